@@ -4,5 +4,6 @@
 #include "taco/tensor.h"
 #include "taco/format.h"
 #include "taco/expr.h"
+#include "taco/jit_cache.h"
 
 #endif
@@ -0,0 +1,21 @@
+#ifndef TACO_JIT_CACHE_H
+#define TACO_JIT_CACHE_H
+
+namespace taco {
+
+/// Counts of JIT compiled kernel libraries that were found in the on-disk
+/// kernel cache (hits) and that had to be compiled and added to it (misses).
+/// Libraries compiled while the cache is disabled are not counted.
+struct JITCacheStats {
+  long hits;
+  long misses;
+};
+
+/// Get the kernel cache statistics of this process. The cache is enabled by
+/// setting the environment variable TACO_CACHE_DIR to a directory, which may
+/// be shared by concurrent processes. Libraries are keyed on their generated
+/// source together with TACO_CC and TACO_CFLAGS.
+JITCacheStats getJITCacheStats();
+
+}
+#endif
@@ -1,17 +1,37 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
 #include <dlfcn.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 
 #include "module.h"
 #include "taco/error.h"
+#include "taco/jit_cache.h"
 #include "taco/util/strings.h"
 #include "taco/util/env.h"
 
 using namespace std;
 
 namespace taco {
+
+namespace {
+std::atomic<long> cacheHits(0);
+std::atomic<long> cacheMisses(0);
+}
+
+JITCacheStats getJITCacheStats() {
+  JITCacheStats stats;
+  stats.hits = cacheHits;
+  stats.misses = cacheMisses;
+  return stats;
+}
+
 namespace ir {
 
 void Module::setJITTmpdir() {
@@ -70,20 +90,74 @@ void Module::compileToStaticLibrary(string path, string prefix) {
   
 namespace {
 
-void writeShims(vector<Stmt> funcs, string path, string prefix) {
+string generateShims(vector<Stmt> funcs) {
   stringstream shims;
   
   for (auto func: funcs) {
     CodeGen_C::generateShim(func, shims);
   }
-  
+  return shims.str();
+}
+
+void writeShims(string shims, string path, string prefix) {
   ofstream shims_file;
   shims_file.open(path+prefix+"_shims.c");
   shims_file << "#include \"" << path << prefix << ".h\"\n";
-  shims_file << shims.str();
+  shims_file << shims;
   shims_file.close();
 }
 
+/// 64-bit FNV-1a hash of str, starting from the given offset basis
+uint64_t fnv1a(const string& str, uint64_t hash) {
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// Name a cache entry by two independent hashes of its key
+string cacheName(const string& key) {
+  char name[33];
+  snprintf(name, sizeof(name), "%016llx%016llx",
+           (unsigned long long)fnv1a(key, 14695981039346656037ULL),
+           (unsigned long long)fnv1a(key, 0x84222325cbf29ce4ULL));
+  return string(name);
+}
+
+bool readFile(const string& path, string* contents) {
+  ifstream file(path, ios::in | ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  stringstream stream;
+  stream << file.rdbuf();
+  *contents = stream.str();
+  return true;
+}
+
+/// Create dir and any missing parents, like mkdir -p. Directories that other
+/// processes create concurrently are fine.
+bool makeDirs(const string& dir) {
+  for (size_t slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1)) {
+    string parent = dir.substr(0, slash);
+    if (mkdir(parent.c_str(), 0777) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (slash == string::npos) {
+      break;
+    }
+  }
+  struct stat info;
+  return stat(dir.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+/// Move a finished file into place. rename() is atomic, so concurrent
+/// processes sharing the cache only ever see complete entries.
+bool publish(const string& from, const string& to) {
+  return rename(from.c_str(), to.c_str()) == 0;
+}
+
 } // anonymous namespace
 
 string Module::compile() {
@@ -93,27 +167,86 @@ string Module::compile() {
   string cc = util::getFromEnv("TACO_CC", "cc");
   string cflags = util::getFromEnv("TACO_CFLAGS",
     "-O3 -ffast-math -std=c99") + " -shared -fPIC";
-  
-  string cmd = cc + " " + cflags + " " +
-    prefix + ".c " +
-    prefix + "_shims.c " +
-    "-o " + prefix + ".so";
 
   // open the output file & write out the source
   compileToSource(tmpdir, libname);
   
   // write out the shims
-  writeShims(funcs, tmpdir, libname);
+  string shims = generateShims(funcs);
+  writeShims(shims, tmpdir, libname);
+
+  // the cache is keyed on everything that determines the compiled library
+  string cachedir = util::getFromEnv("TACO_CACHE_DIR", "");
+  string key;
+  string cachepath;
+  if (cachedir != "") {
+    if (cachedir.back() != '/') {
+      cachedir += '/';
+    }
+    // without a usable cache, compile in the temporary directory instead
+    if (!makeDirs(cachedir)) {
+      taco_uwarning << "Unable to create the kernel cache directory "
+                    << cachedir << ", compiling without it";
+      cachedir = "";
+    }
+  }
+  if (cachedir != "") {
+    key = cc + "\n" + cflags + "\n" + header.str() + "\n" + source.str() +
+          "\n" + shims;
+    cachepath = cachedir + cacheName(key);
+
+    // on a hit, load the library that is already there
+    string cachedkey;
+    if (readFile(cachepath + ".key", &cachedkey) && cachedkey == key) {
+      lib_handle = dlopen((cachepath + ".so").data(), RTLD_NOW | RTLD_LOCAL);
+      if (lib_handle != NULL) {
+        cacheHits++;
+        return cachepath + ".so";
+      }
+    }
+  }
+  
+  // a miss is compiled under a name unique to this module, then published
+  string output = fullpath;
+  string unique = "." + to_string(getpid()) + "." + libname + ".tmp";
+  if (cachedir != "") {
+    output = cachepath + ".so" + unique;
+  }
+
+  string cmd = cc + " " + cflags + " " +
+    prefix + ".c " +
+    prefix + "_shims.c " +
+    "-o " + output;
   
   // now compile it
   int err = system(cmd.data());
   taco_uassert(err == 0) << "Compilation command failed:\n" << cmd
     << "\nreturned " << err;
 
+  // publish the key before the library, so that a visible library always has
+  // a key to check against
+  if (cachedir != "") {
+    ofstream keyfile(cachepath + ".key" + unique, ios::out | ios::binary);
+    keyfile << key;
+    keyfile.close();
+    if (keyfile && publish(cachepath + ".key" + unique, cachepath + ".key") &&
+        publish(output, cachepath + ".so")) {
+      cacheMisses++;
+      output = cachepath + ".so";
+    } else {
+      remove((cachepath + ".key" + unique).c_str());
+    }
+  }
+
   // use dlsym() to open the compiled library
-  lib_handle = dlopen(fullpath.data(), RTLD_NOW | RTLD_LOCAL);
+  lib_handle = dlopen(output.data(), RTLD_NOW | RTLD_LOCAL);
+
+  // an unpublished library is no longer needed on disk once it is loaded
+  if (output != fullpath && output != cachepath + ".so") {
+    remove(output.c_str());
+  }
 
-  return fullpath;
+  return output;
 }
 
 void Module::setSource(string source) {
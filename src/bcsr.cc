@@ -0,0 +1,366 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <omp.h>
+#include "bcsr.h"
+
+/* bcsr_row<c>::dot computes the dot product of one row of a c wide block with
+ * the corresponding c entries of x. Narrow rows are unrolled by recursion on c,
+ * wide rows are left to a SIMD reduction over a loop with constant bounds.
+ */
+template <int c, bool wide = (c >= BCSR_SIMD_WIDTH)>
+struct bcsr_row;
+
+template <int c>
+struct bcsr_row<c, false> {
+  static inline double dot (const double *a, const double *x) {
+    return bcsr_row<c - 1, false>::dot(a, x) + a[c - 1] * x[c - 1];
+  }
+};
+
+template <>
+struct bcsr_row<0, false> {
+  static inline double dot (const double *a, const double *x) {
+    return 0.0;
+  }
+};
+
+template <int c>
+struct bcsr_row<c, true> {
+  static inline double dot (const double *a, const double *x) {
+    double y = 0.0;
+    #pragma omp simd reduction(+:y)
+    for (int l = 0; l < c; l++) {
+      y += a[l] * x[l];
+    }
+    return y;
+  }
+};
+
+/* bcsr_block<r, c>::apply accumulates the product of one r by c block with the
+ * corresponding c entries of x into r entries of y, unrolled by recursion on r.
+ */
+template <int r, int c>
+struct bcsr_block {
+  static inline void apply (const double *a, const double *x, double *y) {
+    bcsr_block<r - 1, c>::apply(a, x, y);
+    y[r - 1] += bcsr_row<c>::dot(a + (r - 1) * c, x);
+  }
+};
+
+template <int c>
+struct bcsr_block<0, c> {
+  static inline void apply (const double *a, const double *x, double *y) {}
+};
+
+/* bcsr_row_mm<c>::dot computes entry v of the product of one row of a c wide
+ * block with the corresponding c rows of a row-major X with k columns.
+ */
+template <int c>
+struct bcsr_row_mm {
+  static inline double dot (const double *a, const double *X, int k, int v) {
+    return bcsr_row_mm<c - 1>::dot(a, X, k, v) + a[c - 1] * X[(c - 1) * k + v];
+  }
+};
+
+template <>
+struct bcsr_row_mm<0> {
+  static inline double dot (const double *a, const double *X, int k, int v) {
+    return 0.0;
+  }
+};
+
+/* bcsr_block_mm<r, c>::apply accumulates the product of one r by c block with
+ * c rows of X into r rows of Y, vectorizing across the k columns.
+ */
+template <int r, int c>
+struct bcsr_block_mm {
+  static inline void apply (const double *a, const double *X, int k, double *Y) {
+    bcsr_block_mm<r - 1, c>::apply(a, X, k, Y);
+    const double *a_row = a + (r - 1) * c;
+    double *y = Y + (r - 1) * k;
+    #pragma omp simd
+    for (int v = 0; v < k; v++) {
+      y[v] += bcsr_row_mm<c>::dot(a_row, X, k, v);
+    }
+  }
+};
+
+template <int c>
+struct bcsr_block_mm<0, c> {
+  static inline void apply (const double *a, const double *X, int k, double *Y) {}
+};
+
+template <int r, int c>
+static void bcsr_kernel_rc (int I_lo,
+                            int I_hi,
+                            const int *ptr,
+                            const int *ind,
+                            const double *val,
+                            const double *x,
+                            double *y) {
+  for (int I = I_lo; I < I_hi; I++) {
+    /* Keep the block row of y in registers */
+    double y_I[r];
+    for (int k = 0; k < r; k++) {
+      y_I[k] = 0.0;
+    }
+    for (int t = ptr[I]; t < ptr[I + 1]; t++) {
+      bcsr_block<r, c>::apply(val + (long)t * (r * c), x + (long)ind[t] * c, y_I);
+    }
+    for (int k = 0; k < r; k++) {
+      y[(long)I * r + k] = y_I[k];
+    }
+  }
+}
+
+template <int r, int c>
+static void bcsr_spmm_kernel_rc (int I_lo,
+                                 int I_hi,
+                                 const int *ptr,
+                                 const int *ind,
+                                 const double *val,
+                                 int k,
+                                 const double *X,
+                                 double *Y) {
+  for (int I = I_lo; I < I_hi; I++) {
+    /* The r by k block row of Y stays in cache while we accumulate into it */
+    double *Y_I = Y + (long)I * r * k;
+    for (long h = 0; h < (long)r * k; h++) {
+      Y_I[h] = 0.0;
+    }
+    for (int t = ptr[I]; t < ptr[I + 1]; t++) {
+      bcsr_block_mm<r, c>::apply(val + (long)t * (r * c), X + (long)ind[t] * c * k, k, Y_I);
+    }
+  }
+}
+
+#define BCSR_KERNEL_ROW(r) \
+  {bcsr_kernel_rc<r, 1>, bcsr_kernel_rc<r, 2>, bcsr_kernel_rc<r, 3>, \
+   bcsr_kernel_rc<r, 4>, bcsr_kernel_rc<r, 5>, bcsr_kernel_rc<r, 6>, \
+   bcsr_kernel_rc<r, 7>, bcsr_kernel_rc<r, 8>, bcsr_kernel_rc<r, 9>, \
+   bcsr_kernel_rc<r, 10>, bcsr_kernel_rc<r, 11>, bcsr_kernel_rc<r, 12>}
+
+static const bcsr_kernel_t kernels[BCSR_MAX_BLOCK][BCSR_MAX_BLOCK] = {
+  BCSR_KERNEL_ROW(1), BCSR_KERNEL_ROW(2), BCSR_KERNEL_ROW(3),
+  BCSR_KERNEL_ROW(4), BCSR_KERNEL_ROW(5), BCSR_KERNEL_ROW(6),
+  BCSR_KERNEL_ROW(7), BCSR_KERNEL_ROW(8), BCSR_KERNEL_ROW(9),
+  BCSR_KERNEL_ROW(10), BCSR_KERNEL_ROW(11), BCSR_KERNEL_ROW(12)
+};
+
+#define BCSR_SPMM_KERNEL_ROW(r) \
+  {bcsr_spmm_kernel_rc<r, 1>, bcsr_spmm_kernel_rc<r, 2>, bcsr_spmm_kernel_rc<r, 3>, \
+   bcsr_spmm_kernel_rc<r, 4>, bcsr_spmm_kernel_rc<r, 5>, bcsr_spmm_kernel_rc<r, 6>, \
+   bcsr_spmm_kernel_rc<r, 7>, bcsr_spmm_kernel_rc<r, 8>, bcsr_spmm_kernel_rc<r, 9>, \
+   bcsr_spmm_kernel_rc<r, 10>, bcsr_spmm_kernel_rc<r, 11>, bcsr_spmm_kernel_rc<r, 12>}
+
+static const bcsr_spmm_kernel_t spmm_kernels[BCSR_MAX_BLOCK][BCSR_MAX_BLOCK] = {
+  BCSR_SPMM_KERNEL_ROW(1), BCSR_SPMM_KERNEL_ROW(2), BCSR_SPMM_KERNEL_ROW(3),
+  BCSR_SPMM_KERNEL_ROW(4), BCSR_SPMM_KERNEL_ROW(5), BCSR_SPMM_KERNEL_ROW(6),
+  BCSR_SPMM_KERNEL_ROW(7), BCSR_SPMM_KERNEL_ROW(8), BCSR_SPMM_KERNEL_ROW(9),
+  BCSR_SPMM_KERNEL_ROW(10), BCSR_SPMM_KERNEL_ROW(11), BCSR_SPMM_KERNEL_ROW(12)
+};
+
+bcsr_kernel_t bcsr_kernel (int r, int c) {
+  if (r < 1 || r > BCSR_MAX_BLOCK || c < 1 || c > BCSR_MAX_BLOCK) {
+    return NULL;
+  }
+  return kernels[r - 1][c - 1];
+}
+
+int bcsr_spmv (const struct bcsr_matrix *A, const double *x, double *y) {
+  bcsr_kernel_t kernel = bcsr_kernel(A->r, A->c);
+  if (kernel == NULL) {
+    return 1;
+  }
+  kernel(0, A->bm, A->ptr, A->ind, A->val, x, y);
+  return 0;
+}
+
+bcsr_spmm_kernel_t bcsr_spmm_kernel (int r, int c) {
+  if (r < 1 || r > BCSR_MAX_BLOCK || c < 1 || c > BCSR_MAX_BLOCK) {
+    return NULL;
+  }
+  return spmm_kernels[r - 1][c - 1];
+}
+
+int bcsr_spmm (const struct bcsr_matrix *A, int k, const double *X, double *Y) {
+  bcsr_spmm_kernel_t kernel = bcsr_spmm_kernel(A->r, A->c);
+  if (kernel == NULL) {
+    return 1;
+  }
+  kernel(0, A->bm, A->ptr, A->ind, A->val, k, X, Y);
+  return 0;
+}
+
+void bcsr_partition (const struct bcsr_matrix *A, int p, int *bounds) {
+  bounds[0] = 0;
+  for (int q = 1; q < p; q++) {
+    /* The first block row starting at or after the q^th share of blocks */
+    long target = ((long)A->nnzb * q) / p;
+    int I = std::lower_bound(A->ptr + bounds[q - 1], A->ptr + A->bm, target) - A->ptr;
+    bounds[q] = I;
+  }
+  bounds[p] = A->bm;
+}
+
+int bcsr_spmv_parallel (const struct bcsr_matrix *A,
+                        int p,
+                        const int *bounds,
+                        const double *x,
+                        double *y) {
+  bcsr_kernel_t kernel = bcsr_kernel(A->r, A->c);
+  if (kernel == NULL) {
+    return 1;
+  }
+  #pragma omp parallel num_threads(p)
+  {
+    /* The runtime may grant fewer than p threads, so cover every part */
+    for (int q = omp_get_thread_num(); q < p; q += omp_get_num_threads()) {
+      kernel(bounds[q], bounds[q + 1], A->ptr, A->ind, A->val, x, y);
+    }
+  }
+  return 0;
+}
+
+int bcsr_spmm_parallel (const struct bcsr_matrix *A,
+                        int p,
+                        const int *bounds,
+                        int k,
+                        const double *X,
+                        double *Y) {
+  bcsr_spmm_kernel_t kernel = bcsr_spmm_kernel(A->r, A->c);
+  if (kernel == NULL) {
+    return 1;
+  }
+  #pragma omp parallel num_threads(p)
+  {
+    for (int q = omp_get_thread_num(); q < p; q += omp_get_num_threads()) {
+      kernel(bounds[q], bounds[q + 1], A->ptr, A->ind, A->val, k, X, Y);
+    }
+  }
+  return 0;
+}
+
+int bcsr_from_csr (struct bcsr_matrix *A,
+                   int m,
+                   int n,
+                   int nnz,
+                   const int *ptr,
+                   const int *ind,
+                   const double *data,
+                   int r,
+                   int c) {
+  assert(m >= 1);
+  assert(n >= 1);
+  A->m = m;
+  A->n = n;
+  A->r = r;
+  A->c = c;
+  A->bm = (m + r - 1) / r;
+  A->bn = (n + c - 1) / c;
+  A->ptr = (int*)malloc(sizeof(int) * (A->bm + 1));
+  if (A->ptr == NULL) {
+    return 1;
+  }
+
+  /* blocks[J] holds one more than the position of block column J in the
+   * current block row, or 0 if the block has not been seen yet.
+   */
+  int *blocks = (int*)malloc(sizeof(int) * A->bn);
+  if (blocks == NULL) {
+    free(A->ptr);
+    return 1;
+  }
+  memset(blocks, 0, sizeof(int) * A->bn);
+
+  /* Count the blocks in each block row */
+  A->ptr[0] = 0;
+  for (int I = 0; I < A->bm; I++) {
+    int K = 0;
+    int i_hi = (I + 1) * r < m ? (I + 1) * r : m;
+    for (int i = I * r; i < i_hi; i++) {
+      for (int t = ptr[i]; t < ptr[i + 1]; t++) {
+        int J = ind[t] / c;
+        if (blocks[J] == 0) {
+          blocks[J] = 1;
+          K++;
+        }
+      }
+    }
+    for (int i = I * r; i < i_hi; i++) {
+      for (int t = ptr[i]; t < ptr[i + 1]; t++) {
+        blocks[ind[t] / c] = 0;
+      }
+    }
+    A->ptr[I + 1] = A->ptr[I] + K;
+  }
+  A->nnzb = A->ptr[A->bm];
+
+  /* A matrix without nonzeros has no blocks, but malloc(0) may return NULL */
+  long nnzb = A->nnzb > 0 ? A->nnzb : 1;
+  A->ind = (int*)malloc(sizeof(int) * nnzb);
+  A->val = (double*)malloc(sizeof(double) * nnzb * r * c);
+  if (A->ind == NULL || A->val == NULL) {
+    free(blocks);
+    bcsr_free(A);
+    return 1;
+  }
+  memset(A->val, 0, sizeof(double) * A->nnzb * r * c);
+
+  /* Place the nonzeros. Blocks appear in the order of their first nonzero,
+   * then each block row is sorted by block column.
+   */
+  for (int I = 0; I < A->bm; I++) {
+    int K = A->ptr[I];
+    int i_hi = (I + 1) * r < m ? (I + 1) * r : m;
+    for (int i = I * r; i < i_hi; i++) {
+      for (int t = ptr[i]; t < ptr[i + 1]; t++) {
+        int J = ind[t] / c;
+        if (blocks[J] == 0) {
+          A->ind[K] = J;
+          K++;
+          blocks[J] = K;
+        }
+      }
+    }
+
+    /* Insertion sort the block columns, keeping blocks[J] in sync */
+    for (int u = A->ptr[I] + 1; u < A->ptr[I + 1]; u++) {
+      int J = A->ind[u];
+      int v = u;
+      while (v > A->ptr[I] && A->ind[v - 1] > J) {
+        A->ind[v] = A->ind[v - 1];
+        blocks[A->ind[v]] = v + 1;
+        v--;
+      }
+      A->ind[v] = J;
+      blocks[J] = v + 1;
+    }
+
+    for (int i = I * r; i < i_hi; i++) {
+      for (int t = ptr[i]; t < ptr[i + 1]; t++) {
+        int j = ind[t];
+        long u = blocks[j / c] - 1;
+        A->val[u * r * c + (i - I * r) * c + (j % c)] = data[t];
+      }
+    }
+
+    for (int u = A->ptr[I]; u < A->ptr[I + 1]; u++) {
+      blocks[A->ind[u]] = 0;
+    }
+  }
+
+  free(blocks);
+  return 0;
+}
+
+void bcsr_free (struct bcsr_matrix *A) {
+  free(A->ptr);
+  free(A->ind);
+  free(A->val);
+  A->ptr = NULL;
+  A->ind = NULL;
+  A->val = NULL;
+}
@@ -0,0 +1,136 @@
+#ifndef BCSR_H
+#define BCSR_H
+
+/* Largest block dimension with a dedicated unrolled kernel. */
+#define BCSR_MAX_BLOCK 12
+
+/* Blocks at least this wide use a SIMD reduction for each block row. */
+#define BCSR_SIMD_WIDTH 4
+
+/**
+ *  An m by n matrix in r by c BCSR format. Block row I owns blocks
+ *  ptr[I] through ptr[I + 1] - 1, block t has block column index ind[t], and
+ *  its r * c values are stored row-major starting at val + t * r * c. Rows and
+ *  columns beyond m and n are explicit zeros, so vectors used with this matrix
+ *  must be padded to bn * c and bm * r entries.
+ */
+struct bcsr_matrix {
+  int m;
+  int n;
+  int r;
+  int c;
+  int bm;
+  int bn;
+  int nnzb;
+  int *ptr;
+  int *ind;
+  double *val;
+};
+
+/**
+ *  Signature of an r by c register-blocked kernel computing y = A * x for
+ *  block rows I_lo <= I < I_hi.
+ */
+typedef void (*bcsr_kernel_t)(int I_lo,
+                              int I_hi,
+                              const int *ptr,
+                              const int *ind,
+                              const double *val,
+                              const double *x,
+                              double *y);
+
+/**
+ *  Convert an m by n CSR matrix into r by c BCSR format. The arrays of A are
+ *  allocated with malloc and should be released with bcsr_free.
+ *
+ *  This routine assumes the CSR matrix uses full storage, and assumes that
+ *  column indicies are sorted.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int bcsr_from_csr (struct bcsr_matrix *A,
+                   int m,
+                   int n,
+                   int nnz,
+                   const int *ptr,
+                   const int *ind,
+                   const double *data,
+                   int r,
+                   int c);
+
+void bcsr_free (struct bcsr_matrix *A);
+
+/**
+ *  Signature of an r by c register-blocked kernel computing Y = A * X for
+ *  block rows I_lo <= I < I_hi, where X and Y are row-major dense matrices
+ *  with k columns.
+ */
+typedef void (*bcsr_spmm_kernel_t)(int I_lo,
+                                   int I_hi,
+                                   const int *ptr,
+                                   const int *ind,
+                                   const double *val,
+                                   int k,
+                                   const double *X,
+                                   double *Y);
+
+/**
+ *  Look up the unrolled kernel for r by c blocks. Returns NULL if r or c is
+ *  outside of 1 through BCSR_MAX_BLOCK.
+ */
+bcsr_kernel_t bcsr_kernel (int r, int c);
+
+/**
+ *  Look up the unrolled multiple vector kernel for r by c blocks. Returns NULL
+ *  if r or c is outside of 1 through BCSR_MAX_BLOCK.
+ */
+bcsr_spmm_kernel_t bcsr_spmm_kernel (int r, int c);
+
+/**
+ *  Compute y = A * x, where x has at least A->bn * A->c entries and y has at
+ *  least A->bm * A->r entries.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int bcsr_spmv (const struct bcsr_matrix *A, const double *x, double *y);
+
+/**
+ *  Split the block rows of A into p contiguous parts holding roughly equal
+ *  numbers of blocks. Part q owns block rows bounds[q] <= I < bounds[q + 1],
+ *  so bounds must have room for p + 1 entries.
+ */
+void bcsr_partition (const struct bcsr_matrix *A, int p, int *bounds);
+
+/**
+ *  Compute y = A * x with p OpenMP threads, where thread q multiplies the
+ *  block rows of part q of a partition computed by bcsr_partition.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int bcsr_spmv_parallel (const struct bcsr_matrix *A,
+                        int p,
+                        const int *bounds,
+                        const double *x,
+                        double *y);
+
+/**
+ *  Compute Y = A * X, where X and Y are row-major with k columns, X has at
+ *  least A->bn * A->c rows, and Y has at least A->bm * A->r rows.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int bcsr_spmm (const struct bcsr_matrix *A, int k, const double *X, double *Y);
+
+/**
+ *  Compute Y = A * X with p OpenMP threads, as in bcsr_spmv_parallel.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int bcsr_spmm_parallel (const struct bcsr_matrix *A,
+                        int p,
+                        const int *bounds,
+                        int k,
+                        const double *X,
+                        double *Y);
+
+#endif
@@ -0,0 +1,54 @@
+#Checks that the mean estimate of sketch over many seeds matches the fill
+#computed by reference on a random matrix, whose block rows mostly hold more
+#blocks than the sketch has registers, so that a bias in the estimator shows
+#up as a ratio away from 1. Run with make check.
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import numpy
+
+parser = argparse.ArgumentParser()
+parser.add_argument("-B", help="the maximum block size", type=int, default=4)
+parser.add_argument("-t", "--trials", help="the number of seeds to average over", type=int, default=200)
+parser.add_argument("--tolerance", help="the largest relative error allowed in the mean", type=float, default=0.01)
+args = parser.parse_args()
+
+fillest = os.path.join(os.path.dirname(os.path.realpath(__file__)), "fillest")
+
+def fill(algo, matrix, epsilon, trials):
+  output = subprocess.check_output([fillest, "-a", algo, "-B", "%d" % args.B, "-e", "%g" % epsilon, "-t", "%d" % trials, "-g", "1", "-r", "-C", matrix])
+  return numpy.array(json.loads(output)[algo]["results"])
+
+directory = tempfile.mkdtemp()
+try:
+  #3000 rows of up to 80 nonzeros scattered over 20000 columns
+  matrix = os.path.join(directory, "random.mtx")
+  random = numpy.random.RandomState(0)
+  m, n = 3000, 20000
+  with open(matrix, "w") as f:
+    rows = [numpy.sort(random.choice(n, random.randint(1, 80), replace = False)) for i in range(m)]
+    f.write("%%MatrixMarket matrix coordinate real general\n")
+    f.write("%d %d %d\n" % (m, n, sum(len(row) for row in rows)))
+    for i, row in enumerate(rows):
+      for j in row:
+        f.write("%d %d 1\n" % (i + 1, j + 1))
+
+  reference = fill("reference", matrix, 0.1, 1)[0]
+  failed = False
+  for epsilon in [0.5, 0.3, 0.2, 0.1]:
+    ratio = numpy.mean(fill("sketch", matrix, epsilon, args.trials), axis = 0) / reference
+    error = numpy.max(numpy.abs(ratio - 1))
+    print("epsilon %g: mean sketch / reference is between %f and %f" % (epsilon, numpy.min(ratio), numpy.max(ratio)))
+    if error > args.tolerance:
+      failed = True
+finally:
+  shutil.rmtree(directory)
+
+if failed:
+  sys.stderr.write("the mean of sketch is more than %g away from reference\n" % args.tolerance)
+  sys.exit(1)
@@ -0,0 +1,191 @@
+#include <linux/perf_event.h>
+#include <omp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "counters.h"
+
+static const char *names[COUNTERS_EVENTS] = {
+  "cycles",
+  "instructions",
+  "llc_misses",
+  "branch_misses",
+  "dtlb_misses"
+};
+
+static const uint32_t types[COUNTERS_EVENTS] = {
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HARDWARE,
+  PERF_TYPE_HW_CACHE
+};
+
+static const uint64_t configs[COUNTERS_EVENTS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES,
+  PERF_COUNT_HW_CACHE_DTLB |
+    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+};
+
+/* Open event e for the calling thread */
+static int open_event (int e) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = types[e];
+  attr.config = configs[e];
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Close the events of thread q */
+static void close_thread (struct counters *counters, int q) {
+  for (int e = 0; e < COUNTERS_EVENTS; e++) {
+    if (counters->fd[q * COUNTERS_EVENTS + e] >= 0) {
+      close(counters->fd[q * COUNTERS_EVENTS + e]);
+    }
+    counters->fd[q * COUNTERS_EVENTS + e] = -1;
+  }
+  counters->tid[q] = -1;
+}
+
+/* Make the events of thread q count the calling thread */
+static void attach_thread (struct counters *counters, int q) {
+  long tid = syscall(SYS_gettid);
+  if (counters->tid[q] == tid) {
+    return;
+  }
+  close_thread(counters, q);
+  for (int e = 0; e < COUNTERS_EVENTS; e++) {
+    counters->fd[q * COUNTERS_EVENTS + e] = open_event(e);
+  }
+  counters->tid[q] = tid;
+}
+
+int counters_open (struct counters *counters, int nthreads) {
+  counters->nthreads = nthreads;
+  counters->fd = (int*)malloc(sizeof(int) * nthreads * COUNTERS_EVENTS);
+  counters->tid = (long*)malloc(sizeof(long) * nthreads);
+  if (counters->fd == NULL || counters->tid == NULL) {
+    free(counters->fd);
+    free(counters->tid);
+    return 1;
+  }
+  for (int h = 0; h < nthreads * COUNTERS_EVENTS; h++) {
+    counters->fd[h] = -1;
+  }
+  for (int q = 0; q < nthreads; q++) {
+    counters->tid[q] = -1;
+  }
+  counters_attach(counters);
+  return 0;
+}
+
+void counters_attach (struct counters *counters) {
+  /* Each thread can only open counters for itself */
+  int team = counters->nthreads;
+  #pragma omp parallel num_threads(counters->nthreads)
+  {
+    attach_thread(counters, omp_get_thread_num());
+    #pragma omp master
+    team = omp_get_num_threads();
+  }
+  for (int q = team; q < counters->nthreads; q++) {
+    close_thread(counters, q);
+  }
+}
+
+static void counters_ioctl (const struct counters *counters, unsigned long request) {
+  for (int h = 0; h < counters->nthreads * COUNTERS_EVENTS; h++) {
+    if (counters->fd[h] >= 0) {
+      ioctl(counters->fd[h], request, 0);
+    }
+  }
+}
+
+void counters_reset (const struct counters *counters) {
+  counters_ioctl(counters, PERF_EVENT_IOC_RESET);
+}
+
+void counters_enable (const struct counters *counters) {
+  counters_ioctl(counters, PERF_EVENT_IOC_ENABLE);
+}
+
+void counters_disable (const struct counters *counters) {
+  counters_ioctl(counters, PERF_EVENT_IOC_DISABLE);
+}
+
+void counters_read (const struct counters *counters, long long *values) {
+  for (int h = 0; h < counters->nthreads * COUNTERS_EVENTS; h++) {
+    /* value, time enabled, time running */
+    uint64_t data[3];
+    values[h] = -1;
+    if (counters->fd[h] >= 0 && read(counters->fd[h], data, sizeof(data)) == sizeof(data)) {
+      if (data[2] == 0) {
+        values[h] = 0;
+      } else if (data[2] < data[1]) {
+        values[h] = (long long)((double)data[0] * data[1] / data[2]);
+      } else {
+        values[h] = data[0];
+      }
+    }
+  }
+}
+
+void counters_close (struct counters *counters) {
+  for (int q = 0; q < counters->nthreads; q++) {
+    close_thread(counters, q);
+  }
+  free(counters->fd);
+  free(counters->tid);
+  counters->fd = NULL;
+  counters->tid = NULL;
+}
+
+static void print_value (long long value) {
+  if (value < 0) {
+    printf("null");
+  } else {
+    printf("%lld", value);
+  }
+}
+
+void counters_print (int nthreads, const long long *values, const char *indent, int comma) {
+  printf("%s\"counters\": {", indent);
+  for (int e = 0; e < COUNTERS_EVENTS; e++) {
+    /* An event is only reported if every thread could count it */
+    long long total = 0;
+    for (int q = 0; q < nthreads; q++) {
+      if (values[q * COUNTERS_EVENTS + e] < 0) {
+        total = -1;
+        break;
+      }
+      total += values[q * COUNTERS_EVENTS + e];
+    }
+    printf("\"%s\": ", names[e]);
+    print_value(total);
+    printf(", ");
+  }
+  printf("\"threads\": [");
+  for (int q = 0; q < nthreads; q++) {
+    printf("{");
+    for (int e = 0; e < COUNTERS_EVENTS; e++) {
+      printf("\"%s\": ", names[e]);
+      print_value(values[q * COUNTERS_EVENTS + e]);
+      printf("%s", e < COUNTERS_EVENTS - 1 ? ", " : "");
+    }
+    printf("}%s", q < nthreads - 1 ? ", " : "");
+  }
+  printf("]}%s\n", comma ? "," : "");
+}
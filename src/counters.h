@@ -0,0 +1,71 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+/* Hardware events counted by counters_open. */
+#define COUNTERS_CYCLES        0
+#define COUNTERS_INSTRUCTIONS  1
+#define COUNTERS_LLC_MISSES    2
+#define COUNTERS_BRANCH_MISSES 3
+#define COUNTERS_DTLB_MISSES   4
+#define COUNTERS_EVENTS        5
+
+/**
+ *  Hardware performance counters for the first nthreads threads of the
+ *  OpenMP thread pool. fd[q * COUNTERS_EVENTS + e] counts event e on thread
+ *  q, or is -1 if the event could not be opened there (for example because
+ *  the kernel does not allow it or the hardware does not support it).
+ *  tid[q] is the operating system thread that thread q's events count, or
+ *  -1 if there is none.
+ */
+struct counters {
+  int nthreads;
+  int *fd;
+  long *tid;
+};
+
+/**
+ *  Open counters on nthreads OpenMP threads. Counters start out disabled and
+ *  only count user space instructions. Threads that OpenMP creates after this
+ *  call (because a later parallel region is larger) are not counted.
+ *
+ *  \returns On success, returns 0, even if some of the events are
+ *  unavailable. On error, returns an error code.
+ */
+int counters_open (struct counters *counters, int nthreads);
+
+/**
+ *  Key the counters by omp_get_thread_num() in a parallel region of
+ *  nthreads threads, reopening the events of any thread number that OpenMP
+ *  now runs on a different operating system thread than when they were
+ *  opened (for example because the pool was resized). If the region has
+ *  fewer than nthreads threads, the events of the missing thread numbers are
+ *  closed and read as unavailable. timing_run calls this after its warmup
+ *  runs, once the trials' pool is in place.
+ */
+void counters_attach (struct counters *counters);
+
+/* Zero the counts */
+void counters_reset (const struct counters *counters);
+
+/* Start or stop counting on every thread */
+void counters_enable (const struct counters *counters);
+void counters_disable (const struct counters *counters);
+
+/**
+ *  Read the counts into values, which has room for nthreads * COUNTERS_EVENTS
+ *  entries laid out like fd. Unavailable events read as -1. Counts are scaled
+ *  up if the kernel had to multiplex the counters.
+ */
+void counters_read (const struct counters *counters, long long *values);
+
+void counters_close (struct counters *counters);
+
+/**
+ *  Print the counts read by counters_read as a JSON member named "counters"
+ *  holding the totals over all threads and a list with the counts of each
+ *  thread. Unavailable events are null. The line starts with indent and is
+ *  followed by a comma if comma is nonzero.
+ */
+void counters_print (int nthreads, const long long *values, const char *indent, int comma);
+
+#endif
@@ -0,0 +1,148 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "estimators.h"
+
+/**
+ *  Given an m by n CSR matrix A, estimates the padding ratio if the matrix
+ *  were converted into a diagonal format of b_r by b_c blocks. Block (I, J)
+ *  holds the entries (i, j) with i / b_r = I and j / b_c = J, and lies on
+ *  block diagonal J - I. The format stores every block of each block
+ *  diagonal that holds a nonzero, one per block row, so the padding ratio is
+ *  b_r times b_c times the number of block rows times the number of
+ *  occupied block diagonals, divided by the number of nonzeros. 1 by 1
+ *  blocks give the DIA format.
+ *
+ *  The block diagonals of the nonzeros that phil samples are counted
+ *  exactly. The occupied block diagonals that no sample falls on are
+ *  estimated from the number of block diagonals sampled once (f_1) and twice
+ *  (f_2) as f_1^2 / (2 f_2) (the Chao1 estimator of the number of unseen
+ *  species). This is close when each occupied block diagonal holds many
+ *  nonzeros, as it does in the matrices where diagonal formats pay off, and
+ *  tends to undercount otherwise. If phil would sample every nonzero, the
+ *  number of block diagonals is exact.
+ *
+ *  The caller supplies this routine with a maximum row and column block size B,
+ *  and this routine returns the estimated padding ratios for all
+ *  1 <= b_r, b_c <= B.
+ *
+ *  This routine assumes the CSR matrix uses full storage, and assumes that
+ *  column indicies are sorted.
+ *
+ *  \param[in] m Logical number of matrix rows
+ *  \param[in] n Logical number of matrix columns
+ *  \param[in] nnz Logical number of matrix nonzeros
+ *  \param[in] *ptr CSR row pointers.
+ *  \param[in] *ind CSR column indices.
+ *  \param[in] B Maximum desired block size
+ *  \param[in] epsilon Epsilon
+ *  \param[in] delta Delta
+ *  \param[in] sigma Sigma
+ *  \param[out] *fill Padding ratios for all specified b_r, b_c in order
+ *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
+ *
+ *  Note that the padding ratios are stored in the same order as the fill
+ *  ratios of the blocked estimators:
+ *  int fill_index = 0;
+ *  for (int b_r = 1; b_r <= B; b_r++) {
+ *    for (int b_c = 1; b_c <= B; b_c++) {
+ *      fill[fill_index] = padding for b_r, b_c
+ *      fill_index++;
+ *    }
+ *  }
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_dia (int m,
+                       int n,
+                       int nnz,
+                       const int *ptr,
+                       const int *ind,
+                       int B,
+                       double epsilon,
+                       double delta,
+                       double sigma,
+                       double *fill,
+                       long seed,
+                       int trial,
+                       int verbose,
+                       struct fill_workspace *workspace){
+  assert(n >= 1);
+  assert(m >= 1);
+
+  /* Compute the necessary number of samples */
+  int s = fill_samples(nnz, B, epsilon, delta);
+
+  /* blocks[J - I + M - 1] counts the samples on block diagonal J - I, of
+   * which there are at most m + n - 1. The workspace keeps it zeroed.
+   */
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, s, (long)m + n)) {
+    return 1;
+  }
+  int *blocks = workspace->blocks;
+  const int *samples_i = workspace->samples_i;
+  const int *samples_j = workspace->samples_j;
+
+  fill_sample_nonzeros(m, nnz, ptr, ind, s, seed, trial, workspace);
+
+  /* see above note about fill order */
+  int fill_index = 0;
+
+  for (int b_r = 1; b_r <= B; b_r++) {
+
+    /* M is the number of block rows */
+    int M = (m + b_r - 1) / b_r;
+
+    for (int b_c = 1; b_c <= B; b_c++) {
+      int N = (n + b_c - 1) / b_c;
+
+      for (int t = 0; t < s; t++) {
+        blocks[samples_j[t] / b_c - samples_i[t] / b_r + M - 1]++;
+      }
+
+      /* Count the sampled block diagonals and how many are sampled once and
+       * twice, zeroing "blocks" as we go so that each is counted once.
+       */
+      long D = 0;
+      long f_1 = 0;
+      long f_2 = 0;
+      for (int t = 0; t < s; t++) {
+        int *count = blocks + samples_j[t] / b_c - samples_i[t] / b_r + M - 1;
+        if (*count) {
+          D++;
+          f_1 += *count == 1;
+          f_2 += *count == 2;
+          *count = 0;
+        }
+      }
+
+      double diagonals = D;
+      if (s < nnz) {
+        diagonals += f_2 ? f_1 * (double)f_1 / (2.0 * f_2) : f_1 * (f_1 - 1.0) / 2.0;
+        diagonals = std::min(diagonals, (double)M + N - 1);
+      }
+      fill[fill_index] = diagonals * M * b_r * b_c / nnz;
+      fill_index++;
+    }
+  }
+
+  fill_workspace_free(&local);
+  return 0;
+}
+
+int reserve_fill_dia (struct fill_workspace *workspace,
+                      int m,
+                      int n,
+                      int nnz,
+                      int B,
+                      double epsilon,
+                      double delta){
+  return fill_workspace_reserve(workspace, fill_samples(nnz, B, epsilon, delta), (long)m + n);
+}
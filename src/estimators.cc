@@ -0,0 +1,181 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include "estimators.h"
+
+const struct estimator estimators[] = {
+  {"phil", estimate_fill_phil, reserve_fill_phil, 0, 0, "bcsr", "Sample nonzeros and count their block neighborhoods"},
+  {"phil_offset", estimate_fill_phil_offset, reserve_fill_phil_offset, 0, 0, "ubcsr", "phil with the blocks at their best row and column offsets"},
+  {"pphil", estimate_fill_pphil, reserve_fill_pphil, 0, 1, "bcsr", "phil with the samples stratified over OpenMP threads"},
+  {"oski", estimate_fill_oski, reserve_fill_oski, 0, 0, "bcsr", "Sample block rows and count their blocks (OSKI)"},
+  {"reference", estimate_fill_reference, reserve_fill_reference, 1, 0, "bcsr", "Count the blocks of every block size exactly"},
+  {"sketch", estimate_fill_sketch, reserve_fill_sketch, 0, 0, "bcsr", "Count the blocks of each block row with a KMV sketch"},
+  {"sell", estimate_fill_sell, reserve_fill_sell, 0, 0, "sell", "Sample row windows and count their SELL-C-sigma padding"},
+  {"ell", estimate_fill_ell, reserve_fill_ell, 1, 0, "ell", "Count the ELLPACK padding of blocks exactly"},
+  {"dia", estimate_fill_dia, reserve_fill_dia, 0, 0, "dia", "Sample nonzeros and count their block diagonals"},
+  {NULL, NULL, NULL, 0, 0, NULL, NULL}
+};
+
+/* Workspace arrays start on cache lines */
+#define FILL_WORKSPACE_ALIGN 64
+
+static int *aligned_ints (long size) {
+  void *p = NULL;
+  if (posix_memalign(&p, FILL_WORKSPACE_ALIGN, sizeof(int) * (size > 0 ? size : 1))) {
+    return NULL;
+  }
+  return (int*)p;
+}
+
+int fill_workspace_reserve (struct fill_workspace *workspace, long samples, long blocks) {
+  if (samples > workspace->samples_size) {
+    free(workspace->samples);
+    free(workspace->samples_i);
+    free(workspace->samples_j);
+    workspace->samples = aligned_ints(samples);
+    workspace->samples_i = aligned_ints(samples);
+    workspace->samples_j = aligned_ints(samples);
+    workspace->samples_size = samples;
+    if (workspace->samples == NULL || workspace->samples_i == NULL || workspace->samples_j == NULL) {
+      workspace->samples_size = 0;
+      return 1;
+    }
+  }
+  if (blocks > workspace->blocks_size) {
+    free(workspace->blocks);
+    workspace->blocks = aligned_ints(blocks);
+    workspace->blocks_size = blocks;
+    if (workspace->blocks == NULL) {
+      workspace->blocks_size = 0;
+      return 1;
+    }
+    memset(workspace->blocks, 0, sizeof(int) * blocks);
+  }
+  return 0;
+}
+
+int fill_workspace_reserve_sums (struct fill_workspace *workspace, long sums) {
+  if (sums > workspace->sums_size) {
+    free(workspace->sums);
+    void *p = NULL;
+    if (posix_memalign(&p, FILL_WORKSPACE_ALIGN, sizeof(double) * sums)) {
+      workspace->sums_size = 0;
+      workspace->sums = NULL;
+      return 1;
+    }
+    workspace->sums = (double*)p;
+    workspace->sums_size = sums;
+  }
+  return 0;
+}
+
+void fill_workspace_free (struct fill_workspace *workspace) {
+  free(workspace->samples);
+  free(workspace->samples_i);
+  free(workspace->samples_j);
+  free(workspace->blocks);
+  free(workspace->sums);
+  workspace->samples_size = 0;
+  workspace->samples = NULL;
+  workspace->samples_i = NULL;
+  workspace->samples_j = NULL;
+  workspace->blocks_size = 0;
+  workspace->blocks = NULL;
+  workspace->sums_size = 0;
+  workspace->sums = NULL;
+}
+
+int fill_samples (int nnz, int B, double epsilon, double delta) {
+  double T = log((2 * B * B) / delta) * B * B * B * B / (2.0 * epsilon * epsilon);
+  return std::min((int)T, nnz);
+}
+
+int fill3_samples (int nnz, int B, double epsilon, double delta) {
+  double T = log((2.0 * B * B * B) / delta) * pow(B, 6) / (2.0 * epsilon * epsilon);
+  return (int)std::min(T, (double)nnz);
+}
+
+int fill_chunk_lower (int n, int p, int q) {
+  return q * (n / p) + std::min(q, n % p);
+}
+
+int fill_chunk_upper (int n, int p, int q) {
+  return fill_chunk_lower(n, p, q + 1);
+}
+
+int fill_chunk_size (int n, int p, int q) {
+  return fill_chunk_upper(n, p, q) - fill_chunk_lower(n, p, q);
+}
+
+long fill_slice_size (int s) {
+  return ((long)s + FILL_SLICE_ALIGN - 1) / FILL_SLICE_ALIGN * FILL_SLICE_ALIGN;
+}
+
+void fill_sample_nonzeros (int m, int nnz, const int *ptr, const int *ind, int s, long seed, int trial, struct fill_workspace *workspace) {
+  int *samples = workspace->samples;
+  int *samples_i = workspace->samples_i;
+  int *samples_j = workspace->samples_j;
+
+  std::seed_seq seeder{seed, (long)trial};
+  std::mt19937 generator(seeder);
+  fill_sample_positions(ptr[0], ptr[0] + nnz, s, s == nnz, &generator, samples);
+  std::sort(samples, samples + s, std::less<int>());
+  fill_sample_convert(m, ptr, ind, samples, s, samples_i, samples_j);
+}
+
+void fill_sample_positions (int lo, int hi, int s, int all, std::mt19937 *generator, int *samples) {
+  if (all) {
+    for (int t = 0; t < s; t++) {
+      samples[t] = lo + t;
+    }
+  } else {
+    std::uniform_int_distribution<> range(lo, hi - 1);
+    for (int t = 0; t < s; t++) {
+      samples[t] = range(*generator);
+    }
+  }
+}
+
+void fill_sample_convert (int m, const int *ptr, const int *ind, const int *samples, int s, int *samples_i, int *samples_j) {
+  int i = 0;
+  for (int t = 0; t < s; t++) {
+    if (ptr[i + 1] <= samples[t]) {
+      i = (std::upper_bound(ptr + i, ptr + m, samples[t]) - ptr) - 1;
+    }
+    samples_i[t] = i;
+    samples_j[t] = ind[samples[t]];
+  }
+}
+
+const struct estimator *estimator_lookup (const char *name) {
+  for (const struct estimator *e = estimators; e->name != NULL; e++) {
+    if (strcmp(e->name, name) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+int estimator_parse (const char *arg, const struct estimator **selected) {
+  int nselected = 0;
+  const char *p = arg;
+  while (*p) {
+    const char *end = strchr(p, ',');
+    size_t length = end ? (size_t)(end - p) : strlen(p);
+    char name[64];
+    if (length == 0 || length >= sizeof(name) || nselected == ESTIMATORS_MAX) {
+      return 0;
+    }
+    memcpy(name, p, length);
+    name[length] = '\0';
+    selected[nselected] = estimator_lookup(name);
+    if (selected[nselected] == NULL) {
+      return 0;
+    }
+    nselected++;
+    p = end ? end + 1 : p + length;
+  }
+  return nselected;
+}
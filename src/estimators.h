@@ -0,0 +1,269 @@
+#ifndef ESTIMATORS_H
+#define ESTIMATORS_H
+
+#include <random>
+
+/**
+ *  Scratch memory reused across calls to the estimators. Arrays are aligned
+ *  to cache lines and only grow. samples, samples_i and samples_j each hold
+ *  samples_size entries, blocks holds blocks_size entries which are zero
+ *  between calls, and sums holds sums_size entries.
+ *
+ *  best_offsets is not scratch memory, but an output that belongs to the
+ *  caller and is left alone by fill_workspace_free. If it is not NULL,
+ *  estimators of offset blocks (phil_offset) store the row and column
+ *  offsets of the smallest fill of b_r by b_c blocks in best_offsets[2 * k]
+ *  and best_offsets[2 * k + 1], where k = (b_r - 1) * B + b_c - 1.
+ */
+struct fill_workspace {
+  long samples_size;
+  int *samples;
+  int *samples_i;
+  int *samples_j;
+  long blocks_size;
+  int *blocks;
+  long sums_size;
+  double *sums;
+  int *best_offsets;
+};
+
+#define FILL_WORKSPACE_INIT {0, NULL, NULL, NULL, 0, NULL, 0, NULL, NULL}
+
+/**
+ *  Make sure the sample arrays of workspace hold at least samples entries and
+ *  blocks holds at least blocks entries. Does not allocate if they already
+ *  do.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int fill_workspace_reserve (struct fill_workspace *workspace, long samples, long blocks);
+
+/**
+ *  Make sure the sums array of workspace holds at least sums entries. Does
+ *  not allocate if it already does.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int fill_workspace_reserve_sums (struct fill_workspace *workspace, long sums);
+
+void fill_workspace_free (struct fill_workspace *workspace);
+
+/**
+ *  The number of nonzeros phil samples to estimate the fill of a matrix with
+ *  nnz nonzeros for block sizes up to B to relative error epsilon with
+ *  probability at least (1 - delta).
+ */
+int fill_samples (int nnz, int B, double epsilon, double delta);
+
+/**
+ *  The number of nonzeros phil3 samples to estimate the fill of an order 3
+ *  tensor with nnz nonzeros for block sizes up to B to relative error
+ *  epsilon with probability at least (1 - delta).
+ */
+int fill3_samples (int nnz, int B, double epsilon, double delta);
+
+/**
+ *  pphil and pphil3 split the positions 0 to n - 1 of the nonzeros into p
+ *  contiguous chunks as evenly as possible, one for each thread. Chunk q
+ *  holds positions fill_chunk_lower(n, p, q) to fill_chunk_upper(n, p, q) - 1.
+ */
+int fill_chunk_lower (int n, int p, int q);
+int fill_chunk_upper (int n, int p, int q);
+int fill_chunk_size (int n, int p, int q);
+
+/* Thread slices of the sample arrays are padded to 16 ints (a cache line) */
+#define FILL_SLICE_ALIGN 16
+
+/* The padded length of a thread slice holding s samples */
+long fill_slice_size (int s);
+
+/**
+ *  Draw s nonzeros of the m row CSR matrix A as phil does, uniformly with
+ *  replacement from a generator seeded with (seed, trial), or every nonzero
+ *  once if s == nnz. Stores the row and column of the t^th sample in
+ *  samples_i[t] and samples_j[t] of workspace, which must hold s samples,
+ *  in order of position in A. As in phil, ptr[0] need not be 0.
+ */
+void fill_sample_nonzeros (int m, int nnz, const int *ptr, const int *ind, int s, long seed, int trial, struct fill_workspace *workspace);
+
+/**
+ *  Store s positions of nonzeros lo <= samples[t] < hi in samples, the
+ *  first step of fill_sample_nonzeros. If all is nonzero, s must be hi - lo
+ *  and every position is stored once in order. Otherwise, the positions are
+ *  drawn uniformly with replacement from generator and are not sorted.
+ */
+void fill_sample_positions (int lo, int hi, int s, int all, std::mt19937 *generator, int *samples);
+
+/**
+ *  Store the row and column of the nonzero at each of the s sorted
+ *  positions in samples of the m row CSR matrix A in samples_i and
+ *  samples_j, the last step of fill_sample_nonzeros.
+ */
+void fill_sample_convert (int m, const int *ptr, const int *ind, const int *samples, int s, int *samples_i, int *samples_j);
+
+/**
+ *  The steps phil takes for each sample (i, j) of the m by n CSR matrix A.
+ *  phil_scan sets the row-major 2B by 2B window Z to 1 where
+ *  (i - B + r, j - B + c) is a nonzero and to 0 elsewhere (stream builds the
+ *  same window from the nonzeros it keeps). phil_prefix replaces Z with its
+ *  2D prefix sums, and
+ *  phil_accumulate then adds the inverse of the number of nonzeros in the
+ *  b_r by b_c block of (i, j) to fill[(b_r - 1) * B + b_c - 1] for all
+ *  1 <= b_r, b_c <= B. After all s samples, phil_normalize turns the sums
+ *  into fill ratios.
+ */
+void phil_scan (int m, int n, const int *ptr, const int *ind, int B, int i, int j, int *Z);
+void phil_prefix (int B, int *Z);
+void phil_accumulate (int B, int i, int j, const int *Z, double *fill);
+void phil_normalize (int B, int s, double *fill);
+
+/**
+ *  Signature of a fill estimator. Given an m by n CSR matrix A, an estimator
+ *  stores an estimate of the fill ratio of A in b_r by b_c BCSR format in
+ *  fill[(b_r - 1) * B + b_c - 1] for all 1 <= b_r, b_c <= B. Randomized
+ *  estimators draw their samples from a generator seeded with (seed, trial).
+ *  The estimator takes its scratch memory from workspace, growing it as
+ *  needed, or allocates its own if workspace is NULL.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+typedef int (*estimate_fill_t)(int m,
+                               int n,
+                               int nnz,
+                               const int *ptr,
+                               const int *ind,
+                               int B,
+                               double epsilon,
+                               double delta,
+                               double sigma,
+                               double *fill,
+                               long seed,
+                               int trial,
+                               int verbose,
+                               struct fill_workspace *workspace);
+
+/**
+ *  Signature of a routine that grows workspace to everything an estimator
+ *  needs for the given problem, so that the estimator will not allocate.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+typedef int (*reserve_fill_t)(struct fill_workspace *workspace,
+                              int m,
+                              int n,
+                              int nnz,
+                              int B,
+                              double epsilon,
+                              double delta);
+
+/**
+ *  A registered fill estimator. exact is nonzero if the estimator always
+ *  computes the exact fill, and parallel is nonzero if it uses all of the
+ *  OpenMP threads. format names the storage format whose fill the estimator
+ *  reports: "bcsr" for b_r by b_c blocks, "ubcsr" for b_r by b_c blocks
+ *  with the best row and column offsets, "sell" for the padding of
+ *  SELL-C-sigma with C = b_r and sigma = b_r * b_c, "ell" for the padding of
+ *  ELLPACK with b_r by b_c blocks, or "dia" for the padding of diagonals of
+ *  b_r by b_c blocks.
+ */
+struct estimator {
+  const char *name;
+  estimate_fill_t estimate_fill;
+  reserve_fill_t reserve_fill;
+  int exact;
+  int parallel;
+  const char *format;
+  const char *description;
+};
+
+/* Every registered estimator, terminated by an entry with a NULL name */
+extern const struct estimator estimators[];
+
+/**
+ *  Find the registered estimator with the given name.
+ *
+ *  \returns The estimator, or NULL if there is no such estimator.
+ */
+const struct estimator *estimator_lookup (const char *name);
+
+/* Longest list of estimators accepted on the command line */
+#define ESTIMATORS_MAX 16
+
+/**
+ *  Parse a comma separated list of estimator names such as "phil,oski" into
+ *  selected, which has room for ESTIMATORS_MAX entries.
+ *
+ *  \returns On success, returns the number of estimators. On error, returns 0.
+ */
+int estimator_parse (const char *arg, const struct estimator **selected);
+
+int estimate_fill_phil (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_phil (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+int estimate_fill_phil_offsets (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int estimate_fill_phil_offset (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_phil_offset (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+int estimate_fill_pphil (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_pphil (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+int estimate_fill_oski (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_oski (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+int estimate_fill_reference (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_reference (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+int estimate_fill_sell (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_sell (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+int estimate_fill_ell (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_ell (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+int estimate_fill_dia (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_dia (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+int estimate_fill_sketch (int m, int n, int nnz, const int *ptr, const int *ind, int B, double epsilon, double delta, double sigma, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_sketch (struct fill_workspace *workspace, int m, int n, int nnz, int B, double epsilon, double delta);
+
+/**
+ *  An order 3 tensor of dimensions m by n by o with nnz nonzeros in CSF
+ *  ({Sparse, Sparse, Sparse}) storage. The nonempty slices are ind_i[0] to
+ *  ind_i[pos_i[1] - 1]. Slice q holds the fibers pos_j[q] to pos_j[q + 1] - 1,
+ *  and fiber f holds (ind_i[q], ind_j[f], ind_k[t]) for pos_k[f] <= t <
+ *  pos_k[f + 1].
+ */
+struct fill3_csf {
+  int m;
+  int n;
+  int o;
+  int nnz;
+  const int *pos_i;
+  const int *ind_i;
+  const int *pos_j;
+  const int *ind_j;
+  const int *pos_k;
+  const int *ind_k;
+};
+
+typedef int (*estimate_fill3_t)(const struct fill3_csf *csf,
+                                int B,
+                                double epsilon,
+                                double delta,
+                                double *fill,
+                                long seed,
+                                int trial,
+                                int verbose,
+                                struct fill_workspace *workspace);
+
+typedef int (*reserve_fill3_t)(struct fill_workspace *workspace,
+                               const struct fill3_csf *csf,
+                               int B,
+                               double epsilon,
+                               double delta);
+
+int estimate_fill_phil3 (const struct fill3_csf *csf, int B, double epsilon, double delta, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_phil3 (struct fill_workspace *workspace, const struct fill3_csf *csf, int B, double epsilon, double delta);
+
+int estimate_fill_pphil3 (const struct fill3_csf *csf, int B, double epsilon, double delta, double *fill, long seed, int trial, int verbose, struct fill_workspace *workspace);
+int reserve_fill_pphil3 (struct fill_workspace *workspace, const struct fill3_csf *csf, int B, double epsilon, double delta);
+
+#endif
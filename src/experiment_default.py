@@ -17,6 +17,7 @@
   "profile_m" : 1000,
   "profile_n" : 1000,
   "profile_trials" : 100,
+  "spmm_vectors" : [4, 8, 16, 32],
   "verbose" : False,
   "table_matrices" : ["3dtube_conv", "gupta1_conv"],
   "plot_points" : {"3dtube_conv": [{"epsilon":e, "delta":0.01, "sigma":s} for (e, s) in zip(exprange(7, 0.2, 10), exprange(0.001, 0.06, 10))],
@@ -0,0 +1,219 @@
+#ifndef FILLEST_H
+#define FILLEST_H
+
+/*
+ * libfillest estimates the fill ratios of a sparse matrix in blocked formats
+ * from inside another program. Link with libfillest.a, OpenMP (-fopenmp) and
+ * the C++ standard library.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  An m by n CSR matrix with nnz nonzeros. Column indices must be sorted
+ *  within each row. Values are not needed to estimate fill.
+ */
+struct estimator_csr {
+  int m;
+  int n;
+  int nnz;
+  const int *ptr;
+  const int *ind;
+};
+
+/**
+ *  Parameters of an estimate. Fill is estimated for all block sizes up to B
+ *  by B. phil and pphil are accurate to relative error epsilon with
+ *  probability at least (1 - delta), and oski examines each block row with
+ *  probability sigma. Randomized estimators seed their generators with
+ *  (seed, trial).
+ */
+struct estimator_params {
+  int B;
+  double epsilon;
+  double delta;
+  double sigma;
+  long seed;
+  int trial;
+  int verbose;
+};
+
+/* An estimator and the workspace it reuses from one estimate to the next */
+struct estimator_context;
+
+/**
+ *  Create a context for the estimator with the given name ("phil",
+ *  "phil_offset", "pphil", "oski", "reference", "sketch", "sell", "ell" or
+ *  "dia"),
+ *  with workspace for matrices of the size of csr and the parameters in
+ *  params.
+ *  "phil_offset" stores the fill of b_r by b_c blocks at their best row and
+ *  column offsets (see estimate_offsets), "sell" stores the padding ratio
+ *  of SELL-C-sigma with C = b_r and sigma = b_r * b_c, "ell" the padding
+ *  ratio of ELLPACK with b_r by b_c blocks, and "dia" the padding ratio of
+ *  the diagonals of b_r by b_c blocks, where the others store the fill of
+ *  b_r by b_c blocks.
+ *
+ *  \returns On success, returns a context to be released with
+ *  estimator_context_free. On error, returns NULL.
+ */
+struct estimator_context *estimator_context_create (const char *name,
+                                                    const struct estimator_csr *csr,
+                                                    const struct estimator_params *params);
+
+/**
+ *  Estimate the fill of csr, storing the fill ratio of b_r by b_c blocks in
+ *  fill[(b_r - 1) * B + b_c - 1] for all 1 <= b_r, b_c <= B. Does not
+ *  allocate memory unless csr or params need a larger workspace than any
+ *  previous call on the context.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate (struct estimator_context *context,
+              const struct estimator_csr *csr,
+              const struct estimator_params *params,
+              double *fill);
+
+/**
+ *  Estimate the fill of csr in b_r by b_c blocks offset by o_r rows and o_c
+ *  columns, as if o_r empty rows and o_c empty columns were prepended to
+ *  csr, storing it in fill[(((b_r - 1) * B + b_c - 1) * B + o_r) * B + o_c]
+ *  for all 1 <= b_r, b_c <= B and 0 <= o_r, o_c < B. Offsets are taken
+ *  modulo the block size. The context must be created for "phil_offset".
+ *  Does not allocate memory unless csr or params need a larger workspace
+ *  than any previous call on the context.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_offsets (struct estimator_context *context,
+                      const struct estimator_csr *csr,
+                      const struct estimator_params *params,
+                      double *fill);
+
+/**
+ *  Estimate the fill of csr into fill as estimate does, storing the row and
+ *  column offsets 0 <= o_r < b_r and 0 <= o_c < b_c at which b_r by b_c
+ *  blocks have that fill in offsets[2 * ((b_r - 1) * B + b_c - 1)] and
+ *  offsets[2 * ((b_r - 1) * B + b_c - 1) + 1]. The context must be created
+ *  for "phil_offset".
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_best_offsets (struct estimator_context *context,
+                           const struct estimator_csr *csr,
+                           const struct estimator_params *params,
+                           double *fill,
+                           int *offsets);
+
+/**
+ *  Estimate the fill of csr into fill as estimate does, then choose the block
+ *  size r by c with the best predicted performance, maximizing
+ *  profile[(r - 1) * B + c - 1] / fill[(r - 1) * B + c - 1]. The profile
+ *  holds the rate (such as the Mflop/s measured by the profile executable)
+ *  at which this machine multiplies a dense matrix stored in b_r by b_c
+ *  blocks at profile[(b_r - 1) * B + b_c - 1]. The estimator must report
+ *  the fill of blocks.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimator_tune (struct estimator_context *context,
+                    const struct estimator_csr *csr,
+                    const struct estimator_params *params,
+                    const double *profile,
+                    double *fill,
+                    int *r,
+                    int *c);
+
+/**
+ *  A roofline model of blocked SpMV on this machine. bandwidth is the
+ *  sustained memory bandwidth in MB/s, and compute[(b_r - 1) * B + b_c - 1]
+ *  is the rate, in Mflop/s, of the b_r by b_c kernel on a matrix that fits in
+ *  cache.
+ */
+struct estimator_model {
+  double bandwidth;
+  const double *compute;
+};
+
+/**
+ *  Predict the seconds taken to multiply an m by n matrix with nnz nonzeros
+ *  by a vector when it is stored in r by c blocks with the given fill, as
+ *  the larger of the time to compute the fill * nnz multiply-adds and the
+ *  time to read the values and index of every block, the block row
+ *  pointers, and x and y once each. B is the maximum block size of
+ *  model->compute.
+ */
+double estimator_model_time (const struct estimator_model *model,
+                             int B,
+                             int m,
+                             int n,
+                             int nnz,
+                             int r,
+                             int c,
+                             double fill);
+
+/**
+ *  Estimate the fill of csr into fill as estimate does, then choose the block
+ *  size r by c with the smallest time predicted by estimator_model_time. The
+ *  estimator must report the fill of blocks.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimator_tune_model (struct estimator_context *context,
+                          const struct estimator_csr *csr,
+                          const struct estimator_params *params,
+                          const struct estimator_model *model,
+                          double *fill,
+                          int *r,
+                          int *c);
+
+/**
+ *  A band of the rows row_lo <= i < row_hi of a matrix, holding nnz nonzeros,
+ *  stored in r by c blocks aligned at row_lo with the given fill, and the
+ *  seconds that estimator_model_time predicts its multiplication takes. The
+ *  bands share x, so the time of a band does not include reading x.
+ */
+struct estimator_band {
+  int row_lo;
+  int row_hi;
+  int nnz;
+  int r;
+  int c;
+  double fill;
+  double time;
+};
+
+/**
+ *  Split csr into bands of band_rows rows for a split BCSR format that
+ *  stores each band in its own block size. The fill of each band is
+ *  estimated by phil on the band alone, and each band takes the block size
+ *  with the smallest time predicted by estimator_model_time. Adjacent bands
+ *  that take the same block size are then merged, so the bands follow the
+ *  regions of the matrix with different structure. The fill of a merged band
+ *  is the average of the fill of its parts weighted by their nonzeros, which
+ *  is exact for block heights that divide band_rows, so band_rows should be
+ *  a multiple of the block heights of the matrix. The context must be
+ *  created for "phil", and fill is scratch space for B * B estimates. bands
+ *  must have room for (m + band_rows - 1) / band_rows bands, and *nbands
+ *  receives the number of bands after merging.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimator_split (struct estimator_context *context,
+                     const struct estimator_csr *csr,
+                     const struct estimator_params *params,
+                     const struct estimator_model *model,
+                     int band_rows,
+                     double *fill,
+                     struct estimator_band *bands,
+                     int *nbands);
+
+void estimator_context_free (struct estimator_context *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
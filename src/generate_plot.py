@@ -24,8 +24,10 @@ for point in util.experiment["plot_points"][args.matrix]:
   row["matrix_m"] = util.matrix_m(args.matrix)
   row["normal_spmv_time"] = util.get_spmv_record(args.matrix)[0][0]
   row.update(point)
-  for name in ["oski", "phil", "pphil"]:
-    output = util.fill_estimates(name, args.matrix, trials = util.experiment["trials"], clock = True, errors = True, spmv_times = True, **point)
+  names = ["oski", "phil", "pphil", "sketch"]
+  outputs = util.fill_estimates_multi(names, args.matrix, trials = util.experiment["trials"], clock = True, errors = True, spmv_times = True, **point)
+  for name in names:
+    output = outputs[name]
     row["{}_mean_time".format(name)] = output["mean_time"]
     row["{}_mean_max_error".format(name)] = numpy.mean(output["max_errors"])
     row["{}_std_max_error".format(name)] = numpy.std(output["max_errors"])
@@ -13,6 +13,10 @@ util.experiment["create_script"](util.experiment["run"], "generate_profile", pre
 #cache spmv_times
 util.experiment["create_script"](util.experiment["run"], "generate_spmv_records", prefix + "python {} -e \"{}\"".format(os.path.join(util.src, "generate_spmv_record.py"), util.read_path(args.experiment)), util.experiment["matrix_registry"].keys())
 
+#cache spmm_times
+if util.experiment["spmm_vectors"]:
+  util.experiment["create_script"](util.experiment["run"], "generate_spmm_records", prefix + "python {} -e \"{}\"".format(os.path.join(util.src, "generate_spmm_record.py"), util.read_path(args.experiment)), util.experiment["matrix_registry"].keys())
+
 #make table data
 if "table_matrices" in util.experiment:
   util.experiment["create_script"](util.experiment["run"], "generate_table_data", prefix + "python {} -e \"{}\"".format(os.path.join(util.src, "generate_table_data.py"), util.read_path(args.experiment)), util.experiment["table_matrices"])
@@ -24,3 +28,8 @@ if "table_matrices" in util.experiment:
 #make plot
 if "plot_points" in util.experiment:
   util.experiment["create_script"](util.experiment["run"], "generate_plots", prefix + "python {} -e \"{}\"".format(os.path.join(util.src, "generate_plot.py"), util.read_path(args.experiment)), util.experiment["plot_points"].keys())
+
+#estimate every matrix of the registry in one process
+util.make_path(util.experiment["experiment"])
+fill_vars = "".join("{}={} ".format(key, value) for (key, value) in util.experiment["fill_vars"].items())
+util.experiment["create_script"](util.experiment["run"], "generate_batch", prefix + "{}{} {} -x \"{}\" -D \"{}\" -a phil,pphil,oski -B {} -e {} -d {} -s {} -t {} -o \"{}\"".format(fill_vars, util.experiment["fill_prefix"], os.path.join(util.src, "fillbatch"), util.read_path(util.experiment["matrix_registry_path"]), util.experiment["matrix"], util.experiment["B"], util.experiment["epsilon"], util.experiment["delta"], util.experiment["sigma"], util.experiment["trials"], os.path.join(util.experiment["experiment"], "batch.json")), [])
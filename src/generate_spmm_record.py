@@ -0,0 +1,14 @@
+import util
+import argparse
+import time
+import sys
+
+tic = time.time()
+
+parser = argparse.ArgumentParser()
+parser.add_argument("matrix", help="the matrix to use", type=str)
+args = util.parse(parser)
+util.get_spmm_records(args.matrix, util.experiment["spmm_vectors"])
+
+toc = time.time()
+sys.stderr.write("generate_spmm_records({}) = {}\n".format(args.matrix, toc - tic))
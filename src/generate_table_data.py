@@ -13,8 +13,10 @@ parser.add_argument("matrix", help="the matrix to use", type=str)
 args = util.parse(parser)
 
 results = {}
-for name in ["oski", "phil", "pphil"]:
-  output = util.fill_estimates(name, args.matrix, trials = util.experiment["trials"], clock = True, errors = True, spmv_times = True)
+names = ["oski", "phil", "pphil"]
+outputs = util.fill_estimates_multi(names, args.matrix, trials = util.experiment["trials"], clock = True, errors = True, spmv_times = True)
+for name in names:
+  output = outputs[name]
   results["{}_mean_time".format(name)] = output["mean_time"]
   results["{}_mean_max_error".format(name)] = numpy.mean(output["max_errors"])
   results["{}_mean_spmv_time".format(name)] = numpy.mean(output["spmv_times"])
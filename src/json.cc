@@ -0,0 +1,154 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "json.h"
+
+void json_space (struct json_reader *json) {
+  while (*json->p == ' ' || *json->p == '\t' || *json->p == '\r' || *json->p == '\n') {
+    json->p++;
+  }
+}
+
+int json_string (struct json_reader *json, std::string *s) {
+  if (*json->p != '"') {
+    return 1;
+  }
+  json->p++;
+  s->clear();
+  while (*json->p != '"') {
+    char ch = *json->p;
+    if (ch == '\0') {
+      return 1;
+    }
+    json->p++;
+    if (ch == '\\') {
+      ch = *json->p;
+      json->p++;
+      switch (ch) {
+        case '"': case '\\': case '/': break;
+        case 'b': ch = '\b'; break;
+        case 'f': ch = '\f'; break;
+        case 'n': ch = '\n'; break;
+        case 'r': ch = '\r'; break;
+        case 't': ch = '\t'; break;
+        default: return 1;
+      }
+    }
+    s->push_back(ch);
+  }
+  json->p++;
+  return 0;
+}
+
+int json_scalar (struct json_reader *json, std::string *text, int *quoted) {
+  *quoted = *json->p == '"';
+  if (*quoted) {
+    return json_string(json, text);
+  }
+  const char *start = json->p;
+  while (*json->p && strchr(",:{}[]\" \t\r\n", *json->p) == NULL) {
+    json->p++;
+  }
+  text->assign(start, json->p - start);
+  return text->empty();
+}
+
+int json_skip (struct json_reader *json) {
+  std::string text;
+  int quoted;
+  json_space(json);
+  if (*json->p == '{') {
+    json->p++;
+    int members = 0;
+    int ret;
+    while ((ret = json_object_next(json, &members, &text)) == 1) {
+      if (json_skip(json)) {
+        return 1;
+      }
+    }
+    return ret < 0;
+  }
+  if (*json->p == '[') {
+    json->p++;
+    json_space(json);
+    if (*json->p == ']') {
+      json->p++;
+      return 0;
+    }
+    while (1) {
+      if (json_skip(json)) {
+        return 1;
+      }
+      json_space(json);
+      if (*json->p == ']') {
+        json->p++;
+        return 0;
+      }
+      if (*json->p != ',') {
+        return 1;
+      }
+      json->p++;
+    }
+  }
+  return json_scalar(json, &text, &quoted);
+}
+
+int json_object_next (struct json_reader *json, int *members, std::string *key) {
+  json_space(json);
+  if (*json->p == '}') {
+    json->p++;
+    return 0;
+  }
+  if (*members > 0) {
+    if (*json->p != ',') {
+      return -1;
+    }
+    json->p++;
+    json_space(json);
+  }
+  if (json_string(json, key)) {
+    return -1;
+  }
+  json_space(json);
+  if (*json->p != ':') {
+    return -1;
+  }
+  json->p++;
+  json_space(json);
+  (*members)++;
+  return 1;
+}
+
+void json_append_string (std::string *out, const std::string &s) {
+  out->push_back('"');
+  for (size_t k = 0; k < s.size(); k++) {
+    unsigned char ch = s[k];
+    if (ch == '"' || ch == '\\') {
+      out->push_back('\\');
+      out->push_back(ch);
+    } else if (ch < 0x20) {
+      json_appendf(out, "\\u%04x", ch);
+    } else {
+      out->push_back(ch);
+    }
+  }
+  out->push_back('"');
+}
+
+void json_appendf (std::string *out, const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int size = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (size < (int)sizeof(buffer)) {
+    out->append(buffer, size);
+    return;
+  }
+  std::vector<char> big(size + 1);
+  va_start(args, format);
+  vsnprintf(big.data(), size + 1, format, args);
+  va_end(args);
+  out->append(big.data(), size);
+}
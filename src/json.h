@@ -0,0 +1,52 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string>
+
+/* A small reader for the JSON requests and registries read by the tools */
+struct json_reader {
+  const char *p;
+};
+
+/* Skip whitespace */
+void json_space (struct json_reader *json);
+
+/**
+ *  Read a string into s.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int json_string (struct json_reader *json, std::string *s);
+
+/**
+ *  Read a string, number or literal into text, setting quoted if it was a
+ *  string. Unquoted values are kept as their JSON text.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int json_scalar (struct json_reader *json, std::string *text, int *quoted);
+
+/**
+ *  Skip any value, including objects and arrays.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int json_skip (struct json_reader *json);
+
+/**
+ *  Step to the next member of an object. members counts the members read so
+ *  far and should start at 0, when the opening brace is consumed. Stores the
+ *  key of the member in key and consumes the colon after it.
+ *
+ *  \returns Returns 1 if there is a member, 0 at the end of the object, and
+ *  -1 on error.
+ */
+int json_object_next (struct json_reader *json, int *members, std::string *key);
+
+/* Append s to out as a quoted JSON string */
+void json_append_string (std::string *out, const std::string &s);
+
+/* Append printf formatted text to out */
+void json_appendf (std::string *out, const char *format, ...);
+
+#endif
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "estimators.h"
+#include "fillest.h"
+
+struct estimator_context {
+  const struct estimator *estimator;
+  struct fill_workspace workspace;
+};
+
+static int estimator_context_reserve (struct estimator_context *context,
+                                      const struct estimator_csr *csr,
+                                      const struct estimator_params *params) {
+  return context->estimator->reserve_fill(&context->workspace, csr->m, csr->n, csr->nnz, params->B, params->epsilon, params->delta);
+}
+
+struct estimator_context *estimator_context_create (const char *name,
+                                                    const struct estimator_csr *csr,
+                                                    const struct estimator_params *params) {
+  const struct estimator *estimator = estimator_lookup(name);
+  if (estimator == NULL) {
+    fprintf(stderr, "unknown estimator: %s\n", name);
+    return NULL;
+  }
+  struct estimator_context *context = (struct estimator_context*)malloc(sizeof(struct estimator_context));
+  if (context == NULL) {
+    return NULL;
+  }
+  context->estimator = estimator;
+  context->workspace = FILL_WORKSPACE_INIT;
+  if (estimator_context_reserve(context, csr, params)) {
+    estimator_context_free(context);
+    return NULL;
+  }
+  return context;
+}
+
+int estimate (struct estimator_context *context,
+              const struct estimator_csr *csr,
+              const struct estimator_params *params,
+              double *fill) {
+  if (csr->m < 1 || csr->n < 1 || params->B < 1) {
+    return 1;
+  }
+  if (estimator_context_reserve(context, csr, params)) {
+    return 1;
+  }
+  return context->estimator->estimate_fill(csr->m, csr->n, csr->nnz, csr->ptr, csr->ind, params->B, params->epsilon, params->delta, params->sigma, fill, params->seed, params->trial, params->verbose, &context->workspace);
+}
+
+int estimate_offsets (struct estimator_context *context,
+                      const struct estimator_csr *csr,
+                      const struct estimator_params *params,
+                      double *fill) {
+  if (context->estimator->estimate_fill != estimate_fill_phil_offset) {
+    fprintf(stderr, "%s does not estimate the fill of offset blocks\n", context->estimator->name);
+    return 1;
+  }
+  if (csr->m < 1 || csr->n < 1 || params->B < 1) {
+    return 1;
+  }
+  if (estimator_context_reserve(context, csr, params)) {
+    return 1;
+  }
+  return estimate_fill_phil_offsets(csr->m, csr->n, csr->nnz, csr->ptr, csr->ind, params->B, params->epsilon, params->delta, params->sigma, fill, params->seed, params->trial, params->verbose, &context->workspace);
+}
+
+int estimate_best_offsets (struct estimator_context *context,
+                           const struct estimator_csr *csr,
+                           const struct estimator_params *params,
+                           double *fill,
+                           int *offsets) {
+  if (context->estimator->estimate_fill != estimate_fill_phil_offset) {
+    fprintf(stderr, "%s does not estimate the fill of offset blocks\n", context->estimator->name);
+    return 1;
+  }
+  context->workspace.best_offsets = offsets;
+  int ret = estimate(context, csr, params, fill);
+  context->workspace.best_offsets = NULL;
+  return ret;
+}
+
+/* Block sizes are only chosen from the fill of blocks */
+static int estimator_blocked (const struct estimator_context *context) {
+  if (strcmp(context->estimator->format, "bcsr") != 0) {
+    fprintf(stderr, "%s does not estimate the fill of blocks\n", context->estimator->name);
+    return 0;
+  }
+  return 1;
+}
+
+int estimator_tune (struct estimator_context *context,
+                    const struct estimator_csr *csr,
+                    const struct estimator_params *params,
+                    const double *profile,
+                    double *fill,
+                    int *r,
+                    int *c) {
+  if (!estimator_blocked(context)) {
+    return 1;
+  }
+  int ret = estimate(context, csr, params, fill);
+  if (ret) {
+    return ret;
+  }
+  int B = params->B;
+  int best = 0;
+  for (int k = 1; k < B * B; k++) {
+    if (profile[k] / fill[k] > profile[best] / fill[best]) {
+      best = k;
+    }
+  }
+  *r = best / B + 1;
+  *c = best % B + 1;
+  return 0;
+}
+
+double estimator_model_time (const struct estimator_model *model,
+                             int B,
+                             int m,
+                             int n,
+                             int nnz,
+                             int r,
+                             int c,
+                             double fill) {
+  double blocks = fill * nnz / (r * c);
+  double bytes = blocks * (sizeof(double) * r * c + sizeof(int)) +
+                 sizeof(int) * ((m + r - 1) / r + 1.0) +
+                 sizeof(double) * ((double)m + n);
+  double memory = bytes / (model->bandwidth * 1e6);
+  double compute = 2.0 * fill * nnz / (model->compute[(r - 1) * B + c - 1] * 1e6);
+  return memory > compute ? memory : compute;
+}
+
+int estimator_tune_model (struct estimator_context *context,
+                          const struct estimator_csr *csr,
+                          const struct estimator_params *params,
+                          const struct estimator_model *model,
+                          double *fill,
+                          int *r,
+                          int *c) {
+  if (!estimator_blocked(context)) {
+    return 1;
+  }
+  int ret = estimate(context, csr, params, fill);
+  if (ret) {
+    return ret;
+  }
+  int B = params->B;
+  double best = -1.0;
+  for (int b_r = 1; b_r <= B; b_r++) {
+    for (int b_c = 1; b_c <= B; b_c++) {
+      double time = estimator_model_time(model, B, csr->m, csr->n, csr->nnz, b_r, b_c, fill[(b_r - 1) * B + b_c - 1]);
+      if (best < 0.0 || time < best) {
+        best = time;
+        *r = b_r;
+        *c = b_c;
+      }
+    }
+  }
+  return 0;
+}
+
+int estimator_split (struct estimator_context *context,
+                     const struct estimator_csr *csr,
+                     const struct estimator_params *params,
+                     const struct estimator_model *model,
+                     int band_rows,
+                     double *fill,
+                     struct estimator_band *bands,
+                     int *nbands) {
+  if (context->estimator->estimate_fill != estimate_fill_phil) {
+    fprintf(stderr, "%s cannot estimate the fill of a band\n", context->estimator->name);
+    return 1;
+  }
+  if (csr->m < 1 || csr->n < 1 || params->B < 1 || band_rows < 1) {
+    return 1;
+  }
+  if (estimator_context_reserve(context, csr, params)) {
+    return 1;
+  }
+  int B = params->B;
+  *nbands = 0;
+  for (int row_lo = 0; row_lo < csr->m; row_lo += band_rows) {
+    struct estimator_band band;
+    band.row_lo = row_lo;
+    band.row_hi = row_lo + band_rows < csr->m ? row_lo + band_rows : csr->m;
+    band.nnz = csr->ptr[band.row_hi] - csr->ptr[row_lo];
+    band.r = 1;
+    band.c = 1;
+    band.fill = 1.0;
+    band.time = estimator_model_time(model, B, band.row_hi - row_lo, 0, band.nnz, 1, 1, 1.0);
+
+    /* Empty bands are stored as they are */
+    if (band.nnz > 0) {
+      int ret = estimate_fill_phil(band.row_hi - row_lo, csr->n, band.nnz, csr->ptr + row_lo, csr->ind, B, params->epsilon, params->delta, params->sigma, fill, params->seed, params->trial, params->verbose, &context->workspace);
+      if (ret) {
+        return ret;
+      }
+      for (int b_r = 1; b_r <= B; b_r++) {
+        for (int b_c = 1; b_c <= B; b_c++) {
+          double band_fill = fill[(b_r - 1) * B + b_c - 1];
+          double time = estimator_model_time(model, B, band.row_hi - row_lo, 0, band.nnz, b_r, b_c, band_fill);
+          if (time < band.time) {
+            band.r = b_r;
+            band.c = b_c;
+            band.fill = band_fill;
+            band.time = time;
+          }
+        }
+      }
+    }
+
+    struct estimator_band *last = *nbands > 0 ? &bands[*nbands - 1] : NULL;
+    if (last != NULL && last->r == band.r && last->c == band.c) {
+      int nnz = last->nnz + band.nnz;
+      if (nnz > 0) {
+        last->fill = (last->fill * last->nnz + band.fill * band.nnz) / nnz;
+      }
+      last->row_hi = band.row_hi;
+      last->nnz = nnz;
+      last->time = estimator_model_time(model, B, last->row_hi - last->row_lo, 0, nnz, last->r, last->c, last->fill);
+    } else {
+      bands[(*nbands)++] = band;
+    }
+  }
+  return 0;
+}
+
+void estimator_context_free (struct estimator_context *context) {
+  fill_workspace_free(&context->workspace);
+  free(context);
+}
@@ -0,0 +1,238 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include "mtx.h"
+
+/* One entry of a row, ordered by column */
+struct mtx_entry {
+  int j;
+  double v;
+};
+
+static bool entry_less (const struct mtx_entry &a, const struct mtx_entry &b) {
+  return a.j < b.j;
+}
+
+/* Read the banner and size line of f into header */
+static int mtx_header_read (FILE *f, const char *path, struct mtx_header *header, char *error) {
+  char *line = NULL;
+  size_t line_size = 0;
+  char head[64] = "", object[64] = "", format[64] = "";
+  if (getline(&line, &line_size, f) < 0 ||
+      sscanf(line, "%63s %63s %63s %63s %63s", head, object, format, header->field, header->symmetry) != 5 ||
+      strcmp(head, "%%MatrixMarket") != 0 ||
+      strcasecmp(object, "matrix") != 0) {
+    snprintf(error, MTX_ERROR_SIZE, "%s is not a MatrixMarket matrix", path);
+    free(line);
+    return 1;
+  }
+  int pattern = strcasecmp(header->field, "pattern") == 0;
+  int mirror = strcasecmp(header->symmetry, "general") != 0;
+  int skew = strcasecmp(header->symmetry, "skew-symmetric") == 0;
+  if (strcasecmp(format, "coordinate") != 0 ||
+      !(pattern || strcasecmp(header->field, "real") == 0 || strcasecmp(header->field, "integer") == 0) ||
+      !(!mirror || strcasecmp(header->symmetry, "symmetric") == 0 || skew)) {
+    snprintf(error, MTX_ERROR_SIZE, "%s must be a real, integer or pattern coordinate matrix", path);
+    free(line);
+    return 1;
+  }
+
+  /* Skip comments to the size line */
+  long m = 0, n = 0, entries = -1;
+  while (getline(&line, &line_size, f) >= 0) {
+    if (line[0] != '%') {
+      sscanf(line, "%ld %ld %ld", &m, &n, &entries);
+      break;
+    }
+  }
+  free(line);
+  if (m < 1 || n < 1 || m > INT_MAX - 1 || n > INT_MAX || entries < 0 || entries > INT_MAX / (mirror ? 2 : 1)) {
+    snprintf(error, MTX_ERROR_SIZE, "%s has a bad size line", path);
+    return 1;
+  }
+  header->m = m;
+  header->n = n;
+  header->entries = entries;
+  return 0;
+}
+
+FILE *mtx_open (const char *path, struct mtx_header *header, char *error) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    snprintf(error, MTX_ERROR_SIZE, "could not open %s: %s", path, strerror(errno));
+    return NULL;
+  }
+  if (mtx_header_read(f, path, header, error)) {
+    fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+int mtx_read_header (const char *path, struct mtx_header *header, char *error) {
+  FILE *f = mtx_open(path, header, error);
+  if (f == NULL) {
+    return 1;
+  }
+  fclose(f);
+  return 0;
+}
+
+int mtx_read_entry (FILE *f, const struct mtx_header *header, char **line, size_t *line_size, long *i, long *j, double *v) {
+  char *p;
+  if (getline(line, line_size, f) < 0) {
+    return -1;
+  }
+  errno = 0;
+  *i = strtol(*line, &p, 10);
+  *j = strtol(p, &p, 10);
+  *v = 1.0;
+  if (strcasecmp(header->field, "pattern") != 0) {
+    *v = strtod(p, &p);
+  }
+  if (errno != 0 || *i < 1 || *i > header->m || *j < 1 || *j > header->n) {
+    return 1;
+  }
+  return 0;
+}
+
+int mtx_read (const char *path, int values, struct csr_matrix *A, char *error) {
+  A->ptr = NULL;
+  A->ind = NULL;
+  A->val = NULL;
+
+  struct mtx_header header;
+  FILE *f = mtx_open(path, &header, error);
+  if (f == NULL) {
+    return 1;
+  }
+  int mirror = strcasecmp(header.symmetry, "general") != 0;
+  double sign = strcasecmp(header.symmetry, "skew-symmetric") == 0 ? -1.0 : 1.0;
+  long m = header.m, n = header.n, entries = header.entries;
+  char *line = NULL;
+  size_t line_size = 0;
+
+  /* Read the coordinates, counting the entries of row i in count[i + 1] */
+  int *I = (int*)malloc(sizeof(int) * (entries * (mirror ? 2 : 1) + 1));
+  int *J = (int*)malloc(sizeof(int) * (entries * (mirror ? 2 : 1) + 1));
+  double *V = (double*)malloc(sizeof(double) * (entries * (mirror ? 2 : 1) + 1));
+  int *count = (int*)calloc(m + 1, sizeof(int));
+  if (I == NULL || J == NULL || V == NULL || count == NULL) {
+    snprintf(error, MTX_ERROR_SIZE, "out of memory reading %s", path);
+    free(I); free(J); free(V); free(count);
+    free(line);
+    fclose(f);
+    return 1;
+  }
+  long t = 0;
+  for (long e = 0; e < entries; e++) {
+    long i, j;
+    double v;
+    int ret = mtx_read_entry(f, &header, &line, &line_size, &i, &j, &v);
+    if (ret < 0) {
+      break;
+    }
+    if (ret > 0) {
+      snprintf(error, MTX_ERROR_SIZE, "%s has a bad entry on line %ld of its entries", path, e + 1);
+      free(I); free(J); free(V); free(count);
+      free(line);
+      fclose(f);
+      return 1;
+    }
+    I[t] = i - 1;
+    J[t] = j - 1;
+    V[t] = v;
+    count[i]++;
+    t++;
+    if (mirror && i != j) {
+      I[t] = j - 1;
+      J[t] = i - 1;
+      V[t] = sign * v;
+      count[j]++;
+      t++;
+    }
+  }
+  free(line);
+  fclose(f);
+
+  /* Bucket the entries by row, using ptr as the next free slot of each row.
+   * Then sort each row and combine duplicates, so that row i moves from
+   * count[i] through count[i + 1] - 1 of rows to the front.
+   */
+  for (long i = 0; i < m; i++) {
+    count[i + 1] += count[i];
+  }
+  struct mtx_entry *rows = (struct mtx_entry*)malloc(sizeof(struct mtx_entry) * (t + 1));
+  A->ptr = (int*)malloc(sizeof(int) * (m + 1));
+  if (rows == NULL || A->ptr == NULL) {
+    snprintf(error, MTX_ERROR_SIZE, "out of memory reading %s", path);
+    free(I); free(J); free(V); free(count); free(rows);
+    csr_free(A);
+    return 1;
+  }
+  memcpy(A->ptr, count, sizeof(int) * (m + 1));
+  for (long s = 0; s < t; s++) {
+    int k = A->ptr[I[s]]++;
+    rows[k].j = J[s];
+    rows[k].v = V[s];
+  }
+  free(I);
+  free(J);
+  free(V);
+
+  int nnz = 0;
+  A->ptr[0] = 0;
+  for (long i = 0; i < m; i++) {
+    std::sort(rows + count[i], rows + count[i + 1], entry_less);
+    for (int k = count[i]; k < count[i + 1]; k++) {
+      if (nnz > A->ptr[i] && rows[nnz - 1].j == rows[k].j) {
+        rows[nnz - 1].v += rows[k].v;
+      } else {
+        rows[nnz] = rows[k];
+        nnz++;
+      }
+    }
+    A->ptr[i + 1] = nnz;
+  }
+  free(count);
+
+  A->ind = (int*)malloc(sizeof(int) * (nnz + 1));
+  if (values) {
+    A->val = (double*)malloc(sizeof(double) * (nnz + 1));
+  }
+  if (A->ind == NULL || (values && A->val == NULL)) {
+    snprintf(error, MTX_ERROR_SIZE, "out of memory reading %s", path);
+    free(rows);
+    csr_free(A);
+    return 1;
+  }
+  for (int k = 0; k < nnz; k++) {
+    A->ind[k] = rows[k].j;
+    if (values) {
+      A->val[k] = rows[k].v;
+    }
+  }
+  free(rows);
+
+  A->m = m;
+  A->n = n;
+  A->nnz = nnz;
+  return 0;
+}
+
+long csr_bytes (const struct csr_matrix *A) {
+  return sizeof(int) * ((long)A->m + 1) + (sizeof(int) + (A->val ? sizeof(double) : 0)) * (long)A->nnz;
+}
+
+void csr_free (struct csr_matrix *A) {
+  free(A->ptr);
+  free(A->ind);
+  free(A->val);
+  A->ptr = NULL;
+  A->ind = NULL;
+  A->val = NULL;
+}
@@ -0,0 +1,83 @@
+#ifndef MTX_H
+#define MTX_H
+
+#include <stdio.h>
+
+/**
+ *  An m by n CSR matrix read from a MatrixMarket file. Row i owns nonzeros
+ *  ptr[i] through ptr[i + 1] - 1, column indices are sorted within each row,
+ *  and val is NULL if the values were not read.
+ */
+struct csr_matrix {
+  int m;
+  int n;
+  int nnz;
+  int *ptr;
+  int *ind;
+  double *val;
+};
+
+/**
+ *  Read the MatrixMarket coordinate matrix at path into A, mirroring the
+ *  entries of symmetric and skew-symmetric matrices and summing duplicate
+ *  entries. The values are only read if values is nonzero. Unlike taco::read,
+ *  this reports errors instead of aborting and may be called from several
+ *  threads at once. On error, a message is stored in error, which has room
+ *  for MTX_ERROR_SIZE characters.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int mtx_read (const char *path, int values, struct csr_matrix *A, char *error);
+
+#define MTX_ERROR_SIZE 256
+
+/**
+ *  The banner and size line of a MatrixMarket coordinate matrix. entries is
+ *  the number of entries stored in the file, before symmetric entries are
+ *  mirrored.
+ */
+struct mtx_header {
+  char field[64];
+  char symmetry[64];
+  long m;
+  long n;
+  long entries;
+};
+
+/**
+ *  Read only the banner and size line of the MatrixMarket coordinate matrix
+ *  at path into header. On error, a message is stored in error, which has
+ *  room for MTX_ERROR_SIZE characters.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int mtx_read_header (const char *path, struct mtx_header *header, char *error);
+
+/**
+ *  Open the MatrixMarket coordinate matrix at path and read its banner and
+ *  size line into header, leaving the file at its first entry. On error, a
+ *  message is stored in error, which has room for MTX_ERROR_SIZE characters.
+ *
+ *  \returns On success, returns the file, to be closed with fclose. On error,
+ *  returns NULL.
+ */
+FILE *mtx_open (const char *path, struct mtx_header *header, char *error);
+
+/**
+ *  Read the next entry of the matrix file f described by header into the
+ *  1-based coordinates i and j and the value v (1 for pattern matrices),
+ *  using the getline buffer line of size line_size.
+ *
+ *  \returns On success, returns 0. At the end of the file, returns -1. If
+ *  the entry is malformed or out of bounds, returns 1.
+ */
+int mtx_read_entry (FILE *f, const struct mtx_header *header, char **line, size_t *line_size, long *i, long *j, double *v);
+
+/**
+ *  The number of bytes held by the arrays of A.
+ */
+long csr_bytes (const struct csr_matrix *A);
+
+void csr_free (struct csr_matrix *A);
+
+#endif
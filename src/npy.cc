@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "json.h"
+#include "npy.h"
+
+int npy_save (const char *path, int ndim, const long *shape, const double *data) {
+  /* The header is a python dict literal padded with spaces and a newline so
+   * that the data starts on a 64 byte boundary.
+   */
+  uint16_t probe = 1;
+  int little = *(unsigned char*)&probe == 1;
+  char header[1024];
+  int size = snprintf(header, sizeof(header), "{'descr': '%cf8', 'fortran_order': False, 'shape': (", little ? '<' : '>');
+  long count = 1;
+  for (int d = 0; d < ndim; d++) {
+    size += snprintf(header + size, sizeof(header) - size, "%ld%s", shape[d], ndim == 1 || d < ndim - 1 ? "," : "");
+    count *= shape[d];
+  }
+  size += snprintf(header + size, sizeof(header) - size, "), }");
+  int padded = (10 + size + 1 + 63) / 64 * 64 - 10;
+  if (padded >= (int)sizeof(header)) {
+    return 1;
+  }
+  memset(header + size, ' ', padded - 1 - size);
+  header[padded - 1] = '\n';
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    return 1;
+  }
+  unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, (unsigned char)(padded & 0xff), (unsigned char)(padded >> 8)};
+  int ret = fwrite(preamble, 1, 10, f) != 10 ||
+            fwrite(header, 1, padded, f) != (size_t)padded ||
+            (count > 0 && fwrite(data, sizeof(double), count, f) != (size_t)count);
+  ret |= fclose(f) != 0;
+  return ret;
+}
+
+/* Find the value of key in the header dict, skipping spaces */
+static const char *npy_header_value (const char *header, const char *key) {
+  const char *p = strstr(header, key);
+  if (p == NULL) {
+    return NULL;
+  }
+  p += strlen(key);
+  while (*p == ' ') {
+    p++;
+  }
+  return p;
+}
+
+static int npy_header_check (const char *header, char order, int ndim, const long *shape) {
+  const char *descr = npy_header_value(header, "'descr':");
+  const char *fortran = npy_header_value(header, "'fortran_order':");
+  const char *dims = npy_header_value(header, "'shape':");
+  if (descr == NULL || !(descr[0] == '\'' && (descr[1] == order || descr[1] == '=') && strncmp(descr + 2, "f8'", 3) == 0) ||
+      fortran == NULL || strncmp(fortran, "False", 5) != 0 ||
+      dims == NULL || *dims != '(') {
+    return 1;
+  }
+  const char *p = dims + 1;
+  for (int d = 0; d < ndim; d++) {
+    char *end;
+    long dim = strtol(p, &end, 10);
+    if (end == p || dim != shape[d]) {
+      return 1;
+    }
+    p = end;
+    while (*p == ' ' || *p == ',') {
+      p++;
+    }
+  }
+  return *p != ')';
+}
+
+int npy_load (const char *path, int ndim, const long *shape, double *data) {
+  uint16_t probe = 1;
+  int little = *(unsigned char*)&probe == 1;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return 1;
+  }
+
+  /* Versions 2 and 3 store the header length in 4 bytes instead of 2 */
+  unsigned char preamble[12];
+  long size = 0;
+  if (fread(preamble, 1, 10, f) != 10 || memcmp(preamble, "\x93NUMPY", 6) != 0) {
+    fclose(f);
+    return 1;
+  }
+  size = preamble[8] | (long)preamble[9] << 8;
+  if (preamble[6] >= 2) {
+    if (fread(preamble + 10, 1, 2, f) != 2) {
+      fclose(f);
+      return 1;
+    }
+    size |= (long)preamble[10] << 16 | (long)preamble[11] << 24;
+  }
+  char *header = (char*)malloc(size + 1);
+  if (header == NULL || fread(header, 1, size, f) != (size_t)size) {
+    free(header);
+    fclose(f);
+    return 1;
+  }
+  header[size] = '\0';
+  int ret = npy_header_check(header, little ? '<' : '>', ndim, shape);
+  free(header);
+
+  long count = 1;
+  for (int d = 0; d < ndim; d++) {
+    count *= shape[d];
+  }
+  ret = ret || (count > 0 && fread(data, sizeof(double), count, f) != (size_t)count);
+  fclose(f);
+  return ret;
+}
+
+int npy_path (char *path, const char *prefix, const char *name) {
+  return snprintf(path, NPY_PATH_SIZE, "%s_%s.npy", prefix, name) >= NPY_PATH_SIZE;
+}
+
+int npy_print (const char *prefix, const char *key, int ndim, const long *shape, const double *data, const char *indent, int comma) {
+  char path[NPY_PATH_SIZE];
+  if (npy_path(path, prefix, key) || npy_save(path, ndim, shape, data)) {
+    fprintf(stderr, "could not write %s_%s.npy\n", prefix, key);
+    return 1;
+  }
+  std::string member;
+  json_append_string(&member, path);
+  printf("%s\"%s_npy\": %s%s\n", indent, key, member.c_str(), comma ? "," : "");
+  return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef NPY_H
+#define NPY_H
+
+/**
+ *  Write the row-major ndim dimensional array of doubles data, with the
+ *  given shape, to path in NumPy's .npy format, so that numpy.load(path)
+ *  returns it as is.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int npy_save (const char *path, int ndim, const long *shape, const double *data);
+
+/**
+ *  Read the .npy array of doubles at path into data, which has room for an
+ *  array of the given shape. The array must be stored in row-major order with
+ *  exactly that shape.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int npy_load (const char *path, int ndim, const long *shape, double *data);
+
+/* Longest path of an array written next to an output prefix */
+#define NPY_PATH_SIZE 4096
+
+/**
+ *  Store "<prefix>_<name>.npy" in path, which has room for NPY_PATH_SIZE
+ *  characters.
+ *
+ *  \returns On success, returns 0. If the path is too long, returns an error
+ *  code.
+ */
+int npy_path (char *path, const char *prefix, const char *name);
+
+/**
+ *  Save data as "<prefix>_<key>.npy" and print its path as the JSON object
+ *  member "<key>_npy" on one line starting with indent, followed by a comma
+ *  if comma is nonzero.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int npy_print (const char *prefix, const char *key, int ndim, const long *shape, const double *data, const char *indent, int comma);
+
+#endif
@@ -4,9 +4,7 @@
 #include <string.h>
 #include <random>
 
-const char *name() {
-  return "oski";
-}
+#include "estimators.h"
 
 /**
  *  Given an m by n CSR matrix A, estimates the fill ratio if the matrix were
@@ -33,6 +31,7 @@ const char *name() {
  *  \param[in] sigma Sigma
  *  \param[out] *fill Fill ratios for all specified b_r, b_c in order
  *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
  *
  *  Note that the fill ratios should be stored according to the following order:
  *  int fill_index = 0;
@@ -45,28 +44,34 @@ const char *name() {
  *
  *  \returns On success, returns 0. On error, returns an error code.
  */
-int estimate_fill (int m,
-                   int n,
-                   int nnz,
-                   const int *ptr,
-                   const int *ind,
-                   int B,
-                   double epsilon,
-                   double delta,
-                   double sigma,
-                   double *fill,
-                   long seed,
-                   int trial,
-                   int verbose){
+int estimate_fill_oski (int m,
+                        int n,
+                        int nnz,
+                        const int *ptr,
+                        const int *ind,
+                        int B,
+                        double epsilon,
+                        double delta,
+                        double sigma,
+                        double *fill,
+                        long seed,
+                        int trial,
+                        int verbose,
+                        struct fill_workspace *workspace){
   assert(n >= 1);
   assert(m >= 1);
 
   /* blocks + (c - 1) * n stores previously seen column block indicies in the
-   * current block row when b_c = c.
+   * current block row when b_c = c. The workspace keeps it zeroed.
    */
-  int *blocks = new int[B * n];
-  assert(blocks != NULL);
-  memset(blocks, 0, sizeof(int) * B * n);
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, 0, (long)B * n)) {
+    return 1;
+  }
+  int *blocks = workspace->blocks;
 
   /* Seed the random generator */
   std::seed_seq seeder{seed, (long)trial};
@@ -153,6 +158,16 @@ int estimate_fill (int m,
     }
   }
 
-  delete[] blocks;
+  fill_workspace_free(&local);
   return 0;
 }
+
+int reserve_fill_oski (struct fill_workspace *workspace,
+                       int m,
+                       int n,
+                       int nnz,
+                       int B,
+                       double epsilon,
+                       double delta){
+  return fill_workspace_reserve(workspace, 0, (long)B * n);
+}
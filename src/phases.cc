@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <string.h>
+#include "phases.h"
+
+#ifdef PHASES_ENABLED
+
+struct phases_thread phases_cycles[PHASES_MAX_THREADS];
+
+static const char *names[PHASES] = {
+  "count",
+  "rng",
+  "sort",
+  "convert",
+  "scan",
+  "prefix",
+  "accumulate",
+  "normalize"
+};
+
+void phases_reset () {
+  memset(phases_cycles, 0, sizeof(phases_cycles));
+}
+
+void phases_print (int nthreads, long calls, const char *indent, int comma) {
+  if (nthreads > PHASES_MAX_THREADS) {
+    nthreads = PHASES_MAX_THREADS;
+  }
+  printf("%s\"phase_cycles\": {", indent);
+  for (int phase = 0; phase < PHASES; phase++) {
+    printf("\"%s\": [", names[phase]);
+    for (int q = 0; q < nthreads; q++) {
+      printf("%.*e%s", DECIMAL_DIG, phases_cycles[q].cycles[phase] / (double)calls, q < nthreads - 1 ? ", " : "");
+    }
+    printf("]%s", phase < PHASES - 1 ? ", " : "");
+  }
+  printf("}%s\n", comma ? "," : "");
+}
+
+#else
+
+void phases_reset () {
+}
+
+void phases_print (int nthreads, long calls, const char *indent, int comma) {
+}
+
+#endif
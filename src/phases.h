@@ -0,0 +1,74 @@
+#ifndef PHASES_H
+#define PHASES_H
+
+/* Phases of a sampling fill estimator. */
+#define PHASE_COUNT      0
+#define PHASE_RNG        1
+#define PHASE_SORT       2
+#define PHASE_CONVERT    3
+#define PHASE_SCAN       4
+#define PHASE_PREFIX     5
+#define PHASE_ACCUMULATE 6
+#define PHASE_NORMALIZE  7
+#define PHASES           8
+
+/* Most threads whose phases are recorded. */
+#define PHASES_MAX_THREADS 256
+
+/**
+ *  When compiled with -DPHASES_ENABLED (make PHASES=1), estimators record the
+ *  cycles each thread spends in each phase. PHASE_START(tic) starts a clock
+ *  named tic, and PHASE_LAP(tic, q, phase) charges the cycles since tic to
+ *  phase on thread q and restarts tic. Otherwise both macros expand to
+ *  nothing.
+ */
+#ifdef PHASES_ENABLED
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline unsigned long long phases_now () {
+  return __rdtsc();
+}
+#else
+#include <chrono>
+static inline unsigned long long phases_now () {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+/* One cache line of counts per thread */
+struct alignas(64) phases_thread {
+  unsigned long long cycles[PHASES];
+};
+
+extern struct phases_thread phases_cycles[PHASES_MAX_THREADS];
+
+#define PHASE_START(tic) unsigned long long tic = phases_now()
+#define PHASE_LAP(tic, q, phase) do {\
+  unsigned long long phase_toc = phases_now();\
+  if ((q) < PHASES_MAX_THREADS) {\
+    phases_cycles[q].cycles[phase] += phase_toc - (tic);\
+  }\
+  tic = phase_toc;\
+} while (0)
+
+#else
+
+#define PHASE_START(tic)
+#define PHASE_LAP(tic, q, phase)
+
+#endif
+
+/* Zero the recorded cycles. */
+void phases_reset ();
+
+/**
+ *  If phases are recorded, print the cycles of the first nthreads threads in
+ *  each phase, divided by calls, as a JSON member named "phase_cycles" that
+ *  maps each phase to a list of per-thread cycles. The line starts with
+ *  indent and is followed by a comma if comma is nonzero. Prints nothing if
+ *  phases are not recorded.
+ */
+void phases_print (int nthreads, long calls, const char *indent, int comma);
+
+#endif
@@ -35,9 +35,90 @@
 #include <stdio.h>
 #include <random>
 #include <algorithm>
+#include "estimators.h"
+#include "phases.h"
 
-const char *name () {
-  return "phil";
+/**
+ *  Set the 2B by 2B row-major window Z to 1 where there are nonzeros in the
+ *  neighborhood of (i, j), so that Z[r][c] is 1 if (i - B + r, j - B + c) is
+ *  a nonzero of A, and to 0 elsewhere.
+ */
+void phil_scan (int m, int n, const int *ptr, const int *ind, int B, int i, int j, int *Z) {
+  int W = 2 * B;
+
+  /* Fill Z with 0 */
+  for (int r = 0; r < W; r++) {
+    for (int c = 0; c < W; c++) {
+      Z[r * W + c] = 0;
+    }
+  }
+
+  /* Set Z to 1 where there are nonzeros in the neighborhood of (i, j) */
+  for (int ii = std::max(i, B - 1) - (B - 1); ii <= std::min(i + (B - 1), m - 1); ii++) {
+    int r = (B + ii) - i;
+    int jj;
+    int jj_min = std::max(j, B - 1) - (B - 1);
+    int jj_max = std::min(j + (B - 1), n - 1);
+
+    int scan = (std::lower_bound(ind + ptr[ii], ind + ptr[ii + 1], jj_min) - ind);
+
+    while (scan < ptr[ii + 1] && (jj = ind[scan]) <= jj_max) {
+      int c = (B + jj) - j;
+      Z[r * W + c] = 1;
+      scan++;
+    }
+  }
+}
+
+/**
+ *  These prefix sums set Z[r][c] to the number of nonzeros in the region
+ *  extending from (i - B + 1, j - B + 1) to (i - B + r, j - B + c) for all
+ *  r > 0, c > 0.
+ */
+void phil_prefix (int B, int *Z) {
+  int W = 2 * B;
+  for (int r = 1; r < W; r++) {
+    for (int c = 1; c < W; c++) {
+      Z[r * W + c] += Z[r * W + c - 1];
+    }
+  }
+
+  for (int r = 1; r < W; r++) {
+    for (int c = 1; c < W; c++) {
+      Z[r * W + c] += Z[(r - 1) * W + c];
+    }
+  }
+}
+
+/**
+ *  Using the prefix sums in Z, compute the number of nonzeros in (i, j)'s
+ *  block for each desired block size, and add its inverse to fill.
+ */
+void phil_accumulate (int B, int i, int j, const int *Z, double *fill) {
+  int W = 2 * B;
+  int fill_index = 0;
+  for (int b_r = 1; b_r <= B; b_r++) {
+    int r_hi = B + b_r - 1 - (i % b_r);
+    int r_lo = r_hi - b_r;
+    for (int b_c = 1; b_c <= B; b_c++) {
+      int c_hi = B + b_c - 1 - (j % b_c);
+      int c_lo = c_hi - b_c;
+      int y_0 = Z[r_hi * W + c_hi] - Z[r_lo * W + c_hi] - Z[r_hi * W + c_lo] + Z[r_lo * W + c_lo];
+      fill[fill_index] += 1.0/y_0;
+      fill_index++;
+    }
+  }
+}
+
+/* Compute the fill from the sums of inverses over s samples stored in fill */
+void phil_normalize (int B, int s, double *fill) {
+  int fill_index = 0;
+  for (int b_r = 1; b_r <= B; b_r++) {
+    for (int b_c = 1; b_c <= B; b_c++) {
+      fill[fill_index] *= b_r * b_c / (double)s;
+      fill_index++;
+    }
+  }
 }
 
 /**
@@ -52,7 +133,9 @@ const char *name () {
  *  1 <= b_r, b_c <= B.
  *
  *  This routine assumes the CSR matrix uses full storage, and assumes that
- *  column indicies are sorted.
+ *  column indicies are sorted. ptr[0] need not be 0, so that the band of
+ *  rows i_lo <= i < i_hi of a larger matrix can be estimated on its own by
+ *  passing ptr + i_lo, with m = i_hi - i_lo and nnz = ptr[i_hi] - ptr[i_lo].
  *
  *  \param[in] m Logical number of matrix rows
  *  \param[in] n Logical number of matrix columns
@@ -65,6 +148,7 @@ const char *name () {
  *  \param[in] sigma Sigma
  *  \param[out] *fill Fill ratios for all specified b_r, b_c in order
  *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
  *
  *  Note that the fill ratios should be stored according to the following order:
  *  int fill_index = 0;
@@ -77,37 +161,41 @@ const char *name () {
  *
  *  \returns On success, returns 0. On error, returns an error code.
  */
-int estimate_fill (int m,
-                   int n,
-                   int nnz,
-                   const int *ptr,
-                   const int *ind,
-                   int B,
-                   double epsilon,
-                   double delta,
-                   double sigma,
-                   double *fill,
-                   long seed,
-                   int trial,
-                   int verbose){
+int estimate_fill_phil (int m,
+                        int n,
+                        int nnz,
+                        const int *ptr,
+                        const int *ind,
+                        int B,
+                        double epsilon,
+                        double delta,
+                        double sigma,
+                        double *fill,
+                        long seed,
+                        int trial,
+                        int verbose,
+                        struct fill_workspace *workspace){
   assert(n >= 1);
   assert(m >= 1);
   int W = 2 * B;
   int Z[W][W];
+  PHASE_START(tic);
 
   /* Compute the necessary number of samples */
-  double T = log((2 * B * B) / delta) * B * B * B * B / (2.0 * epsilon * epsilon);
-  int s;
-
-  s = std::min((int)T, nnz);
+  int s = fill_samples(nnz, B, epsilon, delta);
 
   /* Sample s locations of nonzeros */
-  int *samples = new int[s];
-  assert(samples != NULL);
-  int *samples_i = new int[s];
-  assert(samples_i != NULL);
-  int *samples_j = new int[s];
-  assert(samples_j != NULL);
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, s, 0)) {
+    return 1;
+  }
+  int *samples = workspace->samples;
+  int *samples_i = workspace->samples_i;
+  int *samples_j = workspace->samples_j;
+  PHASE_LAP(tic, 0, PHASE_COUNT);
 
   /* Seed the random generator */
 
@@ -115,31 +203,18 @@ int estimate_fill (int m,
   std::mt19937 generator(seeder);
 
   /* if s == nnz, just compute the fill exactly. Otherwise, sample s nonzeros
-   * so that the samples[t]^th nonzero is included in the sample.
+   * so that the samples[t]^th nonzero is included in the sample. The
+   * nonzeros start at ptr[0], which is only nonzero for a band of rows.
+   * These are the steps of fill_sample_nonzeros, timed separately.
    */
-  if (s == nnz) {
-    for (int t = 0; t < nnz; t++) {
-      samples[t] = t;
-    }
-  } else {
-    std::uniform_int_distribution<> range(0, nnz - 1);
-    for (int t = 0; t < s; t++) {
-      samples[t] = range(generator);
-    }
-  }
+  fill_sample_positions(ptr[0], ptr[0] + nnz, s, s == nnz, &generator, samples);
+  PHASE_LAP(tic, 0, PHASE_RNG);
 
   /* Convert flat samples array to (i, j) pairs in samples_i and samples_j. */
   std::sort(samples, samples + s, std::less<int>());
-  {
-    int i = 0;
-    for (int t = 0; t < s; t++) {
-      if (ptr[i + 1] <= samples[t]) {
-        i = (std::upper_bound(ptr + i, ptr + m, samples[t]) - ptr) - 1;
-      }
-      samples_i[t] = i;
-      samples_j[t] = ind[samples[t]];
-    }
-  }
+  PHASE_LAP(tic, 0, PHASE_SORT);
+  fill_sample_convert(m, ptr, ind, samples, s, samples_i, samples_j);
+  PHASE_LAP(tic, 0, PHASE_CONVERT);
 
   /* Zero out the fill */
   int fill_index = 0;
@@ -154,76 +229,200 @@ int estimate_fill (int m,
     int i = samples_i[t];
     int j = samples_j[t];
 
-    /* Fill Z with 0 */
-    for (int r = 0; r < W; r++) {
-      for (int c = 0; c < W; c++) {
-        Z[r][c] = 0;
-      }
-    }
+    phil_scan(m, n, ptr, ind, B, i, j, &Z[0][0]);
+    PHASE_LAP(tic, 0, PHASE_SCAN);
 
-    /* Set Z to 1 where there are nonzeros in the neighborhood of (i, j) */
-    for (int ii = std::max(i, B - 1) - (B - 1); ii <= std::min(i + (B - 1), m - 1); ii++) {
-      int r = (B + ii) - i;
-      int jj;
-      int jj_min = std::max(j, B - 1) - (B - 1);
-      int jj_max = std::min(j + (B - 1), n - 1);
+    phil_prefix(B, &Z[0][0]);
+    PHASE_LAP(tic, 0, PHASE_PREFIX);
 
-      int scan = (std::lower_bound(ind + ptr[ii], ind + ptr[ii + 1], jj_min) - ind);
+    phil_accumulate(B, i, j, &Z[0][0], fill);
+    PHASE_LAP(tic, 0, PHASE_ACCUMULATE);
+  }
 
-      while (scan < ptr[ii + 1] && (jj = ind[scan]) <= jj_max) {
-        int c = (B + jj) - j;
-        Z[r][c] = 1;
-        scan++;
-      }
-    }
+  phil_normalize(B, s, fill);
 
-    /* These prefix sums set Z[r][c] to the number of nonzeros in the region
-     * extending from (i - B + 1, j - B + 1) to (i - B + r, j - B + c) for all
-     * r > 0, c > 0.
-     */
-    for (int r = 1; r < W; r++) {
-      for (int c = 1; c < W; c++) {
-        Z[r][c] += Z[r][c - 1];
-      }
-    }
+  fill_workspace_free(&local);
+  PHASE_LAP(tic, 0, PHASE_NORMALIZE);
+  return 0;
+}
 
-    for (int r = 1; r < W; r++) {
-      for (int c = 1; c < W; c++) {
-        Z[r][c] += Z[r - 1][c];
-      }
-    }
+int reserve_fill_phil (struct fill_workspace *workspace,
+                       int m,
+                       int n,
+                       int nnz,
+                       int B,
+                       double epsilon,
+                       double delta){
+  return fill_workspace_reserve(workspace, fill_samples(nnz, B, epsilon, delta), 0);
+}
+
+/**
+ *  Given an m by n CSR matrix A, estimates the fill ratio if the matrix were
+ *  converted into b_r by b_c BCSR format with its blocks offset by o_r rows
+ *  and o_c columns, as if o_r empty rows and o_c empty columns were
+ *  prepended to A. This is the unaligned BCSR format, whose first block row
+ *  and column hold only b_r - o_r rows and b_c - o_c columns of A. The
+ *  estimates use the same samples as phil, so they share its accuracy for
+ *  each offset, and are exact when phil would sample every nonzero.
+ *
+ *  The caller supplies this routine with a maximum row and column block size
+ *  B, and this routine returns the estimated fill ratios for all
+ *  1 <= b_r, b_c <= B and 0 <= o_r, o_c < B, in
+ *  fill[(((b_r - 1) * B + b_c - 1) * B + o_r) * B + o_c]. Offsets are taken
+ *  modulo the block size, so the fill with offsets o_r >= b_r or o_c >= b_c
+ *  is the fill with offsets o_r % b_r and o_c % b_c.
+ *
+ *  The parameters are those of estimate_fill_phil.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_phil_offsets (int m,
+                                int n,
+                                int nnz,
+                                const int *ptr,
+                                const int *ind,
+                                int B,
+                                double epsilon,
+                                double delta,
+                                double sigma,
+                                double *fill,
+                                long seed,
+                                int trial,
+                                int verbose,
+                                struct fill_workspace *workspace){
+  assert(n >= 1);
+  assert(m >= 1);
+  int W = 2 * B;
+  int Z[W][W];
+
+  /* Compute the necessary number of samples */
+  int s = fill_samples(nnz, B, epsilon, delta);
+
+  /* Sample s locations of nonzeros as phil does */
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, s, 0)) {
+    return 1;
+  }
+  fill_sample_nonzeros(m, nnz, ptr, ind, s, seed, trial, workspace);
+  const int *samples_i = workspace->samples_i;
+  const int *samples_j = workspace->samples_j;
+
+  /* Zero out the fill */
+  for (long k = 0; k < (long)B * B * B * B; k++) {
+    fill[k] = 0.0;
+  }
+
+  for (int t = 0; t < s; t++) {
+    int i = samples_i[t];
+    int j = samples_j[t];
+
+    phil_scan(m, n, ptr, ind, B, i, j, &Z[0][0]);
+    phil_prefix(B, &Z[0][0]);
 
     /* Using Z, compute the number of nonzeros in (i, j)'s block for each
-     * desired block size.
+     * desired block size and offset.
      */
-    int fill_index = 0;
     for (int b_r = 1; b_r <= B; b_r++) {
-      int r_hi = B + b_r - 1 - (i % b_r);
-      int r_lo = r_hi - b_r;
-      for (int b_c = 1; b_c <= B; b_c++) {
-        int c_hi = B + b_c - 1 - (j % b_c);
-        int c_lo = c_hi - b_c;
-        int y_0 = Z[r_hi][c_hi] - Z[r_lo][c_hi] - Z[r_hi][c_lo] + Z[r_lo][c_lo];
-        /* Compute the average inverse of the number of nozeros in (i, j)'s
-         * block.
-         */
-        fill[fill_index] += 1.0/y_0;
-        fill_index++;
+      for (int o_r = 0; o_r < b_r; o_r++) {
+        int r_hi = B + b_r - 1 - ((i + o_r) % b_r);
+        int r_lo = r_hi - b_r;
+        for (int b_c = 1; b_c <= B; b_c++) {
+          double *offsets = fill + (((long)(b_r - 1) * B + b_c - 1) * B + o_r) * B;
+          for (int o_c = 0; o_c < b_c; o_c++) {
+            int c_hi = B + b_c - 1 - ((j + o_c) % b_c);
+            int c_lo = c_hi - b_c;
+            int y_0 = Z[r_hi][c_hi] - Z[r_lo][c_hi] - Z[r_hi][c_lo] + Z[r_lo][c_lo];
+            offsets[o_c] += 1.0/y_0;
+          }
+        }
       }
     }
   }
 
-  /* Compute the fill from the average inverses stored in fill array */
-  fill_index = 0;
+  /* Compute the fill from the average inverses, copying it to the offsets
+   * that are equal modulo the block size.
+   */
   for (int b_r = 1; b_r <= B; b_r++) {
     for (int b_c = 1; b_c <= B; b_c++) {
-      fill[fill_index] *= b_r * b_c / (double)s;
-      fill_index++;
+      double *offsets = fill + ((long)(b_r - 1) * B + b_c - 1) * B * B;
+      for (int o_r = 0; o_r < B; o_r++) {
+        for (int o_c = 0; o_c < B; o_c++) {
+          if (o_r < b_r && o_c < b_c) {
+            offsets[o_r * B + o_c] *= b_r * b_c / (double)s;
+          } else {
+            offsets[o_r * B + o_c] = offsets[(o_r % b_r) * B + o_c % b_c];
+          }
+        }
+      }
     }
   }
 
-  delete[] samples;
-  delete[] samples_i;
-  delete[] samples_j;
+  fill_workspace_free(&local);
   return 0;
 }
+
+/**
+ *  Estimates the fill ratio of A in b_r by b_c BCSR format with the best
+ *  offsets of the blocks, storing in fill[(b_r - 1) * B + b_c - 1] the
+ *  smallest fill over all offsets that estimate_fill_phil_offsets estimates
+ *  for b_r by b_c blocks. The offsets o_r < b_r and o_c < b_c of that fill
+ *  go to workspace->best_offsets if it is not NULL.
+ *
+ *  The parameters are those of estimate_fill_phil.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_phil_offset (int m,
+                               int n,
+                               int nnz,
+                               const int *ptr,
+                               const int *ind,
+                               int B,
+                               double epsilon,
+                               double delta,
+                               double sigma,
+                               double *fill,
+                               long seed,
+                               int trial,
+                               int verbose,
+                               struct fill_workspace *workspace){
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve_sums(workspace, (long)B * B * B * B)) {
+    return 1;
+  }
+  double *offsets = workspace->sums;
+  int *best_offsets = workspace->best_offsets;
+  int ret = estimate_fill_phil_offsets(m, n, nnz, ptr, ind, B, epsilon, delta, sigma, offsets, seed, trial, verbose, workspace);
+  if (ret == 0) {
+    for (int k = 0; k < B * B; k++) {
+      const double *grid = offsets + (long)k * B * B;
+      long best = std::min_element(grid, grid + B * B) - grid;
+      fill[k] = grid[best];
+
+      /* Offsets beyond the block size repeat smaller ones */
+      if (best_offsets != NULL) {
+        best_offsets[2 * k] = (best / B) % (k / B + 1);
+        best_offsets[2 * k + 1] = (best % B) % (k % B + 1);
+      }
+    }
+  }
+  fill_workspace_free(&local);
+  return ret;
+}
+
+int reserve_fill_phil_offset (struct fill_workspace *workspace,
+                              int m,
+                              int n,
+                              int nnz,
+                              int B,
+                              double epsilon,
+                              double delta){
+  return fill_workspace_reserve(workspace, fill_samples(nnz, B, epsilon, delta), 0) ||
+         fill_workspace_reserve_sums(workspace, (long)B * B * B * B);
+}
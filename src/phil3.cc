@@ -0,0 +1,344 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <algorithm>
+#include <omp.h>
+#include "estimators.h"
+
+/* Sort the s positions of nonzeros in samples and store their i and j
+ * coordinates in samples_i and samples_j. Their k coordinates are
+ * csf->ind_k[samples[t]].
+ */
+static void phil3_convert (const struct fill3_csf *csf,
+                           int *samples,
+                           int *samples_i,
+                           int *samples_j,
+                           int s) {
+  std::sort(samples, samples + s, std::less<int>());
+  int F = csf->pos_j[csf->pos_i[1]];
+  int S = csf->pos_i[1];
+  int f = 0;
+  int q = 0;
+  for (int t = 0; t < s; t++) {
+    if (csf->pos_k[f + 1] <= samples[t]) {
+      f = (std::upper_bound(csf->pos_k + f, csf->pos_k + F, samples[t]) - csf->pos_k) - 1;
+    }
+    if (csf->pos_j[q + 1] <= f) {
+      q = (std::upper_bound(csf->pos_j + q, csf->pos_j + S, f) - csf->pos_j) - 1;
+    }
+    samples_i[t] = csf->ind_i[q];
+    samples_j[t] = csf->ind_j[f];
+  }
+}
+
+/* Add the inverse of the number of nonzeros in the block of each sample to
+ * fill, for each block size.
+ */
+static void phil3_accumulate (const struct fill3_csf *csf,
+                              int B,
+                              const int *samples,
+                              const int *samples_i,
+                              const int *samples_j,
+                              int s,
+                              double *fill) {
+  int W = 2 * B;
+  int Z[W][W][W];
+  int S = csf->pos_i[1];
+
+  for (int t = 0; t < s; t++) {
+    int i = samples_i[t];
+    int j = samples_j[t];
+    int k = csf->ind_k[samples[t]];
+
+    /* Fill Z with 0 */
+    for (int r = 0; r < W; r++) {
+      for (int c = 0; c < W; c++) {
+        for (int d = 0; d < W; d++) {
+          Z[r][c][d] = 0;
+        }
+      }
+    }
+
+    /* Set Z to 1 where there are nonzeros in the neighborhood of (i, j, k),
+     * searching the slices, then the fibers of each slice, then the
+     * nonzeros of each fiber.
+     */
+    int ii_min = std::max(i, B - 1) - (B - 1);
+    int jj_min = std::max(j, B - 1) - (B - 1);
+    int kk_min = std::max(k, B - 1) - (B - 1);
+    int q = std::lower_bound(csf->ind_i, csf->ind_i + S, ii_min) - csf->ind_i;
+    for (; q < S && csf->ind_i[q] <= i + (B - 1); q++) {
+      int r = (B + csf->ind_i[q]) - i;
+      int f = std::lower_bound(csf->ind_j + csf->pos_j[q], csf->ind_j + csf->pos_j[q + 1], jj_min) - csf->ind_j;
+      for (; f < csf->pos_j[q + 1] && csf->ind_j[f] <= j + (B - 1); f++) {
+        int c = (B + csf->ind_j[f]) - j;
+        int scan = std::lower_bound(csf->ind_k + csf->pos_k[f], csf->ind_k + csf->pos_k[f + 1], kk_min) - csf->ind_k;
+        for (; scan < csf->pos_k[f + 1] && csf->ind_k[scan] <= k + (B - 1); scan++) {
+          int d = (B + csf->ind_k[scan]) - k;
+          Z[r][c][d] = 1;
+        }
+      }
+    }
+
+    /* These prefix sums set Z[r][c][d] to the number of nonzeros in the
+     * region extending from (i - B + 1, j - B + 1, k - B + 1) to
+     * (i - B + r, j - B + c, k - B + d) for all r > 0, c > 0, d > 0.
+     */
+    for (int r = 1; r < W; r++) {
+      for (int c = 1; c < W; c++) {
+        for (int d = 1; d < W; d++) {
+          Z[r][c][d] += Z[r][c][d - 1];
+        }
+      }
+    }
+
+    for (int r = 1; r < W; r++) {
+      for (int c = 1; c < W; c++) {
+        for (int d = 1; d < W; d++) {
+          Z[r][c][d] += Z[r][c - 1][d];
+        }
+      }
+    }
+
+    for (int r = 1; r < W; r++) {
+      for (int c = 1; c < W; c++) {
+        for (int d = 1; d < W; d++) {
+          Z[r][c][d] += Z[r - 1][c][d];
+        }
+      }
+    }
+
+    /* Using Z, compute the number of nonzeros in (i, j, k)'s block for each
+     * desired block size.
+     */
+    int fill_index = 0;
+    for (int b_i = 1; b_i <= B; b_i++) {
+      int r_hi = B + b_i - 1 - (i % b_i);
+      int r_lo = r_hi - b_i;
+      for (int b_j = 1; b_j <= B; b_j++) {
+        int c_hi = B + b_j - 1 - (j % b_j);
+        int c_lo = c_hi - b_j;
+        for (int b_k = 1; b_k <= B; b_k++) {
+          int d_hi = B + b_k - 1 - (k % b_k);
+          int d_lo = d_hi - b_k;
+          int y_0 = Z[r_hi][c_hi][d_hi] - Z[r_lo][c_hi][d_hi] - Z[r_hi][c_lo][d_hi] - Z[r_hi][c_hi][d_lo]
+                  + Z[r_lo][c_lo][d_hi] + Z[r_lo][c_hi][d_lo] + Z[r_hi][c_lo][d_lo] - Z[r_lo][c_lo][d_lo];
+          fill[fill_index] += 1.0/y_0;
+          fill_index++;
+        }
+      }
+    }
+  }
+}
+
+/* Compute the fill from the sums of inverses stored in fill */
+static void phil3_normalize (int B, int s, double *fill) {
+  int fill_index = 0;
+  for (int b_i = 1; b_i <= B; b_i++) {
+    for (int b_j = 1; b_j <= B; b_j++) {
+      for (int b_k = 1; b_k <= B; b_k++) {
+        fill[fill_index] *= b_i * b_j * b_k / (double)s;
+        fill_index++;
+      }
+    }
+  }
+}
+
+/**
+ *  Given an order 3 tensor A stored in CSF, estimates the fill ratio if the
+ *  tensor were converted into b_i by b_j by b_k blocks. The fill ratio is
+ *  b_i times b_j times b_k times the number of nonzero blocks divided by the
+ *  number of nonzeros. Like phil, this samples nonzeros uniformly and counts
+ *  the nonzeros in the (2B - 1)^3 neighborhood of each, which holds the
+ *  block of the sample for every block size.
+ *
+ *  The caller supplies this routine with a maximum block size B, and this
+ *  routine returns the estimated fill ratios for all
+ *  1 <= b_i, b_j, b_k <= B.
+ *
+ *  This routine assumes that the coordinates of each level of the CSF
+ *  storage are sorted.
+ *
+ *  \param[in] *csf CSF storage of the tensor
+ *  \param[in] B Maximum desired block size
+ *  \param[in] epsilon Epsilon
+ *  \param[in] delta Delta
+ *  \param[out] *fill Fill ratios for all specified b_i, b_j, b_k in order
+ *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
+ *
+ *  Note that the fill ratios should be stored according to the following order:
+ *  int fill_index = 0;
+ *  for (int b_i = 1; b_i <= B; b_i++) {
+ *    for (int b_j = 1; b_j <= B; b_j++) {
+ *      for (int b_k = 1; b_k <= B; b_k++) {
+ *        fill[fill_index] = fill for b_i, b_j, b_k
+ *        fill_index++;
+ *      }
+ *    }
+ *  }
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_phil3 (const struct fill3_csf *csf,
+                         int B,
+                         double epsilon,
+                         double delta,
+                         double *fill,
+                         long seed,
+                         int trial,
+                         int verbose,
+                         struct fill_workspace *workspace){
+  int nnz = csf->nnz;
+  assert(nnz >= 1);
+
+  /* Compute the necessary number of samples */
+  int s = fill3_samples(nnz, B, epsilon, delta);
+
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, s, 0)) {
+    return 1;
+  }
+  int *samples = workspace->samples;
+  int *samples_i = workspace->samples_i;
+  int *samples_j = workspace->samples_j;
+
+  /* if s == nnz, just compute the fill exactly. Otherwise, sample s nonzeros
+   * so that the samples[t]^th nonzero is included in the sample.
+   */
+  std::seed_seq seeder{seed, (long)trial};
+  std::mt19937 generator(seeder);
+  if (s == nnz) {
+    for (int t = 0; t < nnz; t++) {
+      samples[t] = t;
+    }
+  } else {
+    std::uniform_int_distribution<> range(0, nnz - 1);
+    for (int t = 0; t < s; t++) {
+      samples[t] = range(generator);
+    }
+  }
+  phil3_convert(csf, samples, samples_i, samples_j, s);
+
+  for (int fill_index = 0; fill_index < B * B * B; fill_index++) {
+    fill[fill_index] = 0.0;
+  }
+  phil3_accumulate(csf, B, samples, samples_i, samples_j, s, fill);
+  phil3_normalize(B, s, fill);
+
+  fill_workspace_free(&local);
+  return 0;
+}
+
+int reserve_fill_phil3 (struct fill_workspace *workspace,
+                        const struct fill3_csf *csf,
+                        int B,
+                        double epsilon,
+                        double delta){
+  return fill_workspace_reserve(workspace, fill3_samples(csf->nnz, B, epsilon, delta), 0);
+}
+
+/**
+ *  phil3 with the samples stratified over OpenMP threads as in pphil. Each
+ *  thread samples, converts, and counts the neighborhoods of the nonzeros in
+ *  its own contiguous range of positions, so the estimates differ from those
+ *  of phil3 with the same seed but have the same distribution.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_pphil3 (const struct fill3_csf *csf,
+                          int B,
+                          double epsilon,
+                          double delta,
+                          double *fill,
+                          long seed,
+                          int trial,
+                          int verbose,
+                          struct fill_workspace *workspace){
+  int p = omp_get_max_threads();
+  int nnz = csf->nnz;
+  assert(nnz >= 1);
+
+  /* Compute the necessary number of samples */
+  int s = fill3_samples(nnz, B, epsilon, delta);
+
+  /* Stratify the samples */
+  std::seed_seq seeder{seed, (long)trial};
+  std::mt19937 generator(seeder);
+  int s_p[p];
+  if (s == nnz) {
+    for (int q = 0; q < p; q++){
+      s_p[q] = fill_chunk_size(nnz, p, q);
+    }
+  } else {
+    s_p[p - 1] = s;
+    for (int q = 0; q < p - 1; q++){
+      s_p[q] = std::binomial_distribution<int>(s_p[p - 1], ((double)fill_chunk_size(nnz, p, q))/(nnz - fill_chunk_lower(nnz, p, q)))(generator);
+      s_p[p - 1] -= s_p[q];
+    }
+  }
+
+  /* Each thread gets a cache line aligned slice of the sample arrays */
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, s + (long)p * FILL_SLICE_ALIGN, 0)) {
+    return 1;
+  }
+  long offset_p[p];
+  offset_p[0] = 0;
+  for (int q = 1; q < p; q++) {
+    offset_p[q] = offset_p[q - 1] + fill_slice_size(s_p[q - 1]);
+  }
+
+  for (int fill_index = 0; fill_index < B * B * B; fill_index++) {
+    fill[fill_index] = 0.0;
+  }
+
+  #pragma omp parallel
+  {
+    int q = omp_get_thread_num();
+    int my_s = s_p[q];
+    std::seed_seq my_seeder{seed, (long)trial, (long)q};
+    std::mt19937 my_generator(my_seeder);
+    int *my_samples = workspace->samples + offset_p[q];
+    int *my_samples_i = workspace->samples_i + offset_p[q];
+    int *my_samples_j = workspace->samples_j + offset_p[q];
+
+    fill_sample_positions(fill_chunk_lower(nnz, p, q), fill_chunk_upper(nnz, p, q), my_s, s == nnz, &my_generator, my_samples);
+    phil3_convert(csf, my_samples, my_samples_i, my_samples_j, my_s);
+
+    double my_fill[B * B * B];
+    for (int fill_index = 0; fill_index < B * B * B; fill_index++) {
+      my_fill[fill_index] = 0.0;
+    }
+    phil3_accumulate(csf, B, my_samples, my_samples_i, my_samples_j, my_s, my_fill);
+
+    #pragma omp critical
+    {
+      /* Add personal fill contribution */
+      for (int fill_index = 0; fill_index < B * B * B; fill_index++) {
+        fill[fill_index] += my_fill[fill_index];
+      }
+    }
+  }
+
+  phil3_normalize(B, s, fill);
+
+  fill_workspace_free(&local);
+  return 0;
+}
+
+int reserve_fill_pphil3 (struct fill_workspace *workspace,
+                         const struct fill3_csf *csf,
+                         int B,
+                         double epsilon,
+                         double delta){
+  long p = omp_get_max_threads();
+  return fill_workspace_reserve(workspace, fill3_samples(csf->nnz, B, epsilon, delta) + p * FILL_SLICE_ALIGN, 0);
+}
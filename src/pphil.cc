@@ -36,26 +36,8 @@
 #include <random>
 #include <algorithm>
 #include <omp.h>
-
-const char *name () {
-  return "phil";
-}
-
-int chunk(int n, int p, int q){
-  return q * (n/p) + std::min(q, n % p);
-}
-
-int chunk_lower(int n, int p, int q){
-  return chunk(n, p, q);
-}
-
-int chunk_upper(int n, int p, int q){
-  return chunk(n, p, q + 1);
-}
-
-int chunk_size(int n, int p, int q){
-  return chunk_upper(n, p, q) - chunk_lower(n, p, q);
-}
+#include "estimators.h"
+#include "phases.h"
 
 /**
  *  Given an m by n CSR matrix A, estimates the fill ratio if the matrix were
@@ -82,6 +64,7 @@ int chunk_size(int n, int p, int q){
  *  \param[in] sigma Sigma
  *  \param[out] *fill Fill ratios for all specified b_r, b_c in order
  *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
  *
  *  Note that the fill ratios should be stored according to the following order:
  *  int fill_index = 0;
@@ -94,29 +77,28 @@ int chunk_size(int n, int p, int q){
  *
  *  \returns On success, returns 0. On error, returns an error code.
  */
-int estimate_fill (int m,
-                   int n,
-                   int nnz,
-                   const int *ptr,
-                   const int *ind,
-                   int B,
-                   double epsilon,
-                   double delta,
-                   double sigma,
-                   double *fill,
-                   long seed,
-                   int trial,
-                   int verbose){
+int estimate_fill_pphil (int m,
+                         int n,
+                         int nnz,
+                         const int *ptr,
+                         const int *ind,
+                         int B,
+                         double epsilon,
+                         double delta,
+                         double sigma,
+                         double *fill,
+                         long seed,
+                         int trial,
+                         int verbose,
+                         struct fill_workspace *workspace){
   int p = omp_get_max_threads();
   assert(n >= 1);
   assert(m >= 1);
   int W = 2 * B;
+  PHASE_START(tic);
 
   /* Compute the necessary number of samples */
-  double T = log((2 * B * B) / delta) * B * B * B * B / (2.0 * epsilon * epsilon);
-  int s;
-
-  s = std::min((int)T, nnz);
+  int s = fill_samples(nnz, B, epsilon, delta);
 
   /* Seed the random generator */
 
@@ -128,16 +110,30 @@ int estimate_fill (int m,
   int s_p[p];
   if (s == nnz) {
     for (int q = 0; q < p; q++){
-      s_p[q] = chunk_size(nnz, p, q);
+      s_p[q] = fill_chunk_size(nnz, p, q);
     }
   } else {
     s_p[p - 1] = s;
     for (int q = 0; q < p - 1; q++){
-      s_p[q] = std::binomial_distribution<int>(s_p[p - 1], ((double)chunk_size(nnz, p, q))/(nnz - chunk_lower(nnz, p, q)))(generator);
+      s_p[q] = std::binomial_distribution<int>(s_p[p - 1], ((double)fill_chunk_size(nnz, p, q))/(nnz - fill_chunk_lower(nnz, p, q)))(generator);
       s_p[p - 1] -= s_p[q];
     }
   }
 
+  /* Each thread gets a cache line aligned slice of the sample arrays */
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, s + (long)p * FILL_SLICE_ALIGN, 0)) {
+    return 1;
+  }
+  long offset_p[p];
+  offset_p[0] = 0;
+  for (int q = 1; q < p; q++) {
+    offset_p[q] = offset_p[q - 1] + fill_slice_size(s_p[q - 1]);
+  }
+
   /* Zero out the fill */
   int fill_index = 0;
   for (int b_r = 1; b_r <= B; b_r++) {
@@ -146,21 +142,20 @@ int estimate_fill (int m,
       fill_index++;
     }
   }
+  PHASE_LAP(tic, 0, PHASE_COUNT);
 
   #pragma omp parallel
   {
     int q = omp_get_thread_num();
+    PHASE_START(my_tic);
     int my_s = s_p[q];
     std::seed_seq my_seeder{seed, (long)trial, (long)q};
     std::mt19937 my_generator(my_seeder);
 
     /* Sample s locations of nonzeros */
-    int *my_samples = new int[my_s];
-    assert(my_samples != NULL);
-    int *my_samples_i = new int[my_s];
-    assert(my_samples_i != NULL);
-    int *my_samples_j = new int[my_s];
-    assert(my_samples_j != NULL);
+    int *my_samples = workspace->samples + offset_p[q];
+    int *my_samples_i = workspace->samples_i + offset_p[q];
+    int *my_samples_j = workspace->samples_j + offset_p[q];
 
     /* Private working memory */
     int Z[W][W];
@@ -176,97 +171,29 @@ int estimate_fill (int m,
     /* if s == nnz, just compute the fill exactly. Otherwise, sample s nonzeros
      * so that the samples[t]^th nonzero is included in the sample.
      */
-    if (s == nnz) {
-      for (int t = 0; t < my_s; t++) {
-        my_samples[t] = t + chunk_lower(nnz, p, q);
-      }
-    } else {
-      std::uniform_int_distribution<> range(chunk_lower(nnz, p, q), chunk_upper(nnz, p, q) - 1);
-      for (int t = 0; t < my_s; t++) {
-        my_samples[t] = range(my_generator);
-      }
-    }
+    fill_sample_positions(fill_chunk_lower(nnz, p, q), fill_chunk_upper(nnz, p, q), my_s, s == nnz, &my_generator, my_samples);
+    PHASE_LAP(my_tic, q, PHASE_RNG);
 
     /* Convert flat samples array to (i, j) pairs in samples_i and samples_j. */
     std::sort(my_samples, my_samples + my_s, std::less<int>());
-    {
-      int i = 0;
-      for (int t = 0; t < my_s; t++) {
-        if (ptr[i + 1] <= my_samples[t]) {
-          i = (std::upper_bound(ptr + i, ptr + m, my_samples[t]) - ptr) - 1;
-        }
-        my_samples_i[t] = i;
-        my_samples_j[t] = ind[my_samples[t]];
-      }
-    }
+    PHASE_LAP(my_tic, q, PHASE_SORT);
+    fill_sample_convert(m, ptr, ind, my_samples, my_s, my_samples_i, my_samples_j);
+    PHASE_LAP(my_tic, q, PHASE_CONVERT);
 
     for (int t = 0; t < my_s; t++) {
       int i = my_samples_i[t];
       int j = my_samples_j[t];
 
-      /* Fill Z with 0 */
-      for (int r = 0; r < W; r++) {
-        for (int c = 0; c < W; c++) {
-          Z[r][c] = 0;
-        }
-      }
-
-      /* Set Z to 1 where there are nonzeros in the neighborhood of (i, j) */
-      for (int ii = std::max(i, B - 1) - (B - 1); ii <= std::min(i + (B - 1), m - 1); ii++) {
-        int r = (B + ii) - i;
-        int jj;
-        int jj_min = std::max(j, B - 1) - (B - 1);
-        int jj_max = std::min(j + (B - 1), n - 1);
+      phil_scan(m, n, ptr, ind, B, i, j, &Z[0][0]);
+      PHASE_LAP(my_tic, q, PHASE_SCAN);
 
-        int scan = (std::lower_bound(ind + ptr[ii], ind + ptr[ii + 1], jj_min) - ind);
+      phil_prefix(B, &Z[0][0]);
+      PHASE_LAP(my_tic, q, PHASE_PREFIX);
 
-        while (scan < ptr[ii + 1] && (jj = ind[scan]) <= jj_max) {
-          int c = (B + jj) - j;
-          Z[r][c] = 1;
-          scan++;
-        }
-      }
-
-      /* These prefix sums set Z[r][c] to the number of nonzeros in the region
-       * extending from (i - B + 1, j - B + 1) to (i - B + r, j - B + c) for all
-       * r > 0, c > 0.
-       */
-      for (int r = 1; r < W; r++) {
-        for (int c = 1; c < W; c++) {
-          Z[r][c] += Z[r][c - 1];
-        }
-      }
-
-      for (int r = 1; r < W; r++) {
-        for (int c = 1; c < W; c++) {
-          Z[r][c] += Z[r - 1][c];
-        }
-      }
-
-      /* Using Z, compute the number of nonzeros in (i, j)'s block for each
-       * desired block size.
-       */
-      my_fill_index = 0;
-      for (int b_r = 1; b_r <= B; b_r++) {
-        int r_hi = B + b_r - 1 - (i % b_r);
-        int r_lo = r_hi - b_r;
-        for (int b_c = 1; b_c <= B; b_c++) {
-          int c_hi = B + b_c - 1 - (j % b_c);
-          int c_lo = c_hi - b_c;
-          int y_0 = Z[r_hi][c_hi] - Z[r_lo][c_hi] - Z[r_hi][c_lo] + Z[r_lo][c_lo];
-          /* Compute the average inverse of the number of nozeros in (i, j)'s
-           * block.
-           */
-          my_fill[my_fill_index] += 1.0/y_0;
-          my_fill_index++;
-        }
-      }
+      phil_accumulate(B, i, j, &Z[0][0], my_fill);
+      PHASE_LAP(my_tic, q, PHASE_ACCUMULATE);
     }
 
-    delete[] my_samples;
-    delete[] my_samples_i;
-    delete[] my_samples_j;
-
     #pragma omp critical
     {
       /* Add personal fill contribution */
@@ -278,15 +205,24 @@ int estimate_fill (int m,
         }
       }
     }
+    PHASE_LAP(my_tic, q, PHASE_ACCUMULATE);
   }
 
-  /* Compute the fill from the average inverses stored in fill array */
-  fill_index = 0;
-  for (int b_r = 1; b_r <= B; b_r++) {
-    for (int b_c = 1; b_c <= B; b_c++) {
-      fill[fill_index] *= b_r * b_c / (double)s;
-      fill_index++;
-    }
-  }
+  PHASE_START(normalize_tic);
+
+  phil_normalize(B, s, fill);
+  fill_workspace_free(&local);
+  PHASE_LAP(normalize_tic, 0, PHASE_NORMALIZE);
   return 0;
 }
+
+int reserve_fill_pphil (struct fill_workspace *workspace,
+                        int m,
+                        int n,
+                        int nnz,
+                        int B,
+                        double epsilon,
+                        double delta){
+  long p = omp_get_max_threads();
+  return fill_workspace_reserve(workspace, fill_samples(nnz, B, epsilon, delta) + p * FILL_SLICE_ALIGN, 0);
+}
@@ -0,0 +1,317 @@
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "estimators.h"
+#include "fillest.h"
+
+/* pyfillest runs the registered fill estimators in the python process. The
+ * index arrays of a scipy.sparse.csr_matrix and the output arrays are used in
+ * place through the buffer protocol, so neither the matrix nor the estimates
+ * are copied, and the GIL is released while the estimators run.
+ */
+
+#if PY_MAJOR_VERSION >= 3
+#define PyString_FromString PyUnicode_FromString
+#endif
+
+/* Is view a native array of the struct module type code with itemsize bytes? */
+static int buffer_is (const Py_buffer *view, char code, Py_ssize_t itemsize) {
+  const char *format = view->format ? view->format : "B";
+  if (*format == '@' || *format == '=') {
+    format++;
+  }
+  return view->itemsize == itemsize && format[0] == code && format[1] == '\0';
+}
+
+static int buffer_get (PyObject *object, Py_buffer *view, int writable, char code, Py_ssize_t itemsize, const char *name) {
+  int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+  if (PyObject_GetBuffer(object, view, flags)) {
+    return 1;
+  }
+  if (!buffer_is(view, code, itemsize)) {
+    PyErr_Format(PyExc_TypeError, "%s must be a contiguous array of %s", name, code == 'd' ? "float64" : "int32 (numpy.intc)");
+    PyBuffer_Release(view);
+    return 1;
+  }
+  return 0;
+}
+
+PyDoc_STRVAR(pyfillest_estimate_doc,
+"estimate(algo, indptr, indices, n, fill, times=None, epsilon=0.1, delta=0.01,\n"
+"         sigma=0.02, seed=0, verbose=False, offsets=None)\n"
+"\n"
+"Estimate the fill of the CSR matrix with n columns and row pointers indptr\n"
+"and column indices indices (int32, sorted within each row) with the\n"
+"registered estimator algo. fill is a float64 array of shape (trials, B, B)\n"
+"or (B, B), and fill[t, b_r - 1, b_c - 1] receives the estimated fill of\n"
+"b_r by b_c blocks in trial t. If times is given, times[t] receives the\n"
+"seconds taken by trial t. If offsets is given, algo must estimate the fill\n"
+"of offset blocks (\"phil_offset\"), and offsets[t, b_r - 1, b_c - 1] (an\n"
+"int32 array of shape (trials, B, B, 2) or (B, B, 2)) receives the row and\n"
+"column offsets of the estimate in fill[t, b_r - 1, b_c - 1].");
+
+static PyObject *pyfillest_estimate (PyObject *self, PyObject *args, PyObject *kwargs) {
+  static const char *keywords[] = {"algo", "indptr", "indices", "n", "fill", "times", "epsilon", "delta", "sigma", "seed", "verbose", "offsets", NULL};
+  const char *algo;
+  PyObject *ptr_object;
+  PyObject *ind_object;
+  int n;
+  PyObject *fill_object;
+  PyObject *times_object = Py_None;
+  PyObject *offsets_object = Py_None;
+  struct estimator_params params = {0, 0.1, 0.01, 0.02, 0, 0, 0};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sOOiO|OdddliO", (char**)keywords, &algo, &ptr_object, &ind_object, &n, &fill_object, &times_object, &params.epsilon, &params.delta, &params.sigma, &params.seed, &params.verbose, &offsets_object)) {
+    return NULL;
+  }
+
+  const struct estimator *estimator = estimator_lookup(algo);
+  if (estimator == NULL) {
+    return PyErr_Format(PyExc_ValueError, "unknown estimator: %s", algo);
+  }
+  if (offsets_object != Py_None && strcmp(estimator->format, "ubcsr") != 0) {
+    return PyErr_Format(PyExc_ValueError, "%s does not estimate the fill of offset blocks", algo);
+  }
+
+  Py_buffer ptr, ind, fill, times, offsets;
+  if (buffer_get(ptr_object, &ptr, 0, 'i', sizeof(int), "indptr")) {
+    return NULL;
+  }
+  if (buffer_get(ind_object, &ind, 0, 'i', sizeof(int), "indices")) {
+    PyBuffer_Release(&ptr);
+    return NULL;
+  }
+  if (buffer_get(fill_object, &fill, 1, 'd', sizeof(double), "fill")) {
+    PyBuffer_Release(&ind);
+    PyBuffer_Release(&ptr);
+    return NULL;
+  }
+  if (times_object != Py_None && buffer_get(times_object, &times, 1, 'd', sizeof(double), "times")) {
+    PyBuffer_Release(&fill);
+    PyBuffer_Release(&ind);
+    PyBuffer_Release(&ptr);
+    return NULL;
+  }
+  if (offsets_object != Py_None && buffer_get(offsets_object, &offsets, 1, 'i', sizeof(int), "offsets")) {
+    if (times_object != Py_None) {
+      PyBuffer_Release(&times);
+    }
+    PyBuffer_Release(&fill);
+    PyBuffer_Release(&ind);
+    PyBuffer_Release(&ptr);
+    return NULL;
+  }
+
+  struct estimator_csr csr;
+  const int *ptr_data = (const int*)ptr.buf;
+  csr.m = (int)(ptr.len / (Py_ssize_t)sizeof(int)) - 1;
+  csr.n = n;
+  csr.ptr = ptr_data;
+  csr.ind = (const int*)ind.buf;
+
+  /* The entries of indptr and indices are trusted, as reading them all would
+   * cost more than the sampling estimators themselves.
+   */
+  int trials = 1;
+  const char *error = NULL;
+  if (csr.m < 1 || csr.n < 1) {
+    error = "the matrix must have at least one row and one column";
+  } else if (ptr_data[0] != 0 || ptr_data[csr.m] < 0 || ptr_data[csr.m] > ind.len / (Py_ssize_t)sizeof(int)) {
+    error = "indptr does not match indices";
+  } else if (fill.ndim == 2 && fill.shape[0] == fill.shape[1] && fill.shape[0] > 0) {
+    params.B = fill.shape[0];
+  } else if (fill.ndim == 3 && fill.shape[1] == fill.shape[2] && fill.shape[0] > 0 && fill.shape[1] > 0) {
+    trials = fill.shape[0];
+    params.B = fill.shape[1];
+  } else {
+    error = "fill must have shape (trials, B, B) or (B, B)";
+  }
+  if (error == NULL && times_object != Py_None && times.len / (Py_ssize_t)sizeof(double) < trials) {
+    error = "times must have an entry for each trial";
+  }
+  if (error == NULL && offsets_object != Py_None && offsets.len / (Py_ssize_t)sizeof(int) < 2L * trials * params.B * params.B) {
+    error = "offsets must have shape (trials, B, B, 2) or (B, B, 2)";
+  }
+  csr.nnz = error == NULL ? ptr_data[csr.m] : 0;
+
+  int ret = 0;
+  if (error == NULL) {
+    Py_BEGIN_ALLOW_THREADS
+    struct estimator_context *context = estimator_context_create(algo, &csr, &params);
+    if (context == NULL) {
+      ret = 1;
+    }
+    for (int t = 0; t < trials && ret == 0; t++) {
+      params.trial = t;
+      auto tic = std::chrono::high_resolution_clock::now();
+      double *fill_t = (double*)fill.buf + (long)t * params.B * params.B;
+      if (offsets_object != Py_None) {
+        ret = estimate_best_offsets(context, &csr, &params, fill_t, (int*)offsets.buf + 2L * t * params.B * params.B);
+      } else {
+        ret = estimate(context, &csr, &params, fill_t);
+      }
+      auto toc = std::chrono::high_resolution_clock::now();
+      if (times_object != Py_None) {
+        ((double*)times.buf)[t] = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+      }
+    }
+    if (context != NULL) {
+      estimator_context_free(context);
+    }
+    Py_END_ALLOW_THREADS
+  }
+
+  if (offsets_object != Py_None) {
+    PyBuffer_Release(&offsets);
+  }
+  if (times_object != Py_None) {
+    PyBuffer_Release(&times);
+  }
+  PyBuffer_Release(&fill);
+  PyBuffer_Release(&ind);
+  PyBuffer_Release(&ptr);
+  if (error != NULL) {
+    PyErr_SetString(PyExc_ValueError, error);
+    return NULL;
+  }
+  if (ret) {
+    return PyErr_Format(PyExc_RuntimeError, "%s could not estimate the fill", algo);
+  }
+  Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(pyfillest_formats_doc,
+"formats()\n"
+"\n"
+"Return a dictionary of the storage format whose fill each registered\n"
+"estimator estimates (such as \"bcsr\" or \"dia\"), by name.");
+
+static PyObject *pyfillest_formats (PyObject *self, PyObject *args) {
+  PyObject *result = PyDict_New();
+  if (result == NULL) {
+    return NULL;
+  }
+  for (const struct estimator *estimator = estimators; estimator->name; estimator++) {
+    PyObject *format = PyString_FromString(estimator->format);
+    if (format == NULL || PyDict_SetItemString(result, estimator->name, format)) {
+      Py_XDECREF(format);
+      Py_DECREF(result);
+      return NULL;
+    }
+    Py_DECREF(format);
+  }
+  return result;
+}
+
+PyDoc_STRVAR(pyfillest_model_times_doc,
+"model_times(m, n, nnz, fill, compute, bandwidth, times)\n"
+"\n"
+"Predict the seconds taken to multiply the m by n matrix with nnz nonzeros\n"
+"by a vector in each block size with estimator_model_time. fill and compute\n"
+"are float64 arrays of shape (B, B) holding the fill and the Mflop/s of each\n"
+"b_r by b_c block size, bandwidth is in MB/s, and times[b_r - 1, b_c - 1]\n"
+"receives the predicted time of b_r by b_c blocks.");
+
+static PyObject *pyfillest_model_times (PyObject *self, PyObject *args) {
+  int m;
+  int n;
+  int nnz;
+  PyObject *fill_object;
+  PyObject *compute_object;
+  struct estimator_model model;
+  PyObject *times_object;
+  if (!PyArg_ParseTuple(args, "iiiOOdO", &m, &n, &nnz, &fill_object, &compute_object, &model.bandwidth, &times_object)) {
+    return NULL;
+  }
+
+  Py_buffer fill, compute, times;
+  if (buffer_get(fill_object, &fill, 0, 'd', sizeof(double), "fill")) {
+    return NULL;
+  }
+  if (buffer_get(compute_object, &compute, 0, 'd', sizeof(double), "compute")) {
+    PyBuffer_Release(&fill);
+    return NULL;
+  }
+  if (buffer_get(times_object, &times, 1, 'd', sizeof(double), "times")) {
+    PyBuffer_Release(&compute);
+    PyBuffer_Release(&fill);
+    return NULL;
+  }
+
+  const char *error = NULL;
+  int B = 0;
+  if (fill.ndim != 2 || fill.shape[0] != fill.shape[1] || fill.shape[0] < 1) {
+    error = "fill must have shape (B, B)";
+  } else if (compute.len != fill.len || times.len != fill.len) {
+    error = "compute and times must have the shape of fill";
+  } else if (m < 1 || n < 1 || nnz < 1 || model.bandwidth <= 0.0) {
+    error = "m, n, nnz and bandwidth must be positive";
+  } else {
+    B = fill.shape[0];
+  }
+
+  if (error == NULL) {
+    model.compute = (const double*)compute.buf;
+    for (int b_r = 1; b_r <= B; b_r++) {
+      for (int b_c = 1; b_c <= B; b_c++) {
+        int k = (b_r - 1) * B + b_c - 1;
+        ((double*)times.buf)[k] = estimator_model_time(&model, B, m, n, nnz, b_r, b_c, ((const double*)fill.buf)[k]);
+      }
+    }
+  }
+
+  PyBuffer_Release(&times);
+  PyBuffer_Release(&compute);
+  PyBuffer_Release(&fill);
+  if (error != NULL) {
+    PyErr_SetString(PyExc_ValueError, error);
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(pyfillest_estimators_doc,
+"estimators()\n"
+"\n"
+"Return a dictionary describing each registered estimator by name.");
+
+static PyObject *pyfillest_estimators (PyObject *self, PyObject *args) {
+  PyObject *result = PyDict_New();
+  if (result == NULL) {
+    return NULL;
+  }
+  for (const struct estimator *estimator = estimators; estimator->name; estimator++) {
+    PyObject *description = PyString_FromString(estimator->description);
+    if (description == NULL || PyDict_SetItemString(result, estimator->name, description)) {
+      Py_XDECREF(description);
+      Py_DECREF(result);
+      return NULL;
+    }
+    Py_DECREF(description);
+  }
+  return result;
+}
+
+static PyMethodDef pyfillest_methods[] = {
+  {"estimate", (PyCFunction)pyfillest_estimate, METH_VARARGS | METH_KEYWORDS, pyfillest_estimate_doc},
+  {"estimators", (PyCFunction)pyfillest_estimators, METH_NOARGS, pyfillest_estimators_doc},
+  {"formats", (PyCFunction)pyfillest_formats, METH_NOARGS, pyfillest_formats_doc},
+  {"model_times", (PyCFunction)pyfillest_model_times, METH_VARARGS, pyfillest_model_times_doc},
+  {NULL, NULL, 0, NULL}
+};
+
+PyDoc_STRVAR(pyfillest_doc, "Fill estimators for sparse matrices in CSR format.");
+
+#if PY_MAJOR_VERSION >= 3
+static struct PyModuleDef pyfillest_module = {
+  PyModuleDef_HEAD_INIT, "pyfillest", pyfillest_doc, -1, pyfillest_methods
+};
+
+PyMODINIT_FUNC PyInit_pyfillest (void) {
+  return PyModule_Create(&pyfillest_module);
+}
+#else
+PyMODINIT_FUNC initpyfillest (void) {
+  Py_InitModule3("pyfillest", pyfillest_methods, pyfillest_doc);
+}
+#endif
@@ -1,11 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <unordered_set>
-#include <random>
+#include <algorithm>
 
-const char *name () {
-  return "reference";
-}
+#include "estimators.h"
 
 /**
  *  Given an m by n CSR matrix A, computes the fill ratio if the matrix were
@@ -31,6 +28,7 @@ const char *name () {
  *  \param[in] sigma Sigma
  *  \param[out] *fill Fill ratios for all specified b_r, b_c in order
  *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
  *
  *  Note that the fill ratios should be stored according to the following order:
  *  int fill_index = 0;
@@ -43,42 +41,77 @@ const char *name () {
  *
  *  \returns On success, returns 0. On error, returns an error code.
  */
-int estimate_fill (int m,
-                   int n,
-                   int nnz,
-                   const int *ptr,
-                   const int *ind,
-                   int B,
-                   double epsilon,
-                   double delta,
-                   double sigma,
-                   double *fill,
-                   long seed,
-                   int trial,
-                   int verbose){
-  auto hash = [n](std::pair<int, int> coord){
-    return coord.first * n + coord.second;
-  };
-  std::unordered_set<std::pair<int, int>, decltype(hash)> blocks((size_t)nnz, hash);
+int estimate_fill_reference (int m,
+                             int n,
+                             int nnz,
+                             const int *ptr,
+                             const int *ind,
+                             int B,
+                             double epsilon,
+                             double delta,
+                             double sigma,
+                             double *fill,
+                             long seed,
+                             int trial,
+                             int verbose,
+                             struct fill_workspace *workspace){
+  /* blocks + (b_c - 1) * n marks the column blocks seen so far in the
+   * current block row when the block width is b_c. The workspace keeps it
+   * zeroed.
+   */
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, 0, (long)B * n)) {
+    return 1;
+  }
+  int *blocks = workspace->blocks;
+
+  /* nnzb[b_c - 1] counts the blocks when the block width is b_c */
+  long nnzb[B];
+
   int fill_index = 0;
   for (int b_r = 1; b_r <= B; b_r++) {
     for (int b_c = 1; b_c <= B; b_c++) {
-      blocks.clear();
-      int i = 0;
-      int j = 0;
-      int nnzb = 0;
-      for (int t = 0; t < nnz; t++){
-        while (ptr[i + 1] <= t) {
-          i++;
+      nnzb[b_c - 1] = 0;
+    }
+    for (int I = 0; I * b_r < m; I++) {
+      int t_lo = ptr[I * b_r];
+      int t_hi = ptr[std::min((I + 1) * b_r, m)];
+      for (int t = t_lo; t < t_hi; t++) {
+        int j = ind[t];
+        for (int b_c = 1; b_c <= B; b_c++) {
+          int *seen = blocks + (b_c - 1) * n + j / b_c;
+          if (*seen == 0) {
+            *seen = 1;
+            nnzb[b_c - 1]++;
+          }
         }
-        j = ind[t];
-        int block_i = (i/b_r);
-        int block_j = (j/b_c);
-        blocks.insert(std::pair<int, int>(block_i, block_j));
       }
-      fill[fill_index] = (double)b_r * (double)b_c * (double)blocks.size() / (double)nnz;
+      for (int t = t_lo; t < t_hi; t++) {
+        int j = ind[t];
+        for (int b_c = 1; b_c <= B; b_c++) {
+          blocks[(b_c - 1) * n + j / b_c] = 0;
+        }
+      }
+    }
+    for (int b_c = 1; b_c <= B; b_c++) {
+      fill[fill_index] = (double)b_r * (double)b_c * (double)nnzb[b_c - 1] / (double)nnz;
       fill_index++;
     }
   }
+
+  fill_workspace_free(&local);
   return 0;
 }
+
+int reserve_fill_reference (struct fill_workspace *workspace,
+                            int m,
+                            int n,
+                            int nnz,
+                            int B,
+                            double epsilon,
+                            double delta){
+  return fill_workspace_reserve(workspace, 0, (long)B * n);
+}
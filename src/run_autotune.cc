@@ -0,0 +1,545 @@
+#include <errno.h>
+#include <float.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <random>
+#include "bcsr.h"
+#include "estimators.h"
+#include "fillest.h"
+#include "mtx.h"
+#include "npy.h"
+#include "spmv.h"
+#include "timing.h"
+
+static void usage () {
+  fprintf(stderr,"usage: autotune [options] <input>\n"
+  "  <input>                    MatrixMarket file (tune the format of this matrix)\n"
+  "  -a, --algo <arg>           Estimator to run (phil, pphil, oski, or reference)\n"
+  "  -P, --profile <arg>        Machine profile (.npy), measured and saved here\n"
+  "                             if the file does not exist\n"
+  "  -D, --profile-dim <arg>    Dimension of the dense matrix to profile\n"
+  "  -S, --scorer <arg>         Choose the block size with the measured profile\n"
+  "                             (profile) or a roofline model (model)\n"
+  "  -W, --model <arg>          Machine model, measured and saved as\n"
+  "                             <arg>_compute.npy and <arg>_bandwidth.npy if\n"
+  "                             they do not exist\n"
+  "  -R, --bands <arg>          Also split the matrix into bands of this many\n"
+  "                             rows and choose a block size for each band\n"
+  "                             (requires --scorer model)\n"
+  "  -b, --benchmark            Time the tuned matrix as well as the CSR matrix\n"
+  "  -g, --rng-seed <arg>       Seed for random number generator\n"
+  "  -B, --max-block-size <arg> Maximum block dimension to consider\n"
+  "  -e, --epsilon <arg>        Be accurate to relative error epsilon\n"
+  "  -d, --delta <arg>          With probability (1 - delta)\n"
+  "  -s, --sigma <arg>          Examine block rows With probability sigma\n"
+  "  -t, --trials <arg>         Number of SpMV trials to time\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -f, --flush                Flush caches before each trial\n"
+  "  -v, --verbose              Verbose mode\n"
+  "  -q, --quiet                Quiet mode\n"
+  "  -h, --help                 Display help message\n");
+}
+
+struct spmv_trial {
+  const struct bcsr_matrix *A;
+  const double *x;
+  double *y;
+};
+
+static void spmv_trial (void *arg, int t) {
+  struct spmv_trial *a = (struct spmv_trial*)arg;
+  bcsr_spmv(a->A, a->x, a->y);
+}
+
+/* Store the mean time of y = A * x with the native kernel in time */
+static int time_spmv (const struct bcsr_matrix *A, int trials, const struct timing_options *timing, double *time) {
+  double *x = (double*)malloc(sizeof(double) * ((long)A->bn * A->c + 1));
+  double *y = (double*)malloc(sizeof(double) * ((long)A->bm * A->r + 1));
+  if (x == NULL || y == NULL) {
+    free(x);
+    free(y);
+    return 1;
+  }
+  for (long j = 0; j < (long)A->bn * A->c; j++) {
+    x[j] = 1.0;
+  }
+  struct spmv_trial arg = {A, x, y};
+  struct timing_stats stats;
+  int ret = timing_run(timing, trials, spmv_trial, &arg, &stats);
+  if (ret == 0) {
+    *time = stats.mean;
+    timing_free(&stats);
+  }
+  free(x);
+  free(y);
+  return ret;
+}
+
+static double seconds_since (std::chrono::high_resolution_clock::time_point tic) {
+  auto toc = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+}
+
+/* The compute rates of the model are measured on a dense matrix this wide,
+ * which stays in cache.
+ */
+#define MODEL_DIM 128
+
+/* What to measure when an array is not cached */
+struct measurement {
+  int B;
+  int dim;
+  int trials;
+  const struct timing_options *timing;
+  int verbose;
+};
+
+static int measure_profile (const struct measurement *how, double *data) {
+  int threads[1] = {1};
+  return spmv_profile(how->dim, how->dim, how->B, 1, SPMV_KERNEL_NATIVE, 1, threads, how->trials, how->timing, how->verbose, data);
+}
+
+static int measure_bandwidth (const struct measurement *how, double *data) {
+  return spmv_bandwidth(SPMV_STREAM_SIZE, how->trials, how->timing, data);
+}
+
+/* Machine measurements belong to the machine, so they are read from path if
+ * it exists, and are otherwise measured and saved there. The seconds spent
+ * measuring are added to time.
+ */
+static int cached_array (const char *path,
+                         int ndim,
+                         const long *shape,
+                         int (*measure)(const struct measurement*, double*),
+                         const struct measurement *how,
+                         double *data,
+                         double *time) {
+  struct stat statthing;
+  if (path && stat(path, &statthing) == 0) {
+    if (npy_load(path, ndim, shape, data)) {
+      fprintf(stderr, "%s must be a .npy array of doubles with %ld entries\n", path, ndim > 1 ? shape[0] * shape[1] : shape[0]);
+      return 1;
+    }
+    return 0;
+  }
+  auto tic = std::chrono::high_resolution_clock::now();
+  if (measure(how, data)) {
+    fprintf(stderr, "could not measure the machine\n");
+    return 1;
+  }
+  *time += seconds_since(tic);
+  if (path && npy_save(path, ndim, shape, data)) {
+    fprintf(stderr, "could not write %s\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+
+int main (int argc, char **argv) {
+
+  int verbose = 0;
+  int help = 0;
+
+  int B = 12;
+  double epsilon = 0.1;
+  double delta = 0.01;
+  double sigma = 0.02;
+  int trials = 10;
+  struct timing_options timing;
+  timing_defaults(&timing);
+  const struct estimator *selected = estimator_lookup("phil");
+  const char *profile_path = NULL;
+  int model = 0;
+  const char *model_prefix = NULL;
+  int profile_dim = 1000;
+  int band_rows = 0;
+  int benchmark = 0;
+  long seed = std::random_device()();
+
+  /* Beware. Option parsing below. */
+  long longarg;
+  double doublearg;
+  while (1) {
+    const char *options = "a:P:D:S:W:R:bg:B:e:d:s:t:w:fvqh";
+    const struct option long_options[] = {
+        {"algo",     required_argument, 0, 'a'},
+        {"profile",  required_argument, 0, 'P'},
+        {"profile-dim", required_argument, 0, 'D'},
+        {"scorer",   required_argument, 0, 'S'},
+        {"model",    required_argument, 0, 'W'},
+        {"bands",    required_argument, 0, 'R'},
+        {"benchmark", no_argument, &benchmark, 1},
+        {"rng-seed", required_argument, 0, 'g'},
+        {"max-block-size", required_argument, 0, 'B'},
+        {"epsilon",  required_argument, 0, 'e'},
+        {"delta",    required_argument, 0, 'd'},
+        {"sigma",    required_argument, 0, 's'},
+        {"trials",   required_argument, 0, 't'},
+        {"warmup",   required_argument, 0, 'w'},
+        {"flush",     no_argument, &timing.flush, 1},
+        {"verbose",   no_argument, &verbose, 1},
+        {"quiet",     no_argument, &verbose, 0},
+        {"help",      no_argument, &help,    1},
+        {0, 0, 0, 0}
+      };
+
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+
+    int c = getopt_long (argc, argv, options,
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1)
+      break;
+
+    if (c == 0 && long_options[option_index].flag == 0)
+      c = long_options[option_index].val;
+
+    switch (c) {
+      case 0:
+        /* If this option set a flag, do nothing else now. */
+        break;
+
+      case 'a':
+        selected = estimator_lookup(optarg);
+        if (selected == NULL || strcmp(selected->format, "bcsr") != 0) {
+          printf("option -a takes a blocked estimator (phil, pphil, oski, or reference)\n");
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'P':
+        profile_path = optarg;
+        break;
+
+      case 'D':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1 || longarg > 46340) {
+          printf("option -D takes an integer dimension >= 1 and <= 46340\n");
+          usage();
+          return 1;
+        }
+        profile_dim = longarg;
+        break;
+
+      case 'S':
+        if (strcmp(optarg, "profile") == 0) {
+          model = 0;
+        } else if (strcmp(optarg, "model") == 0) {
+          model = 1;
+        } else {
+          printf("option -S takes a scorer (profile or model)\n");
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'W':
+        model_prefix = optarg;
+        break;
+
+      case 'R':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1 || longarg > INT_MAX) {
+          printf("option -R takes an integer number of rows >= 1\n");
+          usage();
+          return 1;
+        }
+        band_rows = longarg;
+        break;
+
+      case 'b':
+        benchmark = 1;
+        break;
+
+      case 'g':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -g takes an integer seed >= 0\n");
+          usage();
+          return 1;
+        }
+        seed = longarg;
+        break;
+
+      case 'B':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1 || longarg > BCSR_MAX_BLOCK) {
+          printf("option -B takes an integer maximum block size >= 1 and <= %d\n", BCSR_MAX_BLOCK);
+          usage();
+          return 1;
+        }
+        B = longarg;
+        break;
+
+      case 'e':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -e takes a desired relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        epsilon = doublearg;
+        break;
+
+      case 'd':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0 || doublearg > 1.0) {
+          printf("option -d takes a desired probability >= 0.0 and <= 1.0\n");
+          usage();
+          return 1;
+        }
+        delta = doublearg;
+        break;
+
+      case 's':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0 || doublearg > 1.0) {
+          printf("option -s takes a desired probability >= 0.0 and <= 1.0\n");
+          usage();
+          return 1;
+        }
+        sigma = doublearg;
+        break;
+
+      case 't':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -t takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        trials = longarg;
+        break;
+
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        timing.warmup = longarg;
+        break;
+
+      case 'f':
+        timing.flush = 1;
+        break;
+
+      case 'v':
+        verbose = 1;
+        break;
+
+      case 'q':
+        verbose = 0;
+        break;
+
+      case 'h':
+        help = 1;
+        break;
+
+      case '?':
+        usage();
+        return 1;
+
+      default:
+        abort();
+    }
+  }
+
+  if (help) {
+    printf("Tune the block size of a matrix!\n");
+    usage();
+    return 0;
+  }
+
+  if (argc - optind != 1) {
+    printf("<input> must be exactly one file\n");
+    usage();
+    return 1;
+  }
+
+  if (band_rows && !model) {
+    printf("option -R predicts the time of each band, which requires --scorer model\n");
+    usage();
+    return 1;
+  }
+
+  double *profile = (double*)malloc(sizeof(double) * B * B);
+  /* The second half of fill is scratch space for the bands */
+  double *fill = (double*)malloc(sizeof(double) * 2 * B * B);
+  if (profile == NULL || fill == NULL) {
+    free(profile);
+    free(fill);
+    return 1;
+  }
+  double bandwidth = 0.0;
+  double profile_time = 0.0;
+  long shape[2] = {B, B};
+  int ret;
+  if (model) {
+    struct measurement how = {B, MODEL_DIM, trials, &timing, verbose};
+    char compute_path[NPY_PATH_SIZE];
+    char bandwidth_path[NPY_PATH_SIZE];
+    long bandwidth_shape[1] = {1};
+    ret = model_prefix && (npy_path(compute_path, model_prefix, "compute") || npy_path(bandwidth_path, model_prefix, "bandwidth"));
+    ret = ret || cached_array(model_prefix ? compute_path : NULL, 2, shape, measure_profile, &how, profile, &profile_time);
+    ret = ret || cached_array(model_prefix ? bandwidth_path : NULL, 1, bandwidth_shape, measure_bandwidth, &how, &bandwidth, &profile_time);
+  } else {
+    struct measurement how = {B, profile_dim, trials, &timing, verbose};
+    ret = cached_array(profile_path, 2, shape, measure_profile, &how, profile, &profile_time);
+  }
+  if (ret) {
+    free(profile);
+    free(fill);
+    return 1;
+  }
+  struct estimator_model machine = {bandwidth, profile};
+
+  char error[MTX_ERROR_SIZE];
+  struct csr_matrix A;
+  auto tic = std::chrono::high_resolution_clock::now();
+  if (mtx_read(argv[optind], 1, &A, error)) {
+    fprintf(stderr, "%s\n", error);
+    free(profile);
+    free(fill);
+    return 1;
+  }
+  double load_time = seconds_since(tic);
+
+  /* Tuning is estimating the fill, choosing a block size and converting */
+  struct estimator_csr csr = {A.m, A.n, A.nnz, A.ptr, A.ind};
+  struct estimator_params params = {B, epsilon, delta, sigma, seed, 0, verbose};
+  int r, c;
+  tic = std::chrono::high_resolution_clock::now();
+  struct estimator_context *context = estimator_context_create(selected->name, &csr, &params);
+  if (context == NULL) {
+    ret = 1;
+  } else if (model) {
+    ret = estimator_tune_model(context, &csr, &params, &machine, fill, &r, &c);
+  } else {
+    ret = estimator_tune(context, &csr, &params, profile, fill, &r, &c);
+  }
+  double estimate_time = seconds_since(tic);
+  if (context != NULL) {
+    estimator_context_free(context);
+  }
+
+  /* The bands of a split matrix are estimated with phil */
+  struct estimator_band *bands = NULL;
+  int nbands = 0;
+  double split_time = 0.0;
+  if (ret == 0 && band_rows) {
+    bands = (struct estimator_band*)malloc(sizeof(struct estimator_band) * ((A.m + (long)band_rows - 1) / band_rows));
+    tic = std::chrono::high_resolution_clock::now();
+    context = estimator_context_create("phil", &csr, &params);
+    ret = bands == NULL || context == NULL || estimator_split(context, &csr, &params, &machine, band_rows, fill + B * B, bands, &nbands);
+    split_time = seconds_since(tic);
+    if (context != NULL) {
+      estimator_context_free(context);
+    }
+  }
+
+  struct bcsr_matrix tuned;
+  tic = std::chrono::high_resolution_clock::now();
+  ret = ret || bcsr_from_csr(&tuned, A.m, A.n, A.nnz, A.ptr, A.ind, A.val, r, c);
+  double convert_time = seconds_since(tic);
+  if (ret) {
+    fprintf(stderr, "could not tune %s\n", argv[optind]);
+    csr_free(&A);
+    free(bands);
+    free(profile);
+    free(fill);
+    return 1;
+  }
+
+  /* The unblocked matrix is multiplied by the 1 by 1 native kernel */
+  struct bcsr_matrix unblocked;
+  double csr_time = 0.0;
+  double tuned_time = 0.0;
+  ret = bcsr_from_csr(&unblocked, A.m, A.n, A.nnz, A.ptr, A.ind, A.val, 1, 1);
+  if (ret == 0) {
+    ret = time_spmv(&unblocked, trials, &timing, &csr_time);
+    bcsr_free(&unblocked);
+  }
+  if (ret == 0 && benchmark) {
+    ret = time_spmv(&tuned, trials, &timing, &tuned_time);
+  }
+  bcsr_free(&tuned);
+  csr_free(&A);
+  if (ret) {
+    fprintf(stderr, "could not time %s\n", argv[optind]);
+    free(bands);
+    free(profile);
+    free(fill);
+    return 1;
+  }
+
+  double tuning_time = estimate_time + convert_time;
+  printf("{\n");
+  printf("  \"algo\": \"%s\",\n", selected->name);
+  printf("  \"r\": %d,\n", r);
+  printf("  \"c\": %d,\n", c);
+  printf("  \"fill\": %.*e,\n", DECIMAL_DIG, fill[(r - 1) * B + c - 1]);
+  printf("  \"scorer\": \"%s\",\n", model ? "model" : "profile");
+  if (model) {
+    double predicted = estimator_model_time(&machine, B, A.m, A.n, A.nnz, r, c, fill[(r - 1) * B + c - 1]);
+    printf("  \"bandwidth\": %.*e,\n", DECIMAL_DIG, bandwidth);
+    printf("  \"predicted_time\": %.*e,\n", DECIMAL_DIG, predicted);
+    printf("  \"predicted_speedup\": %.*e,\n", DECIMAL_DIG, estimator_model_time(&machine, B, A.m, A.n, A.nnz, 1, 1, fill[0]) / predicted);
+    if (band_rows) {
+      /* The bands share one read of x */
+      double split_predicted = sizeof(double) * (double)A.n / (bandwidth * 1e6);
+      printf("  \"bands\": [\n");
+      for (int k = 0; k < nbands; k++) {
+        printf("    {\"row_lo\": %d, \"row_hi\": %d, \"nnz\": %d, \"r\": %d, \"c\": %d, \"fill\": %.*e, \"time\": %.*e}%s\n", bands[k].row_lo, bands[k].row_hi, bands[k].nnz, bands[k].r, bands[k].c, DECIMAL_DIG, bands[k].fill, DECIMAL_DIG, bands[k].time, k < nbands - 1 ? "," : "");
+        split_predicted += bands[k].time;
+      }
+      printf("  ],\n");
+      printf("  \"split_time\": %.*e,\n", DECIMAL_DIG, split_time);
+      printf("  \"split_predicted_time\": %.*e,\n", DECIMAL_DIG, split_predicted);
+    }
+  } else {
+    printf("  \"predicted_speedup\": %.*e,\n", DECIMAL_DIG, profile[(r - 1) * B + c - 1] / fill[(r - 1) * B + c - 1] / (profile[0] / fill[0]));
+  }
+  printf("  \"profile_time\": %.*e,\n", DECIMAL_DIG, profile_time);
+  printf("  \"load_time\": %.*e,\n", DECIMAL_DIG, load_time);
+  printf("  \"estimate_time\": %.*e,\n", DECIMAL_DIG, estimate_time);
+  printf("  \"convert_time\": %.*e,\n", DECIMAL_DIG, convert_time);
+  printf("  \"tuning_time\": %.*e,\n", DECIMAL_DIG, tuning_time);
+  printf("  \"csr_time\": %.*e,\n", DECIMAL_DIG, csr_time);
+  printf("  \"tuning_spmvs\": %.*e%s\n", DECIMAL_DIG, tuning_time / csr_time, benchmark ? "," : "");
+  if (benchmark) {
+    /* Tuning pays for itself after break_even_spmvs multiplications */
+    printf("  \"tuned_time\": %.*e,\n", DECIMAL_DIG, tuned_time);
+    printf("  \"speedup\": %.*e,\n", DECIMAL_DIG, csr_time / tuned_time);
+    if (tuned_time < csr_time) {
+      printf("  \"break_even_spmvs\": %.*e\n", DECIMAL_DIG, tuning_time / (csr_time - tuned_time));
+    } else {
+      printf("  \"break_even_spmvs\": null\n");
+    }
+  }
+  printf("}\n");
+
+  free(bands);
+  free(profile);
+  free(fill);
+  return 0;
+}
@@ -0,0 +1,640 @@
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "estimators.h"
+#include "json.h"
+#include "mtx.h"
+#include "server.h"
+#include "timing.h"
+
+static void usage () {
+  fprintf(stderr,"usage: fillbatch [options] [<input> ...]\n"
+  "  <input>                    MatrixMarket files (estimate fill of these matrices)\n"
+  "  -l, --list <arg>           File listing one MatrixMarket file per line\n"
+  "  -x, --registry <arg>       Matrix registry (registry.json) of matrices to use\n"
+  "  -D, --matrix-dir <arg>     Directory holding the registry matrices\n"
+  "                             (defaults to the directory of the registry)\n"
+  "  -o, --output <arg>         Write the combined results to this file\n"
+  "  -i, --io-threads <arg>     Number of threads reading matrices\n"
+  "  -j, --jobs <arg>           Number of threads running estimators\n"
+  "  -Q, --queue <arg>          Most read matrices waiting for an estimator\n"
+  "  -a, --algo <arg>           Comma separated estimators to run\n"
+  "                             (phil, phil_offset, pphil, oski, reference,\n"
+  "                             sketch, sell, ell, or dia)\n"
+  "  -g, --rng-seed <arg>       Seed for random number generator\n"
+  "  -B, --max-block-size <arg> Maximum block dimension for fill estimates (sell\n"
+  "                             ties its chunks C <= B and sorting windows of\n"
+  "                             k * C rows for k <= B to this grid)\n"
+  "  -e, --epsilon <arg>        Be accurate to relative error epsilon\n"
+  "  -d, --delta <arg>          With probability (1 - delta)\n"
+  "  -s, --sigma <arg>          Examine block rows With probability sigma\n"
+  "  -t, --trials <arg>         Number of trials to run\n"
+  "  -c, --clock                Display timing information\n"
+  "  -C, --noclock              Do not display timing information\n"
+  "  -r, --results              Display fill estimates for all trials\n"
+  "  -R, --noresults            Do not display fill estimates\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -f, --flush                Flush caches before each trial\n"
+  "  -n, --noise <arg>          Add trials until the 95%% confidence interval of\n"
+  "                             the mean time is within this relative error\n"
+  "  -M, --max-trials <arg>     Most trials to run when adding trials\n"
+  "  -v, --verbose              Verbose mode\n"
+  "  -q, --quiet                Quiet mode\n"
+  "  -h, --help                 Display help message\n");
+}
+
+/* One matrix of the batch and what became of it */
+struct batch_matrix {
+  std::string name;
+  std::string path;
+  struct csr_matrix A;
+  double load_time;
+  double compute_time;
+  std::string output;
+  std::string error;
+};
+
+/* Matrices move from the loaders to the estimators through ready, which
+ * holds at most depth matrices.
+ */
+struct batch {
+  const struct fill_request *request;
+  std::vector<struct batch_matrix> matrices;
+  int verbose;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  size_t next_load;
+  int loaders;
+  size_t depth;
+  std::deque<size_t> ready;
+};
+
+static double seconds_since (std::chrono::high_resolution_clock::time_point tic) {
+  auto toc = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+}
+
+static void batch_loader (struct batch *batch) {
+  while (1) {
+    size_t k;
+    {
+      std::unique_lock<std::mutex> hold(batch->lock);
+      batch->changed.wait(hold, [batch]{return batch->ready.size() < batch->depth;});
+      if (batch->next_load == batch->matrices.size()) {
+        break;
+      }
+      k = batch->next_load++;
+    }
+
+    struct batch_matrix *matrix = &batch->matrices[k];
+    char error[MTX_ERROR_SIZE];
+    auto tic = std::chrono::high_resolution_clock::now();
+    if (mtx_read(matrix->path.c_str(), 0, &matrix->A, error)) {
+      matrix->error = error;
+    }
+    matrix->load_time = seconds_since(tic);
+    if (batch->verbose) {
+      fprintf(stderr, "read %s in %g seconds\n", matrix->path.c_str(), matrix->load_time);
+    }
+
+    {
+      std::lock_guard<std::mutex> hold(batch->lock);
+      batch->ready.push_back(k);
+    }
+    batch->changed.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> hold(batch->lock);
+    batch->loaders--;
+  }
+  batch->changed.notify_all();
+}
+
+/* Each estimator thread reuses one workspace for all of its matrices */
+static void batch_estimator (struct batch *batch) {
+  struct fill_workspace workspace = FILL_WORKSPACE_INIT;
+  while (1) {
+    size_t k;
+    {
+      std::unique_lock<std::mutex> hold(batch->lock);
+      batch->changed.wait(hold, [batch]{return !batch->ready.empty() || batch->loaders == 0;});
+      if (batch->ready.empty()) {
+        break;
+      }
+      k = batch->ready.front();
+      batch->ready.pop_front();
+    }
+    batch->changed.notify_all();
+
+    struct batch_matrix *matrix = &batch->matrices[k];
+    if (matrix->error.empty()) {
+      auto tic = std::chrono::high_resolution_clock::now();
+      fill_request_run(batch->request, &matrix->A, &workspace, &matrix->output, &matrix->error);
+      matrix->compute_time = seconds_since(tic);
+      if (batch->verbose) {
+        fprintf(stderr, "estimated %s in %g seconds\n", matrix->path.c_str(), matrix->compute_time);
+      }
+      csr_free(&matrix->A);
+    }
+  }
+  fill_workspace_free(&workspace);
+}
+
+static void batch_add (struct batch *batch, const std::string &name, const std::string &path) {
+  struct batch_matrix matrix;
+  matrix.name = name;
+  matrix.path = path;
+  matrix.A.ptr = NULL;
+  matrix.A.ind = NULL;
+  matrix.A.val = NULL;
+  matrix.load_time = 0;
+  matrix.compute_time = 0;
+  batch->matrices.push_back(matrix);
+}
+
+/* Matrices are named after their files, without the .mtx extension */
+static std::string matrix_name (const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mtx") == 0) {
+    name.resize(name.size() - 4);
+  }
+  return name;
+}
+
+static int read_file (const char *path, std::string *contents) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return 1;
+  }
+  char buffer[4096];
+  size_t size;
+  contents->clear();
+  while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    contents->append(buffer, size);
+  }
+  fclose(f);
+  return 0;
+}
+
+static int batch_add_list (struct batch *batch, const char *path) {
+  std::string contents;
+  if (read_file(path, &contents)) {
+    printf("could not read matrix list %s\n", path);
+    return 1;
+  }
+  size_t start = 0;
+  while (start < contents.size()) {
+    size_t end = contents.find('\n', start);
+    if (end == std::string::npos) {
+      end = contents.size();
+    }
+    std::string line = contents.substr(start, end - start);
+    start = end + 1;
+    size_t lo = line.find_first_not_of(" \t\r");
+    if (lo == std::string::npos || line[lo] == '#') {
+      continue;
+    }
+    line = line.substr(lo, line.find_last_not_of(" \t\r") + 1 - lo);
+    batch_add(batch, matrix_name(line), line);
+  }
+  return 0;
+}
+
+/* Registry entries are found at their "relpath", or "<key>.mtx", in dir, as
+ * in util.py.
+ */
+static int batch_add_registry (struct batch *batch, const char *path, const char *dir) {
+  std::string contents;
+  if (read_file(path, &contents)) {
+    printf("could not read matrix registry %s\n", path);
+    return 1;
+  }
+  std::string base;
+  if (dir) {
+    base = dir;
+  } else {
+    std::vector<char> copy(path, path + strlen(path) + 1);
+    base = dirname(copy.data());
+  }
+
+  struct json_reader json = {contents.c_str()};
+  json_space(&json);
+  if (*json.p != '{') {
+    printf("matrix registry %s must be a JSON object\n", path);
+    return 1;
+  }
+  json.p++;
+  int members = 0;
+  std::string key;
+  int next;
+  while ((next = json_object_next(&json, &members, &key)) == 1) {
+    std::string relpath = key + ".mtx";
+    if (*json.p == '{') {
+      json.p++;
+      int fields = 0;
+      std::string field;
+      int more;
+      while ((more = json_object_next(&json, &fields, &field)) == 1) {
+        std::string text;
+        int quoted;
+        if (field == "relpath" && json_scalar(&json, &text, &quoted) == 0 && quoted) {
+          relpath = text;
+        } else if (field == "relpath" || json_skip(&json)) {
+          more = -1;
+          break;
+        }
+      }
+      if (more < 0) {
+        next = -1;
+        break;
+      }
+    } else if (json_skip(&json)) {
+      next = -1;
+      break;
+    }
+    batch_add(batch, key, relpath[0] == '/' ? relpath : base + "/" + relpath);
+  }
+  if (next < 0) {
+    printf("could not parse matrix registry %s\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+int main (int argc, char **argv) {
+
+  int clock = 1;
+  int results = 0;
+  int verbose = 0;
+  int help = 0;
+
+  struct fill_request request;
+  request.selected[0] = estimator_lookup("phil");
+  request.nselected = 1;
+  request.B = 12;
+  request.epsilon = 0.1;
+  request.delta = 0.01;
+  request.sigma = 0.02;
+  request.trials = 1;
+  request.seed = std::random_device()();
+  timing_defaults(&request.timing);
+
+  struct batch *batch = new struct batch;
+  const char *output = NULL;
+  const char *registry = NULL;
+  const char *matrix_dir = NULL;
+  int io_threads = 2;
+  int jobs = std::max(1, (int)std::thread::hardware_concurrency());
+  int depth = 0;
+
+  /* Beware. Option parsing below. */
+  long longarg;
+  double doublearg;
+  while (1) {
+    const char *options = "l:x:D:o:i:j:Q:a:g:B:e:s:d:t:cCrRw:fn:M:vqh";
+    const struct option long_options[] = {
+        {"list",       required_argument, 0, 'l'},
+        {"registry",   required_argument, 0, 'x'},
+        {"matrix-dir", required_argument, 0, 'D'},
+        {"output",     required_argument, 0, 'o'},
+        {"io-threads", required_argument, 0, 'i'},
+        {"jobs",       required_argument, 0, 'j'},
+        {"queue",      required_argument, 0, 'Q'},
+        {"algo",     required_argument, 0, 'a'},
+        {"rng-seed", required_argument, 0, 'g'},
+        {"max-block-size", required_argument, 0, 'B'},
+        {"trials",         required_argument, 0, 't'},
+        {"epsilon", required_argument, 0, 'e'},
+        {"delta", required_argument, 0, 'd'},
+        {"sigma", required_argument, 0, 's'},
+        {"clock",     no_argument, &clock,   1},
+        {"noclock",   no_argument, &clock,   0},
+        {"results",   no_argument, &results, 1},
+        {"noresults", no_argument, &results, 0},
+        {"warmup",   required_argument, 0, 'w'},
+        {"flush",     no_argument, &request.timing.flush, 1},
+        {"noise",    required_argument, 0, 'n'},
+        {"max-trials", required_argument, 0, 'M'},
+        {"verbose",   no_argument, &verbose, 1},
+        {"quiet",     no_argument, &verbose, 0},
+        {"help",      no_argument, &help,    1},
+        {0, 0, 0, 0}
+      };
+
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+
+    int c = getopt_long (argc, argv, options,
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1)
+      break;
+
+    if (c == 0 && long_options[option_index].flag == 0)
+      c = long_options[option_index].val;
+
+    switch (c) {
+      case 0:
+        /* If this option set a flag, do nothing else now. */
+        break;
+
+      case 'l':
+        if (batch_add_list(batch, optarg)) {
+          return 1;
+        }
+        break;
+
+      case 'x':
+        registry = optarg;
+        break;
+
+      case 'D':
+        matrix_dir = optarg;
+        break;
+
+      case 'o':
+        output = optarg;
+        break;
+
+      case 'i':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -i takes an integer number of threads >= 1\n");
+          usage();
+          return 1;
+        }
+        io_threads = longarg;
+        break;
+
+      case 'j':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -j takes an integer number of threads >= 1\n");
+          usage();
+          return 1;
+        }
+        jobs = longarg;
+        break;
+
+      case 'Q':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -Q takes an integer number of matrices >= 1\n");
+          usage();
+          return 1;
+        }
+        depth = longarg;
+        break;
+
+      case 'a':
+        request.nselected = estimator_parse(optarg, request.selected);
+        if (request.nselected == 0) {
+          printf("option -a takes a comma separated list of at most %d estimators (phil, phil_offset, pphil, oski, reference, sketch, sell, ell, or dia)\n", ESTIMATORS_MAX);
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'g':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -g takes an integer seed >= 0\n");
+          usage();
+          return 1;
+        }
+        request.seed = longarg;
+        break;
+
+      case 'B':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -B takes an integer maximum block size >= 1\n");
+          usage();
+          return 1;
+        }
+        request.B = longarg;
+        break;
+
+      case 'e':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -e takes a desired relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        request.epsilon = doublearg;
+        break;
+
+      case 'd':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0 || doublearg > 1.0) {
+          printf("option -d takes a desired probability >= 0.0 and <= 1.0\n");
+          usage();
+          return 1;
+        }
+        request.delta = doublearg;
+        break;
+
+      case 's':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0 || doublearg > 1.0) {
+          printf("option -s takes a desired probability >= 0.0 and <= 1.0\n");
+          usage();
+          return 1;
+        }
+        request.sigma = doublearg;
+        break;
+
+      case 't':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -t takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        request.trials = longarg;
+        break;
+
+      case 'c':
+        clock = 1;
+        break;
+
+      case 'C':
+        clock = 0;
+        break;
+
+      case 'r':
+        results = 1;
+        break;
+
+      case 'R':
+        results = 0;
+        break;
+
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        request.timing.warmup = longarg;
+        break;
+
+      case 'f':
+        request.timing.flush = 1;
+        break;
+
+      case 'n':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -n takes a relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        request.timing.noise = doublearg;
+        break;
+
+      case 'M':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -M takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        request.timing.max_trials = longarg;
+        break;
+
+      case 'v':
+        verbose = 1;
+        break;
+
+      case 'q':
+        verbose = 0;
+        break;
+
+      case 'h':
+        help = 1;
+        break;
+
+      case '?':
+        usage();
+        return 1;
+
+      default:
+        abort();
+    }
+  }
+
+  if (help) {
+    printf("Run fill estimation algorithms on many matrices!\n");
+    usage();
+    return 0;
+  }
+
+  if (registry && batch_add_registry(batch, registry, matrix_dir)) {
+    return 1;
+  }
+  for (int k = optind; k < argc; k++) {
+    batch_add(batch, matrix_name(argv[k]), argv[k]);
+  }
+  if (batch->matrices.empty()) {
+    printf("no <input> matrices specified\n");
+    usage();
+    return 1;
+  }
+
+  FILE *out = stdout;
+  if (output) {
+    out = fopen(output, "w");
+    if (out == NULL) {
+      printf("could not open output file %s\n", output);
+      return 1;
+    }
+  }
+
+  request.clock = clock;
+  request.results = results;
+  request.verbose = verbose;
+  batch->request = &request;
+  batch->verbose = verbose;
+  batch->next_load = 0;
+  batch->loaders = io_threads;
+  batch->depth = depth ? depth : 2 * jobs;
+
+  /* Reading the next matrices overlaps with estimating the fill of the
+   * matrices already read.
+   */
+  auto tic = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (int w = 0; w < io_threads; w++) {
+    threads.push_back(std::thread(batch_loader, batch));
+  }
+  for (int w = 0; w < jobs; w++) {
+    threads.push_back(std::thread(batch_estimator, batch));
+  }
+  for (size_t w = 0; w < threads.size(); w++) {
+    threads[w].join();
+  }
+  double total_time = seconds_since(tic);
+
+  int ret = 0;
+  fprintf(out, "{\n");
+  fprintf(out, "  \"matrices\": [\n");
+  for (size_t k = 0; k < batch->matrices.size(); k++) {
+    struct batch_matrix *matrix = &batch->matrices[k];
+    std::string line = "    {\"name\": ";
+    json_append_string(&line, matrix->name);
+    line.append(", \"path\": ");
+    json_append_string(&line, matrix->path);
+    if (matrix->error.empty()) {
+      json_appendf(&line, ", \"m\": %d, \"n\": %d, \"nnz\": %d", matrix->A.m, matrix->A.n, matrix->A.nnz);
+      json_appendf(&line, ", \"load_time\": %.*e, \"compute_time\": %.*e", DECIMAL_DIG, matrix->load_time, DECIMAL_DIG, matrix->compute_time);
+      line.append(matrix->output);
+    } else {
+      line.append(", \"error\": ");
+      json_append_string(&line, matrix->error);
+      fprintf(stderr, "%s: %s\n", matrix->path.c_str(), matrix->error.c_str());
+      ret = 1;
+    }
+    line.append("}");
+    fprintf(out, "%s%s\n", line.c_str(), k < batch->matrices.size() - 1 ? "," : "");
+  }
+  fprintf(out, "  ],\n");
+  fprintf(out, "  \"total_time\": %.*e\n", DECIMAL_DIG, total_time);
+  fprintf(out, "}\n");
+
+  if (output) {
+    fclose(out);
+  }
+  delete batch;
+  return ret;
+}
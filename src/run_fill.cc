@@ -1,12 +1,21 @@
 #include <errno.h>
+#include <limits.h>
 #include <getopt.h>
+#include <omp.h>
 #include <taco.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <random>
-
-int test (int m,
+#include <string>
+#include "estimators.h"
+#include "server.h"
+#include "timing.h"
+
+int test (const char *key,
+          const struct estimator *estimator,
+          int m,
           int n,
           int nnz,
           const int *ptr,
@@ -16,29 +25,77 @@ int test (int m,
           double delta,
           double sigma,
           int trials,
+          const struct timing_options *timing,
           int clock,
           int results,
+          const char *npy,
           long seed,
           int verbose);
 
-const char *name ();
+int test_stream (const char *key,
+                 const char *path,
+                 int B,
+                 double epsilon,
+                 double delta,
+                 int trials,
+                 const struct timing_options *timing,
+                 int clock,
+                 int results,
+                 const char *npy,
+                 long seed,
+                 int verbose);
+
+/* Legacy executables are built from this file with ALGO set to the name of
+ * their estimator. Without it, this file builds fillest, which runs any
+ * number of estimators on one matrix.
+ */
+#ifdef ALGO
+static const char *program = ALGO;
+#else
+static const char *program = "fillest";
+#endif
 
 static void usage () {
   fprintf(stderr,"usage: %s [options] <input>\n"
+  "       %s [options] --serve\n"
   "  <input>                    MatrixMarket file (estimate fill of this matrix)\n"
+  "  -a, --algo <arg>           Comma separated estimators to run\n"
+  "                             (phil, phil_offset, pphil, oski, reference,\n"
+  "                             sketch, sell, ell, or dia)\n"
   "  -g, --rng-seed <arg>       Seed for random number generator\n"
-  "  -B, --max-block-size <arg> Maximum block dimension for fill estimates\n"
+  "  -B, --max-block-size <arg> Maximum block dimension for fill estimates (sell\n"
+  "                             ties its chunks C <= B and sorting windows of\n"
+  "                             k * C rows for k <= B to this grid)\n"
   "  -e, --epsilon <arg>        Be accurate to relative error epsilon\n"
   "  -d, --delta <arg>          With probability (1 - delta)\n"
   "  -s, --sigma <arg>          Examine block rows With probability sigma\n"
   "  -t, --trials <arg>         Number of trials to run\n"
   "  -c, --clock                Display timing information\n"
   "  -C, --noclock              Do not display timing information\n"
-  "  -r, --results              Display fill estimates for all trials\n"
+  "  -r, --results              Display fill estimates for all trials, with the\n"
+  "                             [row, column] offsets of those of phil_offset\n"
   "  -R, --noresults            Do not display fill estimates\n"
+  "  -o, --output-npy <arg>     Save estimates and times as <arg>_<algo>_results.npy\n"
+  "                             and <arg>_<algo>_times.npy (and the offsets of\n"
+  "                             phil_offset as <arg>_<algo>_offsets.npy) instead\n"
+  "                             of printing them\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -f, --flush                Flush caches before each trial\n"
+  "  -n, --noise <arg>          Add trials until the 95%% confidence interval of\n"
+  "                             the mean time is within this relative error\n"
+  "  -M, --max-trials <arg>     Most trials to run when adding trials\n"
+  "  -p, --counters             Count hardware events during the trials\n"
+  "  -x, --stream               Run phil while streaming <input> from disk\n"
+  "                             instead of reading it into memory (the entries\n"
+  "                             must be sorted by row and column)\n"
+  "  -S, --serve                Serve JSON-lines requests from stdin, using the\n"
+  "                             other options as defaults (see server.h)\n"
+  "  -u, --socket <arg>         Serve requests on this Unix socket instead\n"
+  "  -j, --jobs <arg>           Number of requests to serve at once\n"
+  "  -m, --cache-size <arg>     Megabytes of matrices to keep loaded\n"
   "  -v, --verbose              Verbose mode\n"
   "  -q, --quiet                Quiet mode\n"
-  "  -h, --help                 Display help message\n", name());
+  "  -h, --help                 Display help message\n", program, program);
 }
 
 int main (int argc, char **argv) {
@@ -53,14 +110,28 @@ int main (int argc, char **argv) {
   double delta = 0.01;
   double sigma = 0.02;
   int trials = 1;
+  struct timing_options timing;
+  timing_defaults(&timing);
+  int use_counters = 0;
+  const char *npy = NULL;
+  int server = 0;
+  int stream = 0;
+  struct server_options server_options = {NULL, 1, 1024L << 20};
+#ifdef ALGO
+  const struct estimator *selected[ESTIMATORS_MAX] = {estimator_lookup(ALGO)};
+#else
+  const struct estimator *selected[ESTIMATORS_MAX] = {estimator_lookup("phil")};
+#endif
+  int nselected = 1;
   long seed = std::random_device()();
 
   /* Beware. Option parsing below. */
   long longarg;
   double doublearg;
   while (1) {
-    const char *options = "g:B:e:s:d:t:cCrRvqh";
+    const char *options = "a:g:B:e:s:d:t:cCrRo:w:fn:M:pxSu:j:m:vqh";
     const struct option long_options[] = {
+        {"algo",     required_argument, 0, 'a'},
         {"rng-seed", required_argument, 0, 'g'},
         {"max-block-size", required_argument, 0, 'B'},
         {"trials",         required_argument, 0, 't'},
@@ -71,6 +142,17 @@ int main (int argc, char **argv) {
         {"noclock",   no_argument, &clock,   0},
         {"results",   no_argument, &results, 1},
         {"noresults", no_argument, &results, 0},
+        {"output-npy", required_argument, 0, 'o'},
+        {"warmup",   required_argument, 0, 'w'},
+        {"flush",     no_argument, &timing.flush, 1},
+        {"noise",    required_argument, 0, 'n'},
+        {"max-trials", required_argument, 0, 'M'},
+        {"counters",  no_argument, &use_counters, 1},
+        {"stream",    no_argument, &stream,  1},
+        {"serve",     no_argument, &server,  1},
+        {"socket",     required_argument, 0, 'u'},
+        {"jobs",       required_argument, 0, 'j'},
+        {"cache-size", required_argument, 0, 'm'},
         {"verbose",   no_argument, &verbose, 1},
         {"quiet",     no_argument, &verbose, 0},
         {"help",      no_argument, &help,    1},
@@ -95,6 +177,15 @@ int main (int argc, char **argv) {
         /* If this option set a flag, do nothing else now. */
         break;
 
+      case 'a':
+        nselected = estimator_parse(optarg, selected);
+        if (nselected == 0) {
+          printf("option -a takes a comma separated list of at most %d estimators (phil, phil_offset, pphil, oski, reference, sketch, sell, ell, or dia)\n", ESTIMATORS_MAX);
+          usage();
+          return 1;
+        }
+        break;
+
       case 'g':
         errno = 0;
         longarg = strtol(optarg, 0, 10);
@@ -177,6 +268,85 @@ int main (int argc, char **argv) {
         results = 0;
         break;
 
+      case 'o':
+        npy = optarg;
+        break;
+
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        timing.warmup = longarg;
+        break;
+
+      case 'f':
+        timing.flush = 1;
+        break;
+
+      case 'n':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -n takes a relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        timing.noise = doublearg;
+        break;
+
+      case 'M':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -M takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        timing.max_trials = longarg;
+        break;
+
+      case 'p':
+        use_counters = 1;
+        break;
+
+      case 'x':
+        stream = 1;
+        break;
+
+      case 'S':
+        server = 1;
+        break;
+
+      case 'u':
+        server_options.socket = optarg;
+        break;
+
+      case 'j':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -j takes an integer number of jobs >= 1\n");
+          usage();
+          return 1;
+        }
+        server_options.jobs = longarg;
+        break;
+
+      case 'm':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0 || longarg > (LONG_MAX >> 20)) {
+          printf("option -m takes an integer number of megabytes >= 0\n");
+          usage();
+          return 1;
+        }
+        server_options.cache_bytes = longarg << 20;
+        break;
+
       case 'v':
         verbose = 1;
         break;
@@ -204,6 +374,35 @@ int main (int argc, char **argv) {
     return 0;
   }
 
+  if (server || server_options.socket) {
+    if (argc - optind > 0) {
+      printf("<input> is given in each request when serving\n");
+      usage();
+      return 1;
+    }
+    if (use_counters) {
+      printf("option -p cannot be used when serving\n");
+      usage();
+      return 1;
+    }
+    struct fill_request defaults;
+    for (int h = 0; h < nselected; h++) {
+      defaults.selected[h] = selected[h];
+    }
+    defaults.nselected = nselected;
+    defaults.B = B;
+    defaults.epsilon = epsilon;
+    defaults.delta = delta;
+    defaults.sigma = sigma;
+    defaults.trials = trials;
+    defaults.seed = seed;
+    defaults.clock = clock;
+    defaults.results = results;
+    defaults.verbose = verbose;
+    defaults.timing = timing;
+    return serve(&server_options, &defaults);
+  }
+
   if (argc - optind > 1) {
     printf("<input> cannot be more than one file\n");
     usage();
@@ -223,9 +422,66 @@ int main (int argc, char **argv) {
     return 1;
   }
 
+  if (stream) {
+    if (nselected != 1 || strcmp(selected[0]->name, "phil") != 0) {
+      printf("option -x only runs phil\n");
+      usage();
+      return 1;
+    }
+    if (use_counters) {
+      printf("option -p cannot be used when streaming\n");
+      usage();
+      return 1;
+    }
+    int keyed = 1;
+#ifdef ALGO
+    keyed = 0;
+#endif
+    if (keyed) {
+      printf("{\n");
+    }
+    int ret = test_stream(keyed ? "\"phil\": " : "", argv[optind], B, epsilon, delta, trials, &timing, clock, results, npy, seed, verbose);
+    if (keyed) {
+      printf("\n}\n");
+    }
+    return ret;
+  }
+
   auto csr = taco::read(argv[optind], taco::CSR, true);
 
-  int ret = test(csr.getDimension(0), csr.getDimension(1), csr.getStorage().getValues().getSize(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(0).getData(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(1).getData(), B, epsilon, delta, sigma, trials, clock, results, seed, verbose);
+  struct counters counters;
+  if (use_counters) {
+    if (counters_open(&counters, omp_get_max_threads())) {
+      return 1;
+    }
+    timing.counters = &counters;
+  }
 
+  /* fillest reports the output of each estimator under its name. Each key
+   * is printed along with its estimates, so that an estimator which fails
+   * leaves the object valid with the estimators before it.
+   */
+  int keyed = 1;
+#ifdef ALGO
+  keyed = nselected > 1;
+#endif
+  if (keyed) {
+    printf("{\n");
+  }
+  int ret = 0;
+  for (int h = 0; h < nselected && ret == 0; h++) {
+    std::string key;
+    if (keyed) {
+      key = std::string(h > 0 ? ",\n\"" : "\"") + selected[h]->name + "\": ";
+    }
+    ret = test(key.c_str(), selected[h], csr.getDimension(0), csr.getDimension(1), csr.getStorage().getValues().getSize(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(0).getData(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(1).getData(), B, epsilon, delta, sigma, trials, &timing, clock, results, npy, seed, verbose);
+  }
+  if (keyed) {
+    printf("\n}\n");
+  }
+
+  if (use_counters) {
+    counters_close(&counters);
+  }
   return ret;
 }
@@ -0,0 +1,366 @@
+#include <errno.h>
+#include <float.h>
+#include <getopt.h>
+#include <taco.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <random>
+#include "estimators.h"
+#include "timing.h"
+
+/* The estimators of order 3 tensors, which fill3 selects with -a */
+static const struct {
+  const char *name;
+  estimate_fill3_t estimate_fill;
+  reserve_fill3_t reserve_fill;
+} estimators3[] = {
+  {"phil3", estimate_fill_phil3, reserve_fill_phil3},
+  {"pphil3", estimate_fill_pphil3, reserve_fill_pphil3},
+};
+
+static void usage () {
+  fprintf(stderr,"usage: fill3 [options] <input>\n"
+  "  <input>                    FROSTT .tns file of an order 3 tensor\n"
+  "  -a, --algo <arg>           Estimator to run (phil3 or pphil3)\n"
+  "  -g, --rng-seed <arg>       Seed for random number generator\n"
+  "  -B, --max-block-size <arg> Maximum block dimension for fill estimates\n"
+  "  -e, --epsilon <arg>        Be accurate to relative error epsilon\n"
+  "  -d, --delta <arg>          With probability (1 - delta)\n"
+  "  -t, --trials <arg>         Number of trials to run\n"
+  "  -c, --clock                Display timing information\n"
+  "  -C, --noclock              Do not display timing information\n"
+  "  -r, --results              Display fill estimates for all trials\n"
+  "  -R, --noresults            Do not display fill estimates\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -v, --verbose              Verbose mode\n"
+  "  -q, --quiet                Quiet mode\n"
+  "  -h, --help                 Display help message\n");
+}
+
+/* The order of a .tns file is the number of coordinates on its first line,
+ * which taco requires to match the format it is read into.
+ */
+static int tns_order (const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  char *line = NULL;
+  size_t line_size = 0;
+  int order = -1;
+  if (getline(&line, &line_size, f) > 0) {
+    for (char *token = strtok(line, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n")) {
+      order++;
+    }
+  }
+  free(line);
+  fclose(f);
+  return order;
+}
+
+/* Arguments of one estimate_fill3 trial */
+struct fill3_trial {
+  estimate_fill3_t estimate_fill;
+  const struct fill3_csf *csf;
+  int B;
+  double epsilon;
+  double delta;
+  int trials;
+  double *fill;
+  double *extra;
+  long seed;
+  int verbose;
+  struct fill_workspace *workspace;
+};
+
+/* Trials beyond the recorded ones write their estimates to extra */
+static void fill3_trial (void *arg, int t) {
+  struct fill3_trial *a = (struct fill3_trial*)arg;
+  double *fill = t < a->trials ? a->fill + (long)t * a->B * a->B * a->B : a->extra;
+  a->estimate_fill(a->csf, a->B, a->epsilon, a->delta, fill, a->seed, t, a->verbose, a->workspace);
+}
+
+int main (int argc, char **argv) {
+
+  int clock = 1;
+  int results = 0;
+  int verbose = 0;
+  int help = 0;
+
+  int B = 4;
+  double epsilon = 0.1;
+  double delta = 0.01;
+  int trials = 1;
+  struct timing_options timing;
+  timing_defaults(&timing);
+  int selected = 0;
+  long seed = std::random_device()();
+
+  /* Beware. Option parsing below. */
+  long longarg;
+  double doublearg;
+  while (1) {
+    const char *options = "a:g:B:e:d:t:cCrRw:vqh";
+    const struct option long_options[] = {
+        {"algo",     required_argument, 0, 'a'},
+        {"rng-seed", required_argument, 0, 'g'},
+        {"max-block-size", required_argument, 0, 'B'},
+        {"trials",         required_argument, 0, 't'},
+        {"epsilon", required_argument, 0, 'e'},
+        {"delta", required_argument, 0, 'd'},
+        {"clock",     no_argument, &clock,   1},
+        {"noclock",   no_argument, &clock,   0},
+        {"results",   no_argument, &results, 1},
+        {"noresults", no_argument, &results, 0},
+        {"warmup",   required_argument, 0, 'w'},
+        {"verbose",   no_argument, &verbose, 1},
+        {"quiet",     no_argument, &verbose, 0},
+        {"help",      no_argument, &help,    1},
+        {0, 0, 0, 0}
+      };
+
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+
+    int c = getopt_long (argc, argv, options,
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1)
+      break;
+
+    if (c == 0 && long_options[option_index].flag == 0)
+      c = long_options[option_index].val;
+
+    switch (c) {
+      case 0:
+        /* If this option set a flag, do nothing else now. */
+        break;
+
+      case 'a':
+        selected = -1;
+        for (size_t h = 0; h < sizeof(estimators3) / sizeof(estimators3[0]); h++) {
+          if (strcmp(optarg, estimators3[h].name) == 0) {
+            selected = h;
+          }
+        }
+        if (selected < 0) {
+          printf("option -a takes an estimator (phil3 or pphil3)\n");
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'g':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -g takes an integer seed >= 0\n");
+          usage();
+          return 1;
+        }
+        seed = longarg;
+        break;
+
+      case 'B':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -B takes an integer maximum block size >= 1\n");
+          usage();
+          return 1;
+        }
+        B = longarg;
+        break;
+
+      case 'e':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -e takes a desired relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        epsilon = doublearg;
+        break;
+
+      case 'd':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0 || doublearg > 1.0) {
+          printf("option -d takes a desired probability >= 0.0 and <= 1.0\n");
+          usage();
+          return 1;
+        }
+        delta = doublearg;
+        break;
+
+      case 't':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -t takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        trials = longarg;
+        break;
+
+      case 'c':
+        clock = 1;
+        break;
+
+      case 'C':
+        clock = 0;
+        break;
+
+      case 'r':
+        results = 1;
+        break;
+
+      case 'R':
+        results = 0;
+        break;
+
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        timing.warmup = longarg;
+        break;
+
+      case 'v':
+        verbose = 1;
+        break;
+
+      case 'q':
+        verbose = 0;
+        break;
+
+      case 'h':
+        help = 1;
+        break;
+
+      case '?':
+        usage();
+        return 1;
+
+      default:
+        abort();
+    }
+  }
+
+  if (help) {
+    printf("Run a tensor fill estimation algorithm!\n");
+    usage();
+    return 0;
+  }
+
+  if (argc - optind > 1) {
+    printf("<input> cannot be more than one file\n");
+    usage();
+    return 1;
+  }
+
+  if (argc - optind < 1) {
+    printf("<input> not specified\n");
+    usage();
+    return 1;
+  }
+
+  struct stat statthing;
+  if (stat(argv[optind], &statthing) < 0 || !S_ISREG(statthing.st_mode)){
+    printf("<input> must be filename of FROSTT tensor\n");
+    usage();
+    return 1;
+  }
+
+  if (tns_order(argv[optind]) != 3) {
+    printf("<input> must be an order 3 tensor\n");
+    usage();
+    return 1;
+  }
+
+  auto tensor = taco::read(argv[optind], taco::FileType::tns, taco::Format({taco::Sparse, taco::Sparse, taco::Sparse}), true);
+  const auto &index = tensor.getStorage().getIndex();
+  struct fill3_csf csf;
+  csf.m = tensor.getDimension(0);
+  csf.n = tensor.getDimension(1);
+  csf.o = tensor.getDimension(2);
+  csf.nnz = tensor.getStorage().getValues().getSize();
+  csf.pos_i = (const int*)index.getModeIndex(0).getIndexArray(0).getData();
+  csf.ind_i = (const int*)index.getModeIndex(0).getIndexArray(1).getData();
+  csf.pos_j = (const int*)index.getModeIndex(1).getIndexArray(0).getData();
+  csf.ind_j = (const int*)index.getModeIndex(1).getIndexArray(1).getData();
+  csf.pos_k = (const int*)index.getModeIndex(2).getIndexArray(0).getData();
+  csf.ind_k = (const int*)index.getModeIndex(2).getIndexArray(1).getData();
+  if (csf.nnz < 1) {
+    printf("<input> must have nonzeros\n");
+    usage();
+    return 1;
+  }
+  if (verbose) {
+    fprintf(stderr, "%d by %d by %d tensor with %d nonzeros, %d samples\n", csf.m, csf.n, csf.o, csf.nnz, fill3_samples(csf.nnz, B, epsilon, delta));
+  }
+
+  long B3 = (long)B * B * B;
+  double *fill = (double*)malloc(sizeof(double) * B3 * trials);
+  double *extra = (double*)malloc(sizeof(double) * B3);
+
+  /* Trials reuse one workspace, so that they do not time allocation */
+  struct fill_workspace workspace = FILL_WORKSPACE_INIT;
+  if (fill == NULL || extra == NULL || estimators3[selected].reserve_fill(&workspace, &csf, B, epsilon, delta)) {
+    free(fill);
+    free(extra);
+    return 1;
+  }
+
+  struct fill3_trial arg = {estimators3[selected].estimate_fill, &csf, B, epsilon, delta, trials, fill, extra, seed, verbose, &workspace};
+  struct timing_stats stats;
+  int ret = timing_run(&timing, trials, fill3_trial, &arg, &stats);
+  fill_workspace_free(&workspace);
+  if (ret) {
+    free(fill);
+    free(extra);
+    return ret;
+  }
+
+  /* fill3 reports the output of its estimator under its name */
+  printf("{\n\"%s\": {\n", estimators3[selected].name);
+  if (results) {
+    long i = 0;
+    printf("  \"results\": [\n");
+    for (int t = 0; t < trials; t++) {
+      printf("    [\n");
+      for (int b_i = 1; b_i <= B; b_i++) {
+        printf("      [\n");
+        for (int b_j = 1; b_j <= B; b_j++) {
+          printf("        [");
+          for (int b_k = 1; b_k <= B; b_k++) {
+            printf("%.*e%s", DECIMAL_DIG, fill[i], b_k <= B - 1 ? ", " : "");
+            i++;
+          }
+          printf("]%s\n", b_j <= B - 1 ? "," : "");
+        }
+        printf("      ]%s\n", b_i <= B - 1 ? "," : "");
+      }
+      printf("    ]%s\n", t < trials - 1 ? "," : "");
+    }
+    printf("  ]%s\n", clock ? "," : "");
+  }
+  if (clock) {
+    ret = timing_print(&stats, NULL, "  ", 0);
+  }
+  printf("\n}\n}\n");
+
+  timing_free(&stats);
+  free(fill);
+  free(extra);
+  return ret;
+}
@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "json.h"
+#include "mtx.h"
+
+static void usage () {
+  fprintf(stderr,"usage: matrix_info [options] <input>\n"
+  "  <input>                    MatrixMarket file (describe this matrix)\n"
+  "  -H, --header               Only read the size line of the matrix\n"
+  "  -v, --verbose              Verbose mode\n"
+  "  -q, --quiet                Quiet mode\n"
+  "  -h, --help                 Display help message\n");
+}
+
+/* Rows with at least 2^(k - 1) and fewer than 2^k nonzeros count toward bucket
+ * k of the row length histogram, and empty rows count toward bucket 0.
+ */
+#define ROW_HISTOGRAM_SIZE 33
+
+static int row_bucket (int length) {
+  int k = 0;
+  while (length > 0) {
+    length >>= 1;
+    k++;
+  }
+  return k;
+}
+
+/* 64 bit FNV-1a hash of the file at path */
+static int file_hash (const char *path, uint64_t *hash) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return 1;
+  }
+  uint64_t h = 14695981039346656037ULL;
+  unsigned char buffer[1 << 16];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    for (size_t k = 0; k < size; k++) {
+      h = (h ^ buffer[k]) * 1099511628211ULL;
+    }
+  }
+  int ret = ferror(f);
+  fclose(f);
+  *hash = h;
+  return ret;
+}
+
+int main (int argc, char **argv) {
+
+  int verbose = 0;
+  int help = 0;
+  int header_only = 0;
+
+  /* Beware. Option parsing below. */
+  while (1) {
+    const char *options = "Hvqh";
+    const struct option long_options[] = {
+        {"header",    no_argument, &header_only, 1},
+        {"verbose",   no_argument, &verbose, 1},
+        {"quiet",     no_argument, &verbose, 0},
+        {"help",      no_argument, &help,    1},
+        {0, 0, 0, 0}
+      };
+
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+
+    int c = getopt_long (argc, argv, options,
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1)
+      break;
+
+    if (c == 0 && long_options[option_index].flag == 0)
+      c = long_options[option_index].val;
+
+    switch (c) {
+      case 0:
+        /* If this option set a flag, do nothing else now. */
+        break;
+
+      case 'H':
+        header_only = 1;
+        break;
+
+      case 'v':
+        verbose = 1;
+        break;
+
+      case 'q':
+        verbose = 0;
+        break;
+
+      case 'h':
+        help = 1;
+        break;
+
+      case '?':
+        usage();
+        return 1;
+
+      default:
+        abort();
+    }
+  }
+
+  if (help) {
+    printf("Describe a matrix!\n");
+    usage();
+    return 0;
+  }
+
+  if (argc - optind != 1) {
+    printf("wrong number of arguments\n");
+    usage();
+    return 1;
+  }
+
+  const char *path = argv[optind];
+  char error[MTX_ERROR_SIZE];
+  struct mtx_header header;
+  if (mtx_read_header(path, &header, error)) {
+    fprintf(stderr, "%s\n", error);
+    return 1;
+  }
+
+  std::string out = "{\n  \"path\": ";
+  json_append_string(&out, path);
+  out += ",\n  \"field\": ";
+  json_append_string(&out, header.field);
+  out += ",\n  \"symmetry\": ";
+  json_append_string(&out, header.symmetry);
+  json_appendf(&out, ",\n  \"m\": %ld,\n  \"n\": %ld,\n  \"entries\": %ld", header.m, header.n, header.entries);
+
+  if (!header_only) {
+    /* nnz counts the nonzeros after mirroring and combining duplicates */
+    struct csr_matrix A;
+    if (mtx_read(path, 0, &A, error)) {
+      fprintf(stderr, "%s\n", error);
+      return 1;
+    }
+    long histogram[ROW_HISTOGRAM_SIZE] = {0};
+    int max_row = 0;
+    long lower = 0;
+    long upper = 0;
+    for (int i = 0; i < A.m; i++) {
+      int length = A.ptr[i + 1] - A.ptr[i];
+      histogram[row_bucket(length)]++;
+      max_row = length > max_row ? length : max_row;
+      if (length > 0) {
+        lower = i - A.ind[A.ptr[i]] > lower ? i - A.ind[A.ptr[i]] : lower;
+        upper = A.ind[A.ptr[i + 1] - 1] - i > upper ? A.ind[A.ptr[i + 1] - 1] - i : upper;
+      }
+    }
+    int buckets = ROW_HISTOGRAM_SIZE;
+    while (buckets > 1 && histogram[buckets - 1] == 0) {
+      buckets--;
+    }
+    json_appendf(&out, ",\n  \"nnz\": %d,\n  \"max_row\": %d,\n  \"row_histogram\": [", A.nnz, max_row);
+    for (int k = 0; k < buckets; k++) {
+      json_appendf(&out, "%ld%s", histogram[k], k < buckets - 1 ? ", " : "");
+    }
+    json_appendf(&out, "],\n  \"lower_bandwidth\": %ld,\n  \"upper_bandwidth\": %ld", lower, upper);
+    csr_free(&A);
+
+    uint64_t hash;
+    if (file_hash(path, &hash)) {
+      fprintf(stderr, "could not read %s: %s\n", path, strerror(errno));
+      return 1;
+    }
+    json_appendf(&out, ",\n  \"hash\": \"%016" PRIx64 "\"", hash);
+  }
+  out += "\n}\n";
+  fputs(out.c_str(), stdout);
+  return 0;
+}
@@ -0,0 +1,372 @@
+#include <errno.h>
+#include <float.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <taco.h>
+#include <string>
+#include "npy.h"
+#include "spmv.h"
+#include "timing.h"
+
+static void usage () {
+  fprintf(stderr,"usage: profile [options]\n"
+  "  -S, --sizes <arg>          Comma separated dense matrix sizes to profile,\n"
+  "                             each <m>x<n> or <n> for an n by n matrix\n"
+  "  -B, --max-block-size <arg> Maximum block dimension to profile\n"
+  "  -k, --vectors <arg>        Number of vectors to multiply by\n"
+  "  -K, --kernel <arg>         SpMV implementation to time (taco or native)\n"
+  "  -T, --threads <arg>        Comma separated thread counts to time (native)\n"
+  "  -t, --trials <arg>         Number of trials to run\n"
+  "  -W, --bandwidth            Also measure the sustained memory bandwidth\n"
+  "  -o, --output-npy <arg>     Save the profile as <arg>_results.npy instead of\n"
+  "                             printing it\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -f, --flush                Flush caches before each trial\n"
+  "  -n, --noise <arg>          Add trials until the 95%% confidence interval of\n"
+  "                             the mean time is within this relative error\n"
+  "  -M, --max-trials <arg>     Most trials to run when adding trials\n"
+  "  -v, --verbose              Verbose mode\n"
+  "  -q, --quiet                Quiet mode\n"
+  "  -h, --help                 Display help message\n");
+}
+
+/* Parse a comma separated list of sizes such as "1000,4000x100" into ms and
+ * ns, returning the number of sizes or 0 on error.
+ */
+static int parse_sizes (const char *arg, int *ms, int *ns) {
+  int nsizes = 0;
+  const char *p = arg;
+  while (*p) {
+    char *end;
+    errno = 0;
+    long m = strtol(p, &end, 10);
+    long n = m;
+    if (errno == 0 && end != p && *end == 'x') {
+      p = end + 1;
+      n = strtol(p, &end, 10);
+    }
+    if (errno != 0 || end == p || m < 1 || n < 1 || m * n > INT_MAX || nsizes == SPMV_MAX_COUNTS) {
+      return 0;
+    }
+    ms[nsizes] = m;
+    ns[nsizes] = n;
+    nsizes++;
+    if (*end == ',') {
+      end++;
+    } else if (*end) {
+      return 0;
+    }
+    p = end;
+  }
+  return nsizes;
+}
+
+/* Print the row-major array data with the given shape as nested JSON lists,
+ * indenting the lines after the first with indent.
+ */
+static void print_array (const double *data, int ndim, const long *shape, const char *indent) {
+  if (ndim == 1) {
+    printf("[");
+    for (long k = 0; k < shape[0]; k++) {
+      printf("%.*e%s", DECIMAL_DIG, data[k], k < shape[0] - 1 ? ", " : "");
+    }
+    printf("]");
+    return;
+  }
+  long stride = 1;
+  for (int d = 1; d < ndim; d++) {
+    stride *= shape[d];
+  }
+  std::string inner = std::string(indent) + "  ";
+  printf("[\n");
+  for (long k = 0; k < shape[0]; k++) {
+    printf("%s", inner.c_str());
+    print_array(data + k * stride, ndim - 1, shape + 1, inner.c_str());
+    printf("%s\n", k < shape[0] - 1 ? "," : "");
+  }
+  printf("%s]", indent);
+}
+
+int main (int argc, char **argv) {
+
+  int verbose = 0;
+  int help = 0;
+
+  int B = 12;
+  int nsizes = 1;
+  int ms[SPMV_MAX_COUNTS] = {1000};
+  int ns[SPMV_MAX_COUNTS] = {1000};
+  int vectors = 1;
+  int kernel = SPMV_KERNEL_NATIVE;
+  int nthreads = 1;
+  int sweep = 0;
+  int threads[SPMV_MAX_COUNTS] = {1};
+  int trials = 10;
+  struct timing_options timing;
+  timing_defaults(&timing);
+  const char *npy = NULL;
+  int bandwidth = 0;
+
+  /* Beware. Option parsing below. */
+  long longarg;
+  double doublearg;
+  while (1) {
+    const char *options = "S:B:k:K:T:t:Wo:w:fn:M:vqh";
+    const struct option long_options[] = {
+        {"sizes",    required_argument, 0, 'S'},
+        {"max-block-size", required_argument, 0, 'B'},
+        {"vectors",  required_argument, 0, 'k'},
+        {"kernel",   required_argument, 0, 'K'},
+        {"threads",  required_argument, 0, 'T'},
+        {"trials",   required_argument, 0, 't'},
+        {"bandwidth", no_argument, &bandwidth, 1},
+        {"output-npy", required_argument, 0, 'o'},
+        {"warmup",   required_argument, 0, 'w'},
+        {"flush",     no_argument, &timing.flush, 1},
+        {"noise",    required_argument, 0, 'n'},
+        {"max-trials", required_argument, 0, 'M'},
+        {"verbose",   no_argument, &verbose, 1},
+        {"quiet",     no_argument, &verbose, 0},
+        {"help",      no_argument, &help,    1},
+        {0, 0, 0, 0}
+      };
+
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+
+    int c = getopt_long (argc, argv, options,
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1)
+      break;
+
+    if (c == 0 && long_options[option_index].flag == 0)
+      c = long_options[option_index].val;
+
+    switch (c) {
+      case 0:
+        /* If this option set a flag, do nothing else now. */
+        break;
+
+      case 'S':
+        nsizes = parse_sizes(optarg, ms, ns);
+        if (nsizes == 0) {
+          printf("option -S takes a comma separated list of at most %d sizes <m>x<n> or <n> with at most %d entries\n", SPMV_MAX_COUNTS, INT_MAX);
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'B':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -B takes an integer maximum block size >= 1\n");
+          usage();
+          return 1;
+        }
+        B = longarg;
+        break;
+
+      case 'k':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -k takes an integer number of vectors >= 1\n");
+          usage();
+          return 1;
+        }
+        vectors = longarg;
+        break;
+
+      case 'K':
+        if (strcmp(optarg, "taco") == 0) {
+          kernel = SPMV_KERNEL_TACO;
+        } else if (strcmp(optarg, "native") == 0) {
+          kernel = SPMV_KERNEL_NATIVE;
+        } else {
+          printf("option -K takes a kernel name (taco or native)\n");
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'T':
+        nthreads = parse_counts(optarg, threads);
+        if (nthreads == 0) {
+          printf("option -T takes a comma separated list of at most %d thread counts >= 1\n", SPMV_MAX_COUNTS);
+          usage();
+          return 1;
+        }
+        sweep = 1;
+        break;
+
+      case 't':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -t takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        trials = longarg;
+        break;
+
+      case 'W':
+        bandwidth = 1;
+        break;
+
+      case 'o':
+        npy = optarg;
+        break;
+
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        timing.warmup = longarg;
+        break;
+
+      case 'f':
+        timing.flush = 1;
+        break;
+
+      case 'n':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -n takes a relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        timing.noise = doublearg;
+        break;
+
+      case 'M':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -M takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        timing.max_trials = longarg;
+        break;
+
+      case 'v':
+        verbose = 1;
+        break;
+
+      case 'q':
+        verbose = 0;
+        break;
+
+      case 'h':
+        help = 1;
+        break;
+
+      case '?':
+        usage();
+        return 1;
+
+      default:
+        abort();
+    }
+  }
+
+  if (help) {
+    printf("Profile the multiplication of dense matrices in every block size!\n");
+    usage();
+    return 0;
+  }
+
+  if (argc - optind > 0) {
+    printf("profile takes no <input>, the matrices are generated\n");
+    usage();
+    return 1;
+  }
+
+  /* profile[s][u][b_r - 1][b_c - 1] is the rate for sizes[s] using threads[u]
+   * threads. The size and thread dimensions are only reported when several
+   * sizes or a list of threads are given, so that a single profile has the
+   * B by B shape that the python test harnesses and autotune expect.
+   */
+  double *profile = (double*)malloc(sizeof(double) * nsizes * nthreads * B * B);
+  if (profile == NULL) {
+    return 1;
+  }
+  for (int s = 0; s < nsizes; s++) {
+    if (spmv_profile(ms[s], ns[s], B, vectors, kernel, nthreads, threads, trials, &timing, verbose, profile + (long)s * nthreads * B * B)) {
+      fprintf(stderr, "could not profile a %d by %d matrix\n", ms[s], ns[s]);
+      free(profile);
+      return 1;
+    }
+  }
+
+  double bandwidth_mb = 0.0;
+  if (bandwidth && spmv_bandwidth(SPMV_STREAM_SIZE, trials, &timing, &bandwidth_mb)) {
+    fprintf(stderr, "could not measure the bandwidth\n");
+    free(profile);
+    return 1;
+  }
+
+  long shape[4];
+  int ndim = 0;
+  if (nsizes > 1) {
+    shape[ndim++] = nsizes;
+  }
+  if (sweep) {
+    shape[ndim++] = nthreads;
+  }
+  shape[ndim++] = B;
+  shape[ndim++] = B;
+
+  taco::JITCacheStats cache = taco::getJITCacheStats();
+  printf("{\n");
+  printf("  \"jit_cache_hits\": %ld,\n", cache.hits);
+  printf("  \"jit_cache_misses\": %ld,\n", cache.misses);
+  printf("  \"vectors\": %d,\n", vectors);
+  if (bandwidth) {
+    printf("  \"bandwidth\": %.*e,\n", DECIMAL_DIG, bandwidth_mb);
+  }
+  printf("  \"sizes\": [");
+  for (int s = 0; s < nsizes; s++) {
+    printf("[%d, %d]%s", ms[s], ns[s], s < nsizes - 1 ? ", " : "");
+  }
+  printf("],\n");
+
+  /* Bytes of the CSR arrays and vectors, to compare with the cache sizes */
+  printf("  \"bytes\": [");
+  for (int s = 0; s < nsizes; s++) {
+    long bytes = (sizeof(int) + sizeof(double)) * (long)ms[s] * ns[s] + sizeof(int) * ((long)ms[s] + 1) + sizeof(double) * vectors * ((long)ms[s] + ns[s]);
+    printf("%ld%s", bytes, s < nsizes - 1 ? ", " : "");
+  }
+  printf("],\n");
+  if (sweep) {
+    printf("  \"threads\": [");
+    for (int u = 0; u < nthreads; u++) {
+      printf("%d%s", threads[u], u < nthreads - 1 ? ", " : "");
+    }
+    printf("],\n");
+  }
+  int ret = 0;
+  if (npy) {
+    ret = npy_print(npy, "results", ndim, shape, profile, "  ", 0);
+  } else {
+    printf("  \"results\": ");
+    print_array(profile, ndim, shape, "  ");
+    printf("\n");
+  }
+  printf("}\n");
+
+  free(profile);
+  return ret;
+}
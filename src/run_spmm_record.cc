@@ -0,0 +1,286 @@
+#include <errno.h>
+#include <getopt.h>
+#include <taco.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <float.h>
+#include "npy.h"
+#include "spmv.h"
+#include "timing.h"
+
+static void usage () {
+  fprintf(stderr,"usage: spmm_record [options] <input>\n"
+  "  <input>                    MatrixMarket file (multiply this matrix)\n"
+  "  -B, --max-block-size <arg> Maximum block dimension for fill estimates\n"
+  "  -k, --vectors <arg>        Comma separated numbers of vectors to time\n"
+  "  -K, --kernel <arg>         SpMM implementation to time (taco or native)\n"
+  "  -T, --threads <arg>        Number of threads to use (native)\n"
+  "  -t, --trials <arg>         Number of trials to run\n"
+  "  -o, --output-npy <arg>     Save the times as <arg>_results.npy instead of\n"
+  "                             printing them\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -f, --flush                Flush caches before each trial\n"
+  "  -n, --noise <arg>          Add trials until the 95%% confidence interval of\n"
+  "                             the mean time is within this relative error\n"
+  "  -M, --max-trials <arg>     Most trials to run when adding trials\n"
+  "  -v, --verbose              Verbose mode\n"
+  "  -q, --quiet                Quiet mode\n"
+  "  -h, --help                 Display help message\n");
+}
+
+int main (int argc, char **argv) {
+
+  int verbose = 0;
+  int help = 0;
+
+  int B = 12;
+  int kernel = SPMV_KERNEL_TACO;
+  int nvectors = 5;
+  int vectors[SPMV_MAX_COUNTS] = {1, 4, 8, 16, 32};
+  int threads = 1;
+  int trials = 1;
+  struct timing_options timing;
+  timing_defaults(&timing);
+  const char *npy = NULL;
+
+  /* Beware. Option parsing below. */
+  long longarg;
+  double doublearg;
+  while (1) {
+    const char *options = "B:k:K:T:t:o:w:fn:M:vqh";
+    const struct option long_options[] = {
+        {"max-block-size", required_argument, 0, 'B'},
+        {"vectors",  required_argument, 0, 'k'},
+        {"kernel",   required_argument, 0, 'K'},
+        {"threads",  required_argument, 0, 'T'},
+        {"trials",   required_argument, 0, 't'},
+        {"output-npy", required_argument, 0, 'o'},
+        {"warmup",   required_argument, 0, 'w'},
+        {"flush",     no_argument, &timing.flush, 1},
+        {"noise",    required_argument, 0, 'n'},
+        {"max-trials", required_argument, 0, 'M'},
+        {"verbose",   no_argument, &verbose, 1},
+        {"quiet",     no_argument, &verbose, 0},
+        {"help",      no_argument, &help,    1},
+        {0, 0, 0, 0}
+      };
+
+    /* getopt_long stores the option index here. */
+    int option_index = 0;
+
+    int c = getopt_long (argc, argv, options,
+                     long_options, &option_index);
+
+    /* Detect the end of the options. */
+    if (c == -1)
+      break;
+
+    if (c == 0 && long_options[option_index].flag == 0)
+      c = long_options[option_index].val;
+
+    switch (c) {
+      case 0:
+        /* If this option set a flag, do nothing else now. */
+        break;
+
+      case 'B':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -B takes an integer maximum block size >= 1\n");
+          usage();
+          return 1;
+        }
+        B = longarg;
+        break;
+
+      case 'K':
+        if (strcmp(optarg, "taco") == 0) {
+          kernel = SPMV_KERNEL_TACO;
+        } else if (strcmp(optarg, "native") == 0) {
+          kernel = SPMV_KERNEL_NATIVE;
+        } else {
+          printf("option -K takes a kernel name (taco or native)\n");
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'k':
+        nvectors = parse_counts(optarg, vectors);
+        if (nvectors == 0) {
+          printf("option -k takes a comma separated list of at most %d vector counts >= 1\n", SPMV_MAX_COUNTS);
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'T':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -T takes an integer number of threads >= 1\n");
+          usage();
+          return 1;
+        }
+        threads = longarg;
+        break;
+
+      case 't':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -t takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        trials = longarg;
+        break;
+
+      case 'o':
+        npy = optarg;
+        break;
+
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        timing.warmup = longarg;
+        break;
+
+      case 'f':
+        timing.flush = 1;
+        break;
+
+      case 'n':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -n takes a relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        timing.noise = doublearg;
+        break;
+
+      case 'M':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -M takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        timing.max_trials = longarg;
+        break;
+
+      case 'v':
+        verbose = 1;
+        break;
+
+      case 'q':
+        verbose = 0;
+        break;
+
+      case 'h':
+        help = 1;
+        break;
+
+      case '?':
+        usage();
+        return 1;
+
+      default:
+        abort();
+    }
+  }
+
+  if (help) {
+    printf("Run a fill estimation algorithm!\n");
+    usage();
+    return 0;
+  }
+
+  if (argc - optind > 1) {
+    printf("<input> cannot be more than one file\n");
+    usage();
+    return 1;
+  }
+
+  if (argc - optind < 1) {
+    printf("<input> not specified\n");
+    usage();
+    return 1;
+  }
+
+  struct stat statthing;
+  if (stat(argv[optind], &statthing) < 0 || !S_ISREG(statthing.st_mode)){
+    printf("<input> must be filename of MatrixMarket matrix\n");
+    usage();
+    return 1;
+  }
+
+  auto csr = taco::read(argv[optind], taco::CSR, true);
+
+  /* time_mean[u][b_r - 1][b_c - 1] is the mean time using vectors[u] vectors */
+  double *time_mean = (double*)malloc(sizeof(double) * nvectors * B * B);
+  for (int u = 0; u < nvectors; u++) {
+    struct spmv_session *session = spmv_session_create(csr.getDimension(0), csr.getDimension(1), csr.getStorage().getValues().getSize(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(0).getData(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(1).getData(), (double*)csr.getStorage().getValues().getData(), vectors[u], kernel, verbose);
+    if (session == NULL) {
+      return 1;
+    }
+    for (int b_r = 1; b_r <= B; b_r++) {
+      for (int b_c = 1; b_c <= B; b_c++) {
+        double block_convert;
+        double block_assemble;
+        struct timing_stats block_stats;
+        int ret = spmv_session_test(session, b_r, b_c, 1, &threads, trials, &timing, &block_convert, &block_assemble, &block_stats);
+        if (ret) {
+          return ret;
+        }
+        time_mean[(u * B + b_r - 1) * B + b_c - 1] = block_stats.mean;
+        timing_free(&block_stats);
+      }
+    }
+    spmv_session_free(session);
+  }
+
+  taco::JITCacheStats cache = taco::getJITCacheStats();
+  printf("{\n");
+  printf("  \"jit_cache_hits\": %ld,\n", cache.hits);
+  printf("  \"jit_cache_misses\": %ld,\n", cache.misses);
+  printf("  \"vectors\": [");
+  for (int u = 0; u < nvectors; u++) {
+    printf("%d%s", vectors[u], u < nvectors - 1 ? ", " : "");
+  }
+  printf("],\n");
+  int ret = 0;
+  if (npy) {
+    long shape[3] = {nvectors, B, B};
+    ret = npy_print(npy, "results", 3, shape, time_mean, "  ", 0);
+  } else {
+    printf("  \"results\": [\n");
+    for (int u = 0; u < nvectors; u++) {
+      printf("    [\n");
+      for (int b_r = 1; b_r <= B; b_r++) {
+        printf("      [\n");
+        for (int b_c = 1; b_c <= B; b_c++) {
+          printf("%.*e%s", DECIMAL_DIG, time_mean[(u * B + b_r - 1) * B + b_c - 1], b_c <= B - 1 ? ", " : "");
+        }
+        printf("      ]%s\n", b_r <= B - 1 ? "," : "");
+      }
+      printf("    ]%s\n", u < nvectors - 1 ? "," : "");
+    }
+    printf("  ]%s\n", 0 ? "," : "");
+  }
+  printf("}\n");
+
+  free(time_mean);
+  return ret;
+}
@@ -1,25 +1,16 @@
 #include <errno.h>
 #include <getopt.h>
+#include <omp.h>
 #include <taco.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <float.h>
 #include <random>
 #include <chrono>
-
-int test (int m,
-          int n,
-          int nnz,
-          const int *ptr,
-          const int *ind,
-          const double *data,
-          int r,
-          int c,
-          int trials,
-          int verbose,
-          double *time_total,
-          double *time_mean);
+#include "spmv.h"
+#include "timing.h"
 
 static void usage () {
   fprintf(stderr,"usage: spmv [options] <input>\n"
@@ -27,7 +18,16 @@ static void usage () {
   "  -g, --rng-seed <arg>       Seed for random number generator\n"
   "  -r, --block_r <arg>        Row block size\n"
   "  -c, --block_c <arg>        Column block size\n"
+  "  -k, --vectors <arg>        Number of vectors to multiply by at once\n"
+  "  -K, --kernel <arg>         SpMV implementation to time (taco or native)\n"
+  "  -T, --threads <arg>        Comma separated thread counts to time (native)\n"
   "  -t, --trials <arg>         Number of trials to run\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -f, --flush                Flush caches before each trial\n"
+  "  -n, --noise <arg>          Add trials until the 95%% confidence interval of\n"
+  "                             the mean time is within this relative error\n"
+  "  -M, --max-trials <arg>     Most trials to run when adding trials\n"
+  "  -p, --counters             Count hardware events during the trials\n"
   "  -v, --verbose              Verbose mode\n"
   "  -q, --quiet                Quiet mode\n"
   "  -h, --help                 Display help message\n");
@@ -40,19 +40,35 @@ int main (int argc, char **argv) {
 
   int b_r = 1;
   int b_c = 1;
+  int vectors = 1;
+  int kernel = SPMV_KERNEL_TACO;
+  int nthreads = 1;
+  int sweep = 0;
+  int threads[SPMV_MAX_COUNTS] = {1};
   int trials = 1;
+  struct timing_options timing;
+  timing_defaults(&timing);
+  int use_counters = 0;
   long seed = std::random_device()();
 
   /* Beware. Option parsing below. */
   long longarg;
   double doublearg;
   while (1) {
-    const char *options = "g:r:c:t:vqh";
+    const char *options = "g:r:c:k:K:T:t:w:fn:M:pvqh";
     const struct option long_options[] = {
         {"rng-seed", required_argument, 0, 'g'},
         {"block_r",  required_argument, 0, 'r'},
         {"block_c",  required_argument, 0, 'c'},
+        {"vectors",  required_argument, 0, 'k'},
+        {"kernel",   required_argument, 0, 'K'},
+        {"threads",  required_argument, 0, 'T'},
         {"trials",   required_argument, 0, 't'},
+        {"warmup",   required_argument, 0, 'w'},
+        {"flush",     no_argument, &timing.flush, 1},
+        {"noise",    required_argument, 0, 'n'},
+        {"max-trials", required_argument, 0, 'M'},
+        {"counters",  no_argument, &use_counters, 1},
         {"verbose",   no_argument, &verbose, 1},
         {"quiet",     no_argument, &verbose, 0},
         {"help",      no_argument, &help,    1},
@@ -110,6 +126,39 @@ int main (int argc, char **argv) {
         b_c = longarg;
         break;
 
+      case 'k':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -k takes an integer number of vectors >= 1\n");
+          usage();
+          return 1;
+        }
+        vectors = longarg;
+        break;
+
+      case 'K':
+        if (strcmp(optarg, "taco") == 0) {
+          kernel = SPMV_KERNEL_TACO;
+        } else if (strcmp(optarg, "native") == 0) {
+          kernel = SPMV_KERNEL_NATIVE;
+        } else {
+          printf("option -K takes a kernel name (taco or native)\n");
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'T':
+        nthreads = parse_counts(optarg, threads);
+        if (nthreads == 0) {
+          printf("option -T takes a comma separated list of at most %d thread counts >= 1\n", SPMV_MAX_COUNTS);
+          usage();
+          return 1;
+        }
+        sweep = 1;
+        break;
+
       case 't':
         errno = 0;
         longarg = strtol(optarg, 0, 10);
@@ -121,6 +170,47 @@ int main (int argc, char **argv) {
         trials = longarg;
         break;
 
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        timing.warmup = longarg;
+        break;
+
+      case 'f':
+        timing.flush = 1;
+        break;
+
+      case 'n':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -n takes a relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        timing.noise = doublearg;
+        break;
+
+      case 'M':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -M takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        timing.max_trials = longarg;
+        break;
+
+      case 'p':
+        use_counters = 1;
+        break;
+
       case 'v':
         verbose = 1;
         break;
@@ -169,18 +259,62 @@ int main (int argc, char **argv) {
 
   auto csr = taco::read(argv[optind], taco::CSR, true);
 
-  double time_total;
-  double time_mean;
-  int ret = test(csr.getDimension(0), csr.getDimension(1), csr.getStorage().getValues().getSize(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(0).getData(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(1).getData(), (double*)csr.getStorage().getValues().getData(), b_r, b_c, trials, verbose, &time_total, &time_mean);
+  struct counters counters;
+  if (use_counters) {
+    int max_threads = 1;
+    for (int u = 0; u < nthreads; u++) {
+      max_threads = threads[u] > max_threads ? threads[u] : max_threads;
+    }
+    if (counters_open(&counters, max_threads)) {
+      return 1;
+    }
+    timing.counters = &counters;
+  }
+
+  struct timing_stats stats[SPMV_MAX_COUNTS];
+  int ret = test(csr.getDimension(0), csr.getDimension(1), csr.getStorage().getValues().getSize(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(0).getData(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(1).getData(), (double*)csr.getStorage().getValues().getData(), b_r, b_c, vectors, kernel, nthreads, threads, trials, &timing, verbose, stats);
 
   if (ret) {
     return ret;
   }
 
   printf("{\n");
-  printf("  \"total_time\": %.*e,\n", DECIMAL_DIG, time_total);
-  printf("  \"mean_time\": %.*e%s\n", DECIMAL_DIG, time_mean, 0 ? "," : "");
+  if (sweep) {
+    printf("  \"threads\": [");
+    for (int u = 0; u < nthreads; u++) {
+      printf("%d%s", threads[u], u < nthreads - 1 ? ", " : "");
+    }
+    printf("],\n");
+    printf("  \"total_times\": [");
+    for (int u = 0; u < nthreads; u++) {
+      printf("%.*e%s", DECIMAL_DIG, stats[u].total, u < nthreads - 1 ? ", " : "");
+    }
+    printf("],\n");
+    printf("  \"mean_times\": [");
+    for (int u = 0; u < nthreads; u++) {
+      printf("%.*e%s", DECIMAL_DIG, stats[u].mean, u < nthreads - 1 ? ", " : "");
+    }
+    printf("],\n");
+    printf("  \"timings\": [\n");
+    for (int u = 0; u < nthreads; u++) {
+      printf("    {\n");
+      timing_print(&stats[u], NULL, "      ", 0);
+      printf("    }%s\n", u < nthreads - 1 ? "," : "");
+    }
+    printf("  ],\n");
+  }
+  taco::JITCacheStats cache = taco::getJITCacheStats();
+  printf("  \"jit_cache_hits\": %ld,\n", cache.hits);
+  printf("  \"jit_cache_misses\": %ld,\n", cache.misses);
+  timing_print(&stats[0], NULL, "  ", 0);
   printf("\n}\n");
 
+  for (int u = 0; u < nthreads; u++) {
+    timing_free(&stats[u]);
+  }
+  if (use_counters) {
+    counters_close(&counters);
+  }
+
   return 0;
 }
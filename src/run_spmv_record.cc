@@ -3,29 +3,29 @@
 #include <taco.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <float.h>
 #include <random>
-
-int test (int m,
-          int n,
-          int nnz,
-          const int *ptr,
-          const int *ind,
-          const double *data,
-          int r,
-          int c,
-          int trials,
-          int verbose,
-          double *time_total,
-          double *time_mean);
+#include "npy.h"
+#include "spmv.h"
+#include "timing.h"
 
 static void usage () {
   fprintf(stderr,"usage: spmv [options] <input>\n"
   "  <input>                    MatrixMarket file (multiply this matrix)\n"
   "  -g, --rng-seed <arg>       Seed for random number generator\n"
   "  -B, --max-block-size <arg> Maximum block dimension for fill estimates\n"
+  "  -K, --kernel <arg>         SpMV implementation to time (taco or native)\n"
+  "  -T, --threads <arg>        Comma separated thread counts to time (native)\n"
   "  -t, --trials <arg>         Number of trials to run\n"
+  "  -o, --output-npy <arg>     Save each array of times as <arg>_<key>.npy\n"
+  "                             instead of printing it\n"
+  "  -w, --warmup <arg>         Number of untimed runs before the trials\n"
+  "  -f, --flush                Flush caches before each trial\n"
+  "  -n, --noise <arg>          Add trials until the 95%% confidence interval of\n"
+  "                             the mean time is within this relative error\n"
+  "  -M, --max-trials <arg>     Most trials to run when adding trials\n"
   "  -v, --verbose              Verbose mode\n"
   "  -q, --quiet                Quiet mode\n"
   "  -h, --help                 Display help message\n");
@@ -37,18 +37,32 @@ int main (int argc, char **argv) {
   int help = 0;
 
   int B = 12;
+  int kernel = SPMV_KERNEL_TACO;
+  int nthreads = 1;
+  int sweep = 0;
+  int threads[SPMV_MAX_COUNTS] = {1};
   int trials = 1;
+  struct timing_options timing;
+  timing_defaults(&timing);
   long seed = std::random_device()();
+  const char *npy = NULL;
 
   /* Beware. Option parsing below. */
   long longarg;
   double doublearg;
   while (1) {
-    const char *options = "g:B:t:vqh";
+    const char *options = "g:B:K:T:t:o:w:fn:M:vqh";
     const struct option long_options[] = {
         {"rng-seed", required_argument, 0, 'g'},
         {"max-block-size", required_argument, 0, 'B'},
+        {"kernel",   required_argument, 0, 'K'},
+        {"threads",  required_argument, 0, 'T'},
         {"trials",   required_argument, 0, 't'},
+        {"output-npy", required_argument, 0, 'o'},
+        {"warmup",   required_argument, 0, 'w'},
+        {"flush",     no_argument, &timing.flush, 1},
+        {"noise",    required_argument, 0, 'n'},
+        {"max-trials", required_argument, 0, 'M'},
         {"verbose",   no_argument, &verbose, 1},
         {"quiet",     no_argument, &verbose, 0},
         {"help",      no_argument, &help,    1},
@@ -95,6 +109,28 @@ int main (int argc, char **argv) {
         B = longarg;
         break;
 
+      case 'K':
+        if (strcmp(optarg, "taco") == 0) {
+          kernel = SPMV_KERNEL_TACO;
+        } else if (strcmp(optarg, "native") == 0) {
+          kernel = SPMV_KERNEL_NATIVE;
+        } else {
+          printf("option -K takes a kernel name (taco or native)\n");
+          usage();
+          return 1;
+        }
+        break;
+
+      case 'T':
+        nthreads = parse_counts(optarg, threads);
+        if (nthreads == 0) {
+          printf("option -T takes a comma separated list of at most %d thread counts >= 1\n", SPMV_MAX_COUNTS);
+          usage();
+          return 1;
+        }
+        sweep = 1;
+        break;
+
       case 't':
         errno = 0;
         longarg = strtol(optarg, 0, 10);
@@ -106,6 +142,47 @@ int main (int argc, char **argv) {
         trials = longarg;
         break;
 
+      case 'o':
+        npy = optarg;
+        break;
+
+      case 'w':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 0) {
+          printf("option -w takes an integer number of warmup runs >= 0\n");
+          usage();
+          return 1;
+        }
+        timing.warmup = longarg;
+        break;
+
+      case 'f':
+        timing.flush = 1;
+        break;
+
+      case 'n':
+        errno = 0;
+        doublearg = strtod(optarg, 0);
+        if (errno != 0 || doublearg < 0.0) {
+          printf("option -n takes a relative error >= 0.0\n");
+          usage();
+          return 1;
+        }
+        timing.noise = doublearg;
+        break;
+
+      case 'M':
+        errno = 0;
+        longarg = strtol(optarg, 0, 10);
+        if (errno != 0 || longarg < 1) {
+          printf("option -M takes an integer number of trials >= 1\n");
+          usage();
+          return 1;
+        }
+        timing.max_trials = longarg;
+        break;
+
       case 'v':
         verbose = 1;
         break;
@@ -154,23 +231,98 @@ int main (int argc, char **argv) {
 
   auto csr = taco::read(argv[optind], taco::CSR, true);
 
-  printf("{\n");
-  printf("  \"results\": [\n");
+  struct spmv_session *session = spmv_session_create(csr.getDimension(0), csr.getDimension(1), csr.getStorage().getValues().getSize(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(0).getData(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(1).getData(), (double*)csr.getStorage().getValues().getData(), 1, kernel, verbose);
+  if (session == NULL) {
+    return 1;
+  }
+
+  /* time_mean[u][b_r - 1][b_c - 1] is the mean time using threads[u] threads */
+  double *time_mean = (double*)malloc(sizeof(double) * nthreads * B * B);
+  double *time_convert = (double*)malloc(sizeof(double) * B * B);
+  double *time_assemble = (double*)malloc(sizeof(double) * B * B);
   for (int b_r = 1; b_r <= B; b_r++) {
-    printf("      [\n");
     for (int b_c = 1; b_c <= B; b_c++) {
-      double time_total;
-      double time_mean;
-      int ret = test(csr.getDimension(0), csr.getDimension(1), csr.getStorage().getValues().getSize(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(0).getData(), (int*)csr.getStorage().getIndex().getModeIndex(1).getIndexArray(1).getData(), (double*)csr.getStorage().getValues().getData(), b_r, b_c, trials, verbose, &time_total, &time_mean);
+      struct timing_stats block_stats[SPMV_MAX_COUNTS];
+      int ret = spmv_session_test(session, b_r, b_c, nthreads, threads, trials, &timing, &time_convert[(b_r - 1) * B + b_c - 1], &time_assemble[(b_r - 1) * B + b_c - 1], block_stats);
       if (ret) {
         return ret;
       }
-      printf("%.*e%s", DECIMAL_DIG, time_mean, b_c <= B - 1 ? ", " : "");
+      for (int u = 0; u < nthreads; u++) {
+        time_mean[(u * B + b_r - 1) * B + b_c - 1] = block_stats[u].mean;
+        timing_free(&block_stats[u]);
+      }
+    }
+  }
+  spmv_session_free(session);
+
+  taco::JITCacheStats cache = taco::getJITCacheStats();
+  printf("{\n");
+  printf("  \"jit_cache_hits\": %ld,\n", cache.hits);
+  printf("  \"jit_cache_misses\": %ld,\n", cache.misses);
+  int ret = 0;
+  if (sweep) {
+    printf("  \"threads\": [");
+    for (int u = 0; u < nthreads; u++) {
+      printf("%d%s", threads[u], u < nthreads - 1 ? ", " : "");
+    }
+    printf("],\n");
+    if (npy) {
+      long shape[3] = {nthreads, B, B};
+      ret |= npy_print(npy, "thread_results", 3, shape, time_mean, "  ", 1);
+    } else {
+      printf("  \"thread_results\": [\n");
+      for (int u = 0; u < nthreads; u++) {
+        printf("    [\n");
+        for (int b_r = 1; b_r <= B; b_r++) {
+          printf("      [\n");
+          for (int b_c = 1; b_c <= B; b_c++) {
+            printf("%.*e%s", DECIMAL_DIG, time_mean[(u * B + b_r - 1) * B + b_c - 1], b_c <= B - 1 ? ", " : "");
+          }
+          printf("      ]%s\n", b_r <= B - 1 ? "," : "");
+        }
+        printf("    ]%s\n", u < nthreads - 1 ? "," : "");
+      }
+      printf("  ],\n");
+    }
+  }
+  if (npy) {
+    long shape[2] = {B, B};
+    ret |= npy_print(npy, "convert_times", 2, shape, time_convert, "  ", 1);
+    ret |= npy_print(npy, "assemble_times", 2, shape, time_assemble, "  ", 1);
+    ret |= npy_print(npy, "results", 2, shape, time_mean, "  ", 0);
+  } else {
+    printf("  \"convert_times\": [\n");
+    for (int b_r = 1; b_r <= B; b_r++) {
+      printf("      [\n");
+      for (int b_c = 1; b_c <= B; b_c++) {
+        printf("%.*e%s", DECIMAL_DIG, time_convert[(b_r - 1) * B + b_c - 1], b_c <= B - 1 ? ", " : "");
+      }
+      printf("      ]%s\n", b_r <= B - 1 ? "," : "");
+    }
+    printf("  ],\n");
+    printf("  \"assemble_times\": [\n");
+    for (int b_r = 1; b_r <= B; b_r++) {
+      printf("      [\n");
+      for (int b_c = 1; b_c <= B; b_c++) {
+        printf("%.*e%s", DECIMAL_DIG, time_assemble[(b_r - 1) * B + b_c - 1], b_c <= B - 1 ? ", " : "");
+      }
+      printf("      ]%s\n", b_r <= B - 1 ? "," : "");
+    }
+    printf("  ],\n");
+    printf("  \"results\": [\n");
+    for (int b_r = 1; b_r <= B; b_r++) {
+      printf("      [\n");
+      for (int b_c = 1; b_c <= B; b_c++) {
+        printf("%.*e%s", DECIMAL_DIG, time_mean[(b_r - 1) * B + b_c - 1], b_c <= B - 1 ? ", " : "");
+      }
+      printf("      ]%s\n", b_r <= B - 1 ? "," : "");
     }
-    printf("      ]%s\n", b_r <= B - 1 ? "," : "");
+    printf("  ]%s\n", 0 ? "," : "");
   }
-  printf("  ]%s\n", 0 ? "," : "");
   printf("}\n");
 
-  return 0;
+  free(time_mean);
+  free(time_convert);
+  free(time_assemble);
+  return ret;
 }
@@ -0,0 +1,299 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include "estimators.h"
+
+/**
+ *  The fewest windows that sell examines, the number that a Hoeffding bound
+ *  asks for to estimate a mean to within epsilon with probability at least
+ *  (1 - delta).
+ */
+static double sell_windows (double epsilon, double delta) {
+  return ceil(log(2.0 / delta) / (2.0 * epsilon * epsilon));
+}
+
+/* Add the stored entries and nonzeros of the window of rows i_lo to i_hi - 1
+ * to P and S, sorting the row lengths in lengths if sort is nonzero.
+ */
+static void sell_window (const int *ptr, int i_lo, int i_hi, int C, int sort, int *lengths, long *P, long *S) {
+  for (int i = i_lo; i < i_hi; i++) {
+    lengths[i - i_lo] = ptr[i + 1] - ptr[i];
+  }
+  if (sort) {
+    std::sort(lengths, lengths + (i_hi - i_lo), std::greater<int>());
+  }
+
+  /* Each chunk stores C times its longest row */
+  for (int q = 0; q < i_hi - i_lo; q += C) {
+    int longest = *std::max_element(lengths + q, lengths + std::min(q + C, i_hi - i_lo));
+    *P += (long)C * longest;
+  }
+  *S += ptr[i_hi] - ptr[i_lo];
+}
+
+/**
+ *  Given an m by n CSR matrix A, estimates the padding ratio if the matrix
+ *  were converted into SELL-C-sigma format. SELL-C-sigma sorts the rows of
+ *  each window of sigma consecutive rows by decreasing length, then stores
+ *  each chunk of C consecutive rows of the window as a dense C by (length of
+ *  its longest row) column-major array. The padding ratio is the number of
+ *  stored entries divided by the number of nonzeros.
+ *
+ *  Each window is completely examined with probability sigma (the sampling
+ *  rate given to the estimators, not the window of SELL-C-sigma), raised so
+ *  that at least log(2 / delta) / (2 epsilon^2) windows are expected to be
+ *  examined. When that would examine every window, or when the examined
+ *  windows hold no nonzeros, all windows are examined and the ratio is
+ *  exact.
+ *
+ *  The caller supplies this routine with a maximum chunk size B, and this
+ *  routine returns the estimated padding ratios for all chunk sizes
+ *  1 <= C <= B and windows of k * C rows for 1 <= k <= B, so that the grid
+ *  of (C, sigma) is tied to the B by B grid of the blocked estimators.
+ *  Because sorting the rows of a single chunk does not change its longest
+ *  row, k = 1 gives the padding of unsorted SELL-C. ELLPACK, which pads every
+ *  row to the longest one, is estimated by ell instead.
+ *
+ *  This routine assumes the CSR matrix uses full storage.
+ *
+ *  \param[in] m Logical number of matrix rows
+ *  \param[in] n Logical number of matrix columns
+ *  \param[in] nnz Logical number of matrix nonzeros
+ *  \param[in] *ptr CSR row pointers.
+ *  \param[in] *ind CSR column indices.
+ *  \param[in] B Maximum desired chunk size and window multiple
+ *  \param[in] epsilon Epsilon
+ *  \param[in] delta Delta
+ *  \param[in] sigma Sigma
+ *  \param[out] *fill Padding ratios for all specified C, k in order
+ *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
+ *
+ *  Note that the padding ratios are stored in the same order as the fill
+ *  ratios of the blocked estimators, with C in place of b_r and k in place
+ *  of b_c:
+ *  int fill_index = 0;
+ *  for (int C = 1; C <= B; C++) {
+ *    for (int k = 1; k <= B; k++) {
+ *      fill[fill_index] = padding for C, k * C
+ *      fill_index++;
+ *    }
+ *  }
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_sell (int m,
+                        int n,
+                        int nnz,
+                        const int *ptr,
+                        const int *ind,
+                        int B,
+                        double epsilon,
+                        double delta,
+                        double sigma,
+                        double *fill,
+                        long seed,
+                        int trial,
+                        int verbose,
+                        struct fill_workspace *workspace){
+  assert(n >= 1);
+  assert(m >= 1);
+
+  /* lengths holds the row lengths of the current window, which has at most
+   * B * B rows.
+   */
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, (long)B * B, 0)) {
+    return 1;
+  }
+  int *lengths = workspace->samples;
+
+  /* Seed the random generator */
+  std::seed_seq seeder{seed, (long)trial};
+  std::mt19937 generator(seeder);
+  std::uniform_real_distribution<double> range(0.0, 1.0);
+
+  /* see above note about fill order */
+  int fill_index = 0;
+
+  for (int C = 1; C <= B; C++) {
+    for (int k = 1; k <= B; k++) {
+      int window = C * k;
+      long windows = (m + (long)window - 1) / window;
+      double p = std::max(sigma, sell_windows(epsilon, delta) / windows);
+      int exact = p >= 1.0;
+
+      /* stores the number of stored entries and nonzeros in the examined
+       * windows
+       */
+      long P = 0;
+      long S = 0;
+
+      /* examine each window with probability p */
+      for (long W = 0; W < windows; W++) {
+        if (exact || range(generator) < p) {
+          sell_window(ptr, W * window, std::min(W * window + window, (long)m), C, k > 1, lengths, &P, &S);
+        }
+      }
+
+      /* Windows without nonzeros say nothing about the padding of the
+       * others, so if no others were examined, examine them all.
+       */
+      if (S == 0 && !exact) {
+        if (verbose) {
+          fprintf(stderr, "sell examined no nonzeros for C = %d and k = %d, so it examines every window\n", C, k);
+        }
+        for (long W = 0; W < windows; W++) {
+          sell_window(ptr, W * window, std::min(W * window + window, (long)m), C, k > 1, lengths, &P, &S);
+        }
+      }
+
+      /*
+       * Compute the padding from the number of stored entries and nonzeros
+       * that have been seen in the sample. Only a matrix without nonzeros
+       * leaves S at 0, and it stores nothing.
+       */
+      fill[fill_index] = S ? (double)P / S : 1.0;
+      fill_index++;
+    }
+  }
+
+  fill_workspace_free(&local);
+  return 0;
+}
+
+int reserve_fill_sell (struct fill_workspace *workspace,
+                       int m,
+                       int n,
+                       int nnz,
+                       int B,
+                       double epsilon,
+                       double delta){
+  return fill_workspace_reserve(workspace, (long)B * B, 0);
+}
+
+/**
+ *  Given an m by n CSR matrix A, computes the padding ratio if the matrix
+ *  were converted into ELLPACK format with b_r by b_c blocks, which stores
+ *  every block row as many blocks as the block row with the most blocks.
+ *  The padding ratio is b_r times b_c times the number of block rows times
+ *  their most blocks divided by the number of nonzeros, which is
+ *  m * (longest row) / nnz for 1 by 1 blocks. Like reference, ell marks the
+ *  column blocks of each block row in an array of n entries for each block
+ *  width, so the ratio is exact.
+ *
+ *  The caller supplies this routine with a maximum row and column block size B,
+ *  and this routine returns the padding ratios for all 1 <= b_r, b_c <= B, in
+ *  the order of the fill ratios of reference.
+ *
+ *  This routine assumes the CSR matrix uses full storage.
+ *
+ *  \param[in] m Logical number of matrix rows
+ *  \param[in] n Logical number of matrix columns
+ *  \param[in] nnz Logical number of matrix nonzeros
+ *  \param[in] *ptr CSR row pointers.
+ *  \param[in] *ind CSR column indices.
+ *  \param[in] B Maximum desired block size
+ *  \param[in] epsilon Epsilon
+ *  \param[in] delta Delta
+ *  \param[in] sigma Sigma
+ *  \param[out] *fill Padding ratios for all specified b_r, b_c in order
+ *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_ell (int m,
+                       int n,
+                       int nnz,
+                       const int *ptr,
+                       const int *ind,
+                       int B,
+                       double epsilon,
+                       double delta,
+                       double sigma,
+                       double *fill,
+                       long seed,
+                       int trial,
+                       int verbose,
+                       struct fill_workspace *workspace){
+  assert(n >= 1);
+  assert(m >= 1);
+
+  /* blocks + (b_c - 1) * n marks the column blocks of the current block row
+   * when the block width is b_c, and is zeroed again after each block row.
+   */
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve(workspace, 0, (long)B * n)) {
+    return 1;
+  }
+  int *blocks = workspace->blocks;
+
+  /* count[b_c - 1] counts the blocks of the current block row and
+   * longest[b_c - 1] is the most blocks of any block row so far.
+   */
+  long count[B];
+  long longest[B];
+
+  int fill_index = 0;
+  for (int b_r = 1; b_r <= B; b_r++) {
+    for (int b_c = 1; b_c <= B; b_c++) {
+      longest[b_c - 1] = 0;
+    }
+    for (int I = 0; I * b_r < m; I++) {
+      int t_lo = ptr[I * b_r];
+      int t_hi = ptr[std::min((I + 1) * b_r, m)];
+      for (int b_c = 1; b_c <= B; b_c++) {
+        count[b_c - 1] = 0;
+      }
+      for (int t = t_lo; t < t_hi; t++) {
+        int j = ind[t];
+        for (int b_c = 1; b_c <= B; b_c++) {
+          int *seen = blocks + (b_c - 1) * n + j / b_c;
+          if (*seen == 0) {
+            *seen = 1;
+            count[b_c - 1]++;
+          }
+        }
+      }
+      for (int t = t_lo; t < t_hi; t++) {
+        int j = ind[t];
+        for (int b_c = 1; b_c <= B; b_c++) {
+          blocks[(b_c - 1) * n + j / b_c] = 0;
+        }
+      }
+      for (int b_c = 1; b_c <= B; b_c++) {
+        longest[b_c - 1] = std::max(longest[b_c - 1], count[b_c - 1]);
+      }
+    }
+    long rows = (m + b_r - 1) / b_r;
+    for (int b_c = 1; b_c <= B; b_c++) {
+      fill[fill_index] = (double)b_r * (double)b_c * (double)rows * (double)longest[b_c - 1] / (double)nnz;
+      fill_index++;
+    }
+  }
+
+  fill_workspace_free(&local);
+  return 0;
+}
+
+int reserve_fill_ell (struct fill_workspace *workspace,
+                      int m,
+                      int n,
+                      int nnz,
+                      int B,
+                      double epsilon,
+                      double delta){
+  return fill_workspace_reserve(workspace, 0, (long)B * n);
+}
@@ -0,0 +1,590 @@
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "json.h"
+#include "mtx.h"
+#include "server.h"
+
+/* A loaded matrix. Requests hold references to entries, so an entry that is
+ * evicted while in use is only freed when its last request finishes.
+ */
+struct cached_matrix {
+  std::string path;
+  time_t mtime;
+  off_t size;
+  int loading;
+  int failed;
+  std::string error;
+  long bytes;
+  struct csr_matrix A;
+
+  cached_matrix () : mtime(0), size(0), loading(1), failed(0), bytes(0) {
+    A.ptr = NULL;
+    A.ind = NULL;
+    A.val = NULL;
+  }
+  ~cached_matrix () {
+    csr_free(&A);
+  }
+};
+
+/* Matrices by path, most recently used first */
+struct matrix_cache {
+  std::mutex lock;
+  std::condition_variable loaded;
+  std::list<std::shared_ptr<cached_matrix> > entries;
+  long bytes;
+  long budget;
+};
+
+/* Release least recently used matrices until the cache fits its budget,
+ * keeping keep and any matrix still loading. Call with the lock held.
+ */
+static void matrix_cache_evict (struct matrix_cache *cache, const std::shared_ptr<cached_matrix> &keep) {
+  auto it = cache->entries.end();
+  while (cache->bytes > cache->budget && it != cache->entries.begin()) {
+    --it;
+    if (*it != keep && !(*it)->loading) {
+      cache->bytes -= (*it)->bytes;
+      it = cache->entries.erase(it);
+    }
+  }
+}
+
+/**
+ *  Find the matrix at path in the cache, reading it if it is missing or the
+ *  file has changed. Concurrent requests for the same matrix wait for one
+ *  read.
+ *
+ *  \returns On success, returns the matrix. On error, stores a message in
+ *  error and returns NULL.
+ */
+static std::shared_ptr<cached_matrix> matrix_cache_get (struct matrix_cache *cache, const std::string &path, int *cached, std::string *error) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+    *error = "matrix must be filename of MatrixMarket matrix";
+    return NULL;
+  }
+
+  std::unique_lock<std::mutex> hold(cache->lock);
+  for (auto it = cache->entries.begin(); it != cache->entries.end(); ++it) {
+    std::shared_ptr<cached_matrix> entry = *it;
+    if (entry->path != path) {
+      continue;
+    }
+    if (!entry->loading && (entry->mtime != st.st_mtime || entry->size != st.st_size)) {
+      cache->bytes -= entry->bytes;
+      cache->entries.erase(it);
+      break;
+    }
+    cache->entries.splice(cache->entries.begin(), cache->entries, it);
+    cache->loaded.wait(hold, [&entry]{return !entry->loading;});
+    if (entry->failed) {
+      *error = entry->error;
+      return NULL;
+    }
+    *cached = 1;
+    return entry;
+  }
+
+  std::shared_ptr<cached_matrix> entry = std::make_shared<cached_matrix>();
+  entry->path = path;
+  entry->mtime = st.st_mtime;
+  entry->size = st.st_size;
+  cache->entries.push_front(entry);
+  hold.unlock();
+
+  /* The values are not needed to estimate fill */
+  char message[MTX_ERROR_SIZE];
+  int ret = mtx_read(path.c_str(), 0, &entry->A, message);
+
+  hold.lock();
+  entry->loading = 0;
+  if (ret) {
+    entry->failed = 1;
+    entry->error = message;
+    cache->entries.remove(entry);
+    cache->loaded.notify_all();
+    *error = entry->error;
+    return NULL;
+  }
+  entry->bytes = csr_bytes(&entry->A);
+  cache->bytes += entry->bytes;
+  matrix_cache_evict(cache, entry);
+  cache->loaded.notify_all();
+  *cached = 0;
+  return entry;
+}
+
+/* Where the responses to the requests of one client go */
+struct connection {
+  int fd;
+  int owned;
+  std::mutex lock;
+
+  connection (int fd, int owned) : fd(fd), owned(owned) {}
+  ~connection () {
+    if (owned) {
+      close(fd);
+    }
+  }
+};
+
+/* Send one response line, whole, to the client. A client that went away
+ * just misses its responses.
+ */
+static void connection_send (struct connection *client, const std::string &response) {
+  std::lock_guard<std::mutex> hold(client->lock);
+  const char *p = response.data();
+  size_t left = response.size();
+  while (left > 0) {
+    ssize_t sent = write(client->fd, p, left);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return;
+    }
+    p += sent;
+    left -= sent;
+  }
+}
+
+/* Requests waiting for a worker, and the workers that run them */
+struct work_queue {
+  std::mutex lock;
+  std::condition_variable ready;
+  std::deque<std::function<void(struct fill_workspace*)> > jobs;
+  int closed;
+  std::vector<std::thread> workers;
+};
+
+/* Each worker reuses one workspace for all of its requests */
+static void work_queue_worker (struct work_queue *queue) {
+  struct fill_workspace workspace = FILL_WORKSPACE_INIT;
+  while (1) {
+    std::function<void(struct fill_workspace*)> job;
+    {
+      std::unique_lock<std::mutex> hold(queue->lock);
+      queue->ready.wait(hold, [queue]{return queue->closed || !queue->jobs.empty();});
+      if (queue->jobs.empty()) {
+        break;
+      }
+      job = std::move(queue->jobs.front());
+      queue->jobs.pop_front();
+    }
+    job(&workspace);
+  }
+  fill_workspace_free(&workspace);
+}
+
+static void work_queue_push (struct work_queue *queue, std::function<void(struct fill_workspace*)> job) {
+  {
+    std::lock_guard<std::mutex> hold(queue->lock);
+    queue->jobs.push_back(std::move(job));
+  }
+  queue->ready.notify_one();
+}
+
+/* Run the remaining jobs, then stop the workers */
+static void work_queue_close (struct work_queue *queue) {
+  {
+    std::lock_guard<std::mutex> hold(queue->lock);
+    queue->closed = 1;
+  }
+  queue->ready.notify_all();
+  for (size_t w = 0; w < queue->workers.size(); w++) {
+    queue->workers[w].join();
+  }
+}
+
+struct server {
+  const struct fill_request *defaults;
+  struct matrix_cache cache;
+  struct work_queue queue;
+};
+
+static int parse_long (const std::string &text, long lo, long hi, long *value) {
+  char *end;
+  errno = 0;
+  long v = strtol(text.c_str(), &end, 10);
+  if (errno != 0 || end == text.c_str() || *end || v < lo || v > hi) {
+    return 1;
+  }
+  *value = v;
+  return 0;
+}
+
+static int parse_double (const std::string &text, double lo, double hi, double *value) {
+  char *end;
+  errno = 0;
+  double v = strtod(text.c_str(), &end);
+  if (errno != 0 || end == text.c_str() || *end || !(v >= lo && v <= hi)) {
+    return 1;
+  }
+  *value = v;
+  return 0;
+}
+
+static int parse_bool (const std::string &text, int *value) {
+  if (text == "true" || text == "1") {
+    *value = 1;
+  } else if (text == "false" || text == "0") {
+    *value = 0;
+  } else {
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ *  Parse a request line, starting from the server defaults. The id is stored
+ *  as JSON text, ready to be echoed.
+ *
+ *  \returns On success, returns 0. On error, stores a message in error and
+ *  returns an error code.
+ */
+static int parse_request (const char *line, struct fill_request *request, std::string *id, std::string *matrix, std::string *error) {
+  struct json_reader json = {line};
+  json_space(&json);
+  if (*json.p != '{') {
+    *error = "request must be a JSON object";
+    return 1;
+  }
+  json.p++;
+  int members = 0;
+  std::string key;
+  int next;
+  while ((next = json_object_next(&json, &members, &key)) == 1) {
+    std::string text;
+    int quoted;
+    if (json_scalar(&json, &text, &quoted)) {
+      *error = "bad value for \"" + key + "\"";
+      return 1;
+    }
+
+    long longarg;
+    double doublearg;
+    int bad = 0;
+    if (key == "id") {
+      id->clear();
+      if (quoted) {
+        json_append_string(id, text);
+      } else {
+        *id = text;
+      }
+    } else if (key == "matrix") {
+      *matrix = text;
+      bad = !quoted;
+    } else if (key == "algo") {
+      request->nselected = estimator_parse(text.c_str(), request->selected);
+      bad = !quoted || request->nselected == 0;
+    } else if (key == "B") {
+      bad = parse_long(text, 1, FILL_REQUEST_MAX_B, &longarg);
+      if (!bad) {
+        request->B = longarg;
+      }
+    } else if (key == "epsilon") {
+      bad = parse_double(text, 0.0, DBL_MAX, &request->epsilon);
+    } else if (key == "delta") {
+      bad = parse_double(text, 0.0, 1.0, &request->delta);
+    } else if (key == "sigma") {
+      bad = parse_double(text, 0.0, 1.0, &request->sigma);
+    } else if (key == "trials") {
+      bad = parse_long(text, 1, TIMING_MAX_TRIALS, &longarg);
+      if (!bad) {
+        request->trials = longarg;
+      }
+    } else if (key == "seed") {
+      bad = parse_long(text, 0, LONG_MAX, &request->seed);
+    } else if (key == "clock") {
+      bad = parse_bool(text, &request->clock);
+    } else if (key == "results") {
+      bad = parse_bool(text, &request->results);
+    } else if (key == "warmup") {
+      bad = parse_long(text, 0, TIMING_MAX_TRIALS, &longarg);
+      if (!bad) {
+        request->timing.warmup = longarg;
+      }
+    } else if (key == "flush") {
+      bad = parse_bool(text, &request->timing.flush);
+    } else if (key == "noise") {
+      bad = parse_double(text, 0.0, DBL_MAX, &doublearg);
+      if (!bad) {
+        request->timing.noise = doublearg;
+      }
+    } else if (key == "max_trials") {
+      bad = parse_long(text, 1, TIMING_MAX_TRIALS, &longarg);
+      if (!bad) {
+        request->timing.max_trials = longarg;
+      }
+    } else {
+      *error = "unknown request key \"" + key + "\"";
+      return 1;
+    }
+    if (bad) {
+      *error = "bad value for \"" + key + "\"";
+      return 1;
+    }
+  }
+  if (next < 0) {
+    *error = "request must be a JSON object";
+    return 1;
+  }
+  if (matrix->empty()) {
+    *error = "request must name a \"matrix\"";
+    return 1;
+  }
+  return 0;
+}
+
+/* Arguments of one estimate_fill trial */
+struct request_trial {
+  const struct estimator *estimator;
+  const struct csr_matrix *A;
+  const struct fill_request *request;
+  double *fill;
+  double *extra;
+  int *offsets;
+  int *extra_offsets;
+  struct fill_workspace *workspace;
+};
+
+static void request_trial (void *arg, int t) {
+  struct request_trial *a = (struct request_trial*)arg;
+  const struct fill_request *r = a->request;
+  double *fill = t < r->trials ? a->fill + (long)t * r->B * r->B : a->extra;
+  if (a->offsets != NULL) {
+    a->workspace->best_offsets = t < r->trials ? a->offsets + 2L * t * r->B * r->B : a->extra_offsets;
+  }
+  a->estimator->estimate_fill(a->A->m, a->A->n, a->A->nnz, a->A->ptr, a->A->ind, r->B, r->epsilon, r->delta, r->sigma, fill, r->seed, t, r->verbose, a->workspace);
+}
+
+/* Run one estimator on A and append its output to response */
+static int request_estimator (const struct estimator *estimator, const struct csr_matrix *A, const struct fill_request *request, struct fill_workspace *workspace, std::string *response, std::string *error) {
+  int B = request->B;
+  if (estimator->reserve_fill(workspace, A->m, A->n, A->nnz, B, request->epsilon, request->delta)) {
+    *error = std::string("estimator ") + estimator->name + " could not allocate its workspace";
+    return 1;
+  }
+  /* Estimators of offset blocks also report the offsets of their estimates */
+  bool offset_blocks = strcmp(estimator->format, "ubcsr") == 0;
+  std::vector<double> fill;
+  std::vector<double> extra;
+  std::vector<int> offsets;
+  std::vector<int> extra_offsets;
+  try {
+    fill.assign((long)B * B * request->trials, 0.0);
+    extra.assign((long)B * B, 0.0);
+    if (offset_blocks) {
+      offsets.assign(2L * B * B * request->trials, 0);
+      extra_offsets.assign(2L * B * B, 0);
+    }
+  } catch (const std::bad_alloc &) {
+    *error = std::string("estimator ") + estimator->name + " could not allocate its results";
+    return 1;
+  }
+  struct request_trial arg = {estimator, A, request, fill.data(), extra.data(), offset_blocks ? offsets.data() : NULL, extra_offsets.data(), workspace};
+  struct timing_stats stats;
+  int ret = timing_run(&request->timing, request->trials, request_trial, &arg, &stats);
+
+  /* The workspace outlives the offsets */
+  workspace->best_offsets = NULL;
+  if (ret) {
+    *error = std::string("estimator ") + estimator->name + " failed";
+    return 1;
+  }
+
+  json_appendf(response, "\"%s\": {\"format\": \"%s\"", estimator->name, estimator->format);
+  if (request->results) {
+    response->append(", \"results\": [");
+    for (int t = 0; t < request->trials; t++) {
+      response->append(t ? ", [" : "[");
+      for (int b_r = 0; b_r < B; b_r++) {
+        response->append(b_r ? ", [" : "[");
+        for (int b_c = 0; b_c < B; b_c++) {
+          json_appendf(response, "%s%.*e", b_c ? ", " : "", DECIMAL_DIG, fill[((long)t * B + b_r) * B + b_c]);
+        }
+        response->append("]");
+      }
+      response->append("]");
+    }
+    response->append("]");
+  }
+  if (request->results && offset_blocks) {
+    response->append(", \"offsets\": [");
+    for (int t = 0; t < request->trials; t++) {
+      response->append(t ? ", [" : "[");
+      for (int b_r = 0; b_r < B; b_r++) {
+        response->append(b_r ? ", [" : "[");
+        for (int b_c = 0; b_c < B; b_c++) {
+          long k = ((long)t * B + b_r) * B + b_c;
+          json_appendf(response, "%s[%d, %d]", b_c ? ", " : "", offsets[2 * k], offsets[2 * k + 1]);
+        }
+        response->append("]");
+      }
+      response->append("]");
+    }
+    response->append("]");
+  }
+  if (request->clock) {
+    response->append(", ");
+    timing_append(response, &stats, "", ", ");
+    response->append("\"times\": [");
+    for (int t = 0; t < stats.trials; t++) {
+      json_appendf(response, "%s%.*e", t ? ", " : "", DECIMAL_DIG, stats.times[t]);
+    }
+    response->append("]");
+  }
+  response->append("}");
+  timing_free(&stats);
+  return 0;
+}
+
+int fill_request_run (const struct fill_request *request, const struct csr_matrix *A, struct fill_workspace *workspace, std::string *out, std::string *error) {
+  for (int h = 0; h < request->nselected; h++) {
+    out->append(", ");
+    if (request_estimator(request->selected[h], A, request, workspace, out, error)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void serve_request (struct server *server, const std::shared_ptr<connection> &client, const std::string &line, struct fill_workspace *workspace) {
+  struct fill_request request = *server->defaults;
+  std::string id = "null";
+  std::string matrix;
+  std::string error;
+  std::string response;
+
+  if (parse_request(line.c_str(), &request, &id, &matrix, &error) == 0) {
+    int cached = 0;
+    /* A request too large for memory fails on its own, not the server */
+    try {
+      std::shared_ptr<cached_matrix> entry = matrix_cache_get(&server->cache, matrix, &cached, &error);
+      if (entry) {
+        response = "{\"id\": " + id + ", \"matrix\": ";
+        json_append_string(&response, matrix);
+        json_appendf(&response, ", \"cached\": %s", cached ? "true" : "false");
+        fill_request_run(&request, &entry->A, workspace, &response, &error);
+        response.append("}\n");
+      }
+    } catch (const std::bad_alloc &) {
+      error = "out of memory";
+    }
+  }
+
+  if (!error.empty()) {
+    response = "{\"id\": " + id + ", \"error\": ";
+    json_append_string(&response, error);
+    response.append("}\n");
+  }
+  connection_send(client.get(), response);
+}
+
+/* Queue every request line read from in, answering on client */
+static void serve_connection (struct server *server, FILE *in, std::shared_ptr<connection> client) {
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t length;
+  while ((length = getline(&line, &line_size, in)) >= 0) {
+    std::string request(line, length);
+    if (request.find_first_not_of(" \t\r\n") == std::string::npos) {
+      continue;
+    }
+    work_queue_push(&server->queue, [server, client, request](struct fill_workspace *workspace) {
+      serve_request(server, client, request, workspace);
+    });
+  }
+  free(line);
+  fclose(in);
+}
+
+static int serve_socket (struct server *server, const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "socket path %s is too long\n", path);
+    return 1;
+  }
+  strcpy(address.sun_path, path);
+
+  /* Replace a socket left behind by an earlier server */
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+    fprintf(stderr, "could not listen on %s: %s\n", path, strerror(errno));
+    if (listener >= 0) {
+      close(listener);
+    }
+    return 1;
+  }
+
+  while (1) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      fprintf(stderr, "could not accept on %s: %s\n", path, strerror(errno));
+      close(listener);
+      return 1;
+    }
+    FILE *in = fdopen(dup(fd), "r");
+    if (in == NULL) {
+      close(fd);
+      continue;
+    }
+    std::shared_ptr<connection> client = std::make_shared<connection>(fd, 1);
+    std::thread(serve_connection, server, in, client).detach();
+  }
+}
+
+int serve (const struct server_options *options, const struct fill_request *defaults) {
+  /* Clients that disconnect early must not take the server down */
+  signal(SIGPIPE, SIG_IGN);
+
+  struct server *server = new struct server;
+  server->defaults = defaults;
+  server->cache.bytes = 0;
+  server->cache.budget = options->cache_bytes;
+  server->queue.closed = 0;
+  for (int w = 0; w < options->jobs; w++) {
+    server->queue.workers.push_back(std::thread(work_queue_worker, &server->queue));
+  }
+
+  int ret = 0;
+  if (options->socket) {
+    ret = serve_socket(server, options->socket);
+  } else {
+    serve_connection(server, stdin, std::make_shared<connection>(STDOUT_FILENO, 0));
+  }
+
+  work_queue_close(&server->queue);
+  delete server;
+  return ret;
+}
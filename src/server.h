@@ -0,0 +1,79 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include "estimators.h"
+#include "mtx.h"
+#include "timing.h"
+
+/* Largest B a request may ask for. trials, warmup and max_trials may be at
+ * most TIMING_MAX_TRIALS, so that no request can exhaust the memory of the
+ * server with its results.
+ */
+#define FILL_REQUEST_MAX_B 64
+
+/**
+ *  The settings of a fill estimation request, which are described in
+ *  run_fill.cc. The command line sets the defaults of the server, and each
+ *  request may override them.
+ */
+struct fill_request {
+  const struct estimator *selected[ESTIMATORS_MAX];
+  int nselected;
+  int B;
+  double epsilon;
+  double delta;
+  double sigma;
+  int trials;
+  long seed;
+  int clock;
+  int results;
+  int verbose;
+  struct timing_options timing;
+};
+
+/**
+ *  Run the estimators of request on A, appending ", " and then the output of
+ *  each estimator under its name to out, as members of a one line JSON
+ *  object. Each estimator takes its scratch memory from workspace.
+ *
+ *  \returns On success, returns 0. On error, stores a message in error and
+ *  returns an error code.
+ */
+int fill_request_run (const struct fill_request *request,
+                      const struct csr_matrix *A,
+                      struct fill_workspace *workspace,
+                      std::string *out,
+                      std::string *error);
+
+/**
+ *  How to run the server. Requests are read from the Unix socket at socket,
+ *  or from stdin if it is NULL, and run on jobs worker threads. Matrices stay
+ *  loaded until the matrices held exceed cache_bytes bytes, when the least
+ *  recently used ones are released.
+ */
+struct server_options {
+  const char *socket;
+  int jobs;
+  long cache_bytes;
+};
+
+/**
+ *  Serve JSON-lines fill estimation requests until stdin is closed, or
+ *  forever when listening on a socket. Each request is a JSON object on one
+ *  line, such as
+ *
+ *    {"id": 7, "matrix": "a.mtx", "algo": "phil,oski", "B": 8, "epsilon": 0.5}
+ *
+ *  with the optional keys id, algo, B, epsilon, delta, sigma, trials, seed,
+ *  clock, results, warmup, flush, noise and max_trials (B is at most
+ *  FILL_REQUEST_MAX_B). Each response is a
+ *  JSON object on one line holding the id of its request and the output of
+ *  each estimator under its name, or an "error" message. Responses are sent
+ *  as requests finish, so they may arrive out of order when jobs > 1.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int serve (const struct server_options *options, const struct fill_request *defaults);
+
+#endif
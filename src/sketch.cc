@@ -0,0 +1,197 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+
+#include "estimators.h"
+
+/* Hash a block (I, J) to a uniform double in [0, 1) (splitmix64) */
+static inline double sketch_hash (uint64_t salt, int I, int J) {
+  uint64_t z = salt + (((uint64_t)(uint32_t)I << 32) | (uint32_t)J) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z = z ^ (z >> 31);
+  return (z >> 11) / 9007199254740992.0;
+}
+
+/**
+ *  Number of registers that sketch keeps for each block width.
+ */
+static int sketch_registers (int n, double epsilon) {
+  double k = 2.0 + ceil(1.0 / (epsilon * epsilon));
+  return (int)std::min(k, (double)std::max(n, 2));
+}
+
+/**
+ *  Given an m by n CSR matrix A, estimates the fill ratio if the matrix were
+ *  converted into b_r by b_c BCSR format. The fill ratio is b_r times b_c times
+ *  the number of nonzero blocks in the BCSR format divided by the number of
+ *  nonzeros.
+ *
+ *  Like reference, sketch reads each block row once in order, but instead of
+ *  marking the column blocks it has seen in an array of n entries, it counts
+ *  the distinct column blocks of the block row with a K-minimum-values sketch
+ *  of k = 2 + 1 / epsilon^2 registers for each block width, which keeps the
+ *  k smallest hashes of the blocks. A block row with fewer than k blocks is
+ *  counted exactly, and one with more is estimated as (k - 1) divided by the
+ *  k-th smallest hash, with a relative standard error of about epsilon. The
+ *  memory used is B times k doubles, independent of the size of the matrix,
+ *  and the matrix is only read sequentially.
+ *
+ *  The caller supplies this routine with a maximum row and column block size B,
+ *  and this routine returns the estimated fill ratios for all
+ *  1 <= b_r, b_c <= B.
+ *
+ *  This routine assumes the CSR matrix uses full storage, and assumes that
+ *  column indicies are sorted.
+ *
+ *  \param[in] m Logical number of matrix rows
+ *  \param[in] n Logical number of matrix columns
+ *  \param[in] nnz Logical number of matrix nonzeros
+ *  \param[in] *ptr CSR row pointers.
+ *  \param[in] *ind CSR column indices.
+ *  \param[in] B Maximum desired block size
+ *  \param[in] epsilon Epsilon
+ *  \param[in] delta Delta
+ *  \param[in] sigma Sigma
+ *  \param[out] *fill Fill ratios for all specified b_r, b_c in order
+ *  \param[in] verbose 0 if you should be quiet
+ *  \param[in,out] *workspace Scratch memory, or NULL to allocate it here
+ *
+ *  Note that the fill ratios should be stored according to the following order:
+ *  int fill_index = 0;
+ *  for (int b_r = 1; b_r <= B; b_r++) {
+ *    for (int b_c = 1; b_c <= B; b_c++) {
+ *      fill[fill_index] = fill for b_r, b_c
+ *      fill_index++;
+ *    }
+ *  }
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_sketch (int m,
+                          int n,
+                          int nnz,
+                          const int *ptr,
+                          const int *ind,
+                          int B,
+                          double epsilon,
+                          double delta,
+                          double sigma,
+                          double *fill,
+                          long seed,
+                          int trial,
+                          int verbose,
+                          struct fill_workspace *workspace){
+  assert(n >= 1);
+  assert(m >= 1);
+
+  /* sketches + (b_c - 1) * k holds the sorted smallest hashes of the column
+   * blocks in the current block row when the block width is b_c, and
+   * counts[b_c - 1] says how many there are.
+   */
+  int k = sketch_registers(n, epsilon);
+  struct fill_workspace local = FILL_WORKSPACE_INIT;
+  if (workspace == NULL) {
+    workspace = &local;
+  }
+  if (fill_workspace_reserve_sums(workspace, (long)B * k)) {
+    return 1;
+  }
+  double *sketches = workspace->sums;
+  int counts[B];
+
+  /* last[b_c - 1] is the last column block inserted from the current row,
+   * which is skipped if it comes up again since the columns are sorted.
+   */
+  int last[B];
+
+  /* nnzb[b_c - 1] sums the blocks when the block width is b_c */
+  double nnzb[B];
+
+  /* Salt the hashes so that each trial sees a different sketch */
+  std::seed_seq seeder{seed, (long)trial};
+  std::mt19937_64 generator(seeder);
+  uint64_t salt = generator();
+
+  int fill_index = 0;
+  for (int b_r = 1; b_r <= B; b_r++) {
+    for (int b_c = 1; b_c <= B; b_c++) {
+      nnzb[b_c - 1] = 0.0;
+    }
+    for (int I = 0; I * b_r < m; I++) {
+      for (int b_c = 1; b_c <= B; b_c++) {
+        counts[b_c - 1] = 0;
+      }
+      int i_hi = std::min((I + 1) * b_r, m);
+      for (int i = I * b_r; i < i_hi; i++) {
+        for (int b_c = 1; b_c <= B; b_c++) {
+          last[b_c - 1] = -1;
+        }
+        for (int t = ptr[i]; t < ptr[i + 1]; t++) {
+          int j = ind[t];
+          for (int b_c = 1; b_c <= B; b_c++) {
+            int J = j / b_c;
+            if (J == last[b_c - 1]) {
+              continue;
+            }
+            last[b_c - 1] = J;
+            double h = sketch_hash(salt, I, J);
+            double *sketch = sketches + (long)(b_c - 1) * k;
+            int *count = counts + b_c - 1;
+            if (*count == k && h >= sketch[k - 1]) {
+              continue;
+            }
+            double *slot = std::lower_bound(sketch, sketch + *count, h);
+            if (slot < sketch + *count && *slot == h) {
+              continue;
+            }
+            if (*count < k) {
+              (*count)++;
+            }
+            std::copy_backward(slot, sketch + *count - 1, sketch + *count);
+            *slot = h;
+          }
+        }
+      }
+
+      /* A full sketch estimates the number of blocks from its k-th hash.
+       * The estimate is unbiased, and is not clamped to the blocks that the
+       * block row could hold, since that would bias the sum low when most
+       * block rows are near their limit.
+       */
+      for (int b_c = 1; b_c <= B; b_c++) {
+        int count = counts[b_c - 1];
+        if (count < k) {
+          nnzb[b_c - 1] += count;
+        } else {
+          nnzb[b_c - 1] += (k - 1) / sketches[(long)(b_c - 1) * k + k - 1];
+        }
+      }
+    }
+    for (int b_c = 1; b_c <= B; b_c++) {
+      fill[fill_index] = (double)b_r * (double)b_c * nnzb[b_c - 1] / (double)nnz;
+      fill_index++;
+    }
+  }
+
+  if (verbose) {
+    fprintf(stderr, "sketch used %d registers per block width\n", k);
+  }
+
+  fill_workspace_free(&local);
+  return 0;
+}
+
+int reserve_fill_sketch (struct fill_workspace *workspace,
+                         int m,
+                         int n,
+                         int nnz,
+                         int B,
+                         double epsilon,
+                         double delta){
+  return fill_workspace_reserve_sums(workspace, (long)B * sketch_registers(n, epsilon));
+}
@@ -0,0 +1,125 @@
+#ifndef SPMV_H
+#define SPMV_H
+
+#include "timing.h"
+
+/* Kernels that test() can benchmark */
+#define SPMV_KERNEL_TACO   0
+#define SPMV_KERNEL_NATIVE 1
+
+/* Longest list of thread or vector counts accepted on the command line */
+#define SPMV_MAX_COUNTS 64
+
+/**
+ *  Time trials multiplications of the m by n CSR matrix (ptr, ind, data) by a
+ *  row-major dense matrix of ones with the given number of vectors (columns)
+ *  after converting it to r by c blocks, as described by timing. The
+ *  multiplication is timed once for each of the nthreads thread counts in
+ *  threads, storing the results in the corresponding entries of stats, which
+ *  should be released with timing_free. Thread counts above 1 require the
+ *  native kernel.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int test (int m,
+          int n,
+          int nnz,
+          const int *ptr,
+          const int *ind,
+          const double *data,
+          int r,
+          int c,
+          int vectors,
+          int kernel,
+          int nthreads,
+          const int *threads,
+          int trials,
+          const struct timing_options *timing,
+          int verbose,
+          struct timing_stats *stats);
+
+/**
+ *  A multiplication benchmark for one CSR matrix that is reused across block
+ *  sizes. The session keeps the unblocked taco kernel and the vector buffers
+ *  between calls to spmv_session_test, so that only the blocked matrix and
+ *  its kernel are rebuilt for each block size. The CSR arrays are used in
+ *  place and must outlive the session.
+ *
+ *  \returns On success, returns a session to be released with
+ *  spmv_session_free. On error, returns NULL.
+ */
+struct spmv_session *spmv_session_create (int m,
+                                          int n,
+                                          int nnz,
+                                          const int *ptr,
+                                          const int *ind,
+                                          const double *data,
+                                          int vectors,
+                                          int kernel,
+                                          int verbose);
+
+/**
+ *  Time the multiplication of the session matrix in r by c blocks as in
+ *  test. Also stores the seconds spent converting the matrix to blocks in
+ *  time_convert, and the seconds spent compiling the kernel and preparing
+ *  its operands (summed over thread counts) in time_assemble.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int spmv_session_test (struct spmv_session *session,
+                       int r,
+                       int c,
+                       int nthreads,
+                       const int *threads,
+                       int trials,
+                       const struct timing_options *timing,
+                       double *time_convert,
+                       double *time_assemble,
+                       struct timing_stats *stats);
+
+void spmv_session_free (struct spmv_session *session);
+
+/**
+ *  Measure the machine profile used to choose block sizes: the rate, in
+ *  Mflop/s, at which an m by n dense matrix stored in CSR format is
+ *  multiplied by vectors vectors when converted to each block size up to B by
+ *  B, with each of the nthreads thread counts in threads. The rate for b_r by
+ *  b_c blocks with threads[u] threads is stored in
+ *  profile[(u * B + b_r - 1) * B + b_c - 1]. The matrix is built in memory,
+ *  so m * n must fit in an int.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int spmv_profile (int m,
+                  int n,
+                  int B,
+                  int vectors,
+                  int kernel,
+                  int nthreads,
+                  const int *threads,
+                  int trials,
+                  const struct timing_options *timing,
+                  int verbose,
+                  double *profile);
+
+/* Doubles in each array of the bandwidth benchmark, 64MB per array */
+#define SPMV_STREAM_SIZE (1L << 23)
+
+/**
+ *  Measure the sustained memory bandwidth, in MB/s, of a STREAM triad
+ *  a = b + s * c over arrays of size doubles, counting 24 bytes moved for
+ *  each entry of a, as described by timing.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int spmv_bandwidth (long size, int trials, const struct timing_options *timing, double *bandwidth);
+
+/**
+ *  Parse a comma separated list of positive counts such as "1,2,4,8" into
+ *  counts, which has room for SPMV_MAX_COUNTS entries.
+ *
+ *  \returns On success, returns the number of counts. On error, returns 0.
+ */
+int parse_counts (const char *arg, int *counts);
+
+#endif
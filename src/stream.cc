@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "estimators.h"
+#include "mtx.h"
+#include "stream.h"
+
+/* Entries of the file are read in order of their position in CSR, which is
+ * checked as they are read.
+ */
+struct stream_reader {
+  FILE *f;
+  struct mtx_header header;
+  char *line;
+  size_t line_size;
+  long e;
+  long i;
+  long j;
+};
+
+static int stream_open (struct stream_reader *reader, const char *path, char *error) {
+  reader->line = NULL;
+  reader->line_size = 0;
+  reader->e = 0;
+  reader->i = 0;
+  reader->j = 0;
+  reader->f = mtx_open(path, &reader->header, error);
+  if (reader->f == NULL) {
+    return 1;
+  }
+  if (strcasecmp(reader->header.symmetry, "general") != 0) {
+    snprintf(error, MTX_ERROR_SIZE, "%s must be a general matrix to be streamed, since mirrored entries are out of order", path);
+    fclose(reader->f);
+    return 1;
+  }
+  return 0;
+}
+
+/* Read the next entry into the 0-based reader->i and reader->j */
+static int stream_next (struct stream_reader *reader, const char *path, char *error) {
+  long i, j;
+  double v;
+  int ret = mtx_read_entry(reader->f, &reader->header, &reader->line, &reader->line_size, &i, &j, &v);
+  if (ret < 0) {
+    snprintf(error, MTX_ERROR_SIZE, "%s ends before its %ld entries", path, reader->header.entries);
+    return 1;
+  }
+  if (ret > 0) {
+    snprintf(error, MTX_ERROR_SIZE, "%s has a bad entry on line %ld of its entries", path, reader->e + 1);
+    return 1;
+  }
+  i--;
+  j--;
+  if (reader->e > 0 && (i < reader->i || (i == reader->i && j <= reader->j))) {
+    snprintf(error, MTX_ERROR_SIZE, "%s must be sorted by row and column without duplicates to be streamed, but is not on line %ld of its entries", path, reader->e + 1);
+    return 1;
+  }
+  reader->i = i;
+  reader->j = j;
+  reader->e++;
+  return 0;
+}
+
+static void stream_close (struct stream_reader *reader) {
+  free(reader->line);
+  fclose(reader->f);
+}
+
+int estimate_fill_phil_stream (const char *path,
+                               int B,
+                               double epsilon,
+                               double delta,
+                               double *fill,
+                               long seed,
+                               int trial,
+                               int verbose,
+                               char *error) {
+  struct stream_reader reader;
+  if (stream_open(&reader, path, error)) {
+    return 1;
+  }
+  int m = reader.header.m;
+  int n = reader.header.n;
+  int nnz = reader.header.entries;
+  if (nnz < 1) {
+    snprintf(error, MTX_ERROR_SIZE, "%s has no entries", path);
+    stream_close(&reader);
+    return 1;
+  }
+  int W = 2 * B;
+  int Z[W][W];
+
+  /* Compute the necessary number of samples */
+  int s = fill_samples(nnz, B, epsilon, delta);
+
+  /* Sample s positions of nonzeros exactly as phil does */
+  std::vector<int> samples(s);
+  std::vector<int> samples_i(s);
+  std::vector<int> samples_j(s);
+  std::seed_seq seeder{seed, (long)trial};
+  std::mt19937 generator(seeder);
+  fill_sample_positions(0, nnz, s, s == nnz, &generator, samples.data());
+  std::sort(samples.begin(), samples.end(), std::less<int>());
+
+  /* The first pass finds the (i, j) of each sampled position */
+  int ret = 0;
+  for (int t = 0; t < s && ret == 0; t++) {
+    while (reader.e <= samples[t] && ret == 0) {
+      ret = stream_next(&reader, path, error);
+    }
+    samples_i[t] = reader.i;
+    samples_j[t] = reader.j;
+  }
+  while (reader.e < nnz && ret == 0) {
+    ret = stream_next(&reader, path, error);
+  }
+  stream_close(&reader);
+  if (ret) {
+    return ret;
+  }
+
+  /* The second pass keeps the nonzeros (ii, jj) within B - 1 rows and
+   * columns of a sample in a compressed structure holding only their rows,
+   * so that row rows[k] owns columns cols[row_ptr[k]] to
+   * cols[row_ptr[k + 1] - 1].
+   */
+  std::vector<int> rows;
+  std::vector<long> row_ptr(1, 0);
+  std::vector<int> cols;
+  if (stream_open(&reader, path, error)) {
+    return 1;
+  }
+
+  /* samples lo to hi - 1 are within B - 1 rows of the current row, and
+   * intervals holds the merged column ranges of their neighborhoods.
+   */
+  int lo = 0;
+  int hi = 0;
+  long row = -1;
+  std::vector<std::pair<int, int>> intervals;
+  size_t next = 0;
+  while (reader.e < nnz && ret == 0) {
+    ret = stream_next(&reader, path, error);
+    if (ret) {
+      break;
+    }
+    if (reader.i != row) {
+      row = reader.i;
+      while (lo < s && samples_i[lo] < row - (B - 1)) {
+        lo++;
+      }
+      while (hi < s && samples_i[hi] <= row + (B - 1)) {
+        hi++;
+      }
+      intervals.clear();
+      for (int t = lo; t < hi; t++) {
+        intervals.push_back(std::make_pair(samples_j[t] - (B - 1), samples_j[t] + (B - 1)));
+      }
+      std::sort(intervals.begin(), intervals.end());
+      size_t merged = 0;
+      for (size_t k = 0; k < intervals.size(); k++) {
+        if (merged > 0 && intervals[k].first <= intervals[merged - 1].second + 1) {
+          intervals[merged - 1].second = std::max(intervals[merged - 1].second, intervals[k].second);
+        } else {
+          intervals[merged++] = intervals[k];
+        }
+      }
+      intervals.resize(merged);
+      next = 0;
+    }
+    while (next < intervals.size() && intervals[next].second < reader.j) {
+      next++;
+    }
+    if (next < intervals.size() && intervals[next].first <= reader.j) {
+      if (rows.empty() || rows.back() != row) {
+        rows.push_back(row);
+        row_ptr.push_back(row_ptr.back());
+      }
+      cols.push_back(reader.j);
+      row_ptr.back()++;
+    }
+  }
+  stream_close(&reader);
+  if (ret) {
+    return ret;
+  }
+  if (verbose) {
+    fprintf(stderr, "kept %zu of %d nonzeros in %zu rows for %d samples\n", cols.size(), nnz, rows.size(), s);
+  }
+
+  /* Zero out the fill */
+  for (int k = 0; k < B * B; k++) {
+    fill[k] = 0.0;
+  }
+
+  /* From here on, this is phil on the kept nonzeros */
+  for (int t = 0; t < s; t++) {
+    int i = samples_i[t];
+    int j = samples_j[t];
+
+    /* Fill Z with 0 */
+    std::fill(&Z[0][0], &Z[0][0] + W * W, 0);
+
+    /* Set Z to 1 where there are nonzeros in the neighborhood of (i, j) */
+    int jj_min = std::max(j, B - 1) - (B - 1);
+    int jj_max = std::min(j + (B - 1), n - 1);
+    for (size_t k = std::lower_bound(rows.begin(), rows.end(), i - (B - 1)) - rows.begin(); k < rows.size() && rows[k] <= std::min(i + (B - 1), m - 1); k++) {
+      int r = (B + rows[k]) - i;
+      long scan = std::lower_bound(cols.begin() + row_ptr[k], cols.begin() + row_ptr[k + 1], jj_min) - cols.begin();
+      while (scan < row_ptr[k + 1] && cols[scan] <= jj_max) {
+        int c = (B + cols[scan]) - j;
+        Z[r][c] = 1;
+        scan++;
+      }
+    }
+
+    phil_prefix(B, &Z[0][0]);
+    phil_accumulate(B, i, j, &Z[0][0], fill);
+  }
+
+  phil_normalize(B, s, fill);
+  return 0;
+}
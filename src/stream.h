@@ -0,0 +1,29 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/**
+ *  Estimate the fill of the MatrixMarket matrix at path as estimate_fill_phil
+ *  does, without reading the matrix into memory. The matrix must be a
+ *  general coordinate matrix whose entries are sorted by row, then by
+ *  column, without duplicates, so that the position of each entry in the
+ *  file is its position in CSR. The file is read sequentially twice: the
+ *  first pass finds the rows and columns of the sampled nonzeros, and the
+ *  second keeps only the nonzeros in their neighborhoods, so memory grows
+ *  with the number of samples times B^2 rather than with nnz. The estimates
+ *  are identical to those of estimate_fill_phil on the same matrix with the
+ *  same seed and trial. On error, a message is stored in error, which has
+ *  room for MTX_ERROR_SIZE characters.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int estimate_fill_phil_stream (const char *path,
+                               int B,
+                               double epsilon,
+                               double delta,
+                               double *fill,
+                               long seed,
+                               int trial,
+                               int verbose,
+                               char *error);
+
+#endif
@@ -1,61 +1,89 @@
 #include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
+#include <string>
 #include <random>
+#include <vector>
+#include <omp.h>
+#include "estimators.h"
+#include "mtx.h"
+#include "npy.h"
+#include "phases.h"
+#include "stream.h"
+#include "timing.h"
 
-int estimate_fill (int m,
-                   int n,
-                   int nnz,
-                   const int *ptr,
-                   const int *ind,
-                   int B,
-                   double epsilon,
-                   double delta,
-                   double sigma,
-                   double *fill,
-                   long seed,
-                   int trial,
-                   int verbose);
-
-int test (int m,
-          int n,
-          int nnz,
-          const int *ptr,
-          const int *ind,
-          int B,
-          double epsilon,
-          double delta,
-          double sigma,
-          int trials,
-          int clock,
-          int results,
-          long seed,
-          int verbose) {
-
-  double *fill = (double*)malloc(sizeof(double) * B * B * trials);
-  for (int i = 0; i < B * B * trials; i++) {
-    fill[i] = 0;
-  }
+/* Arguments of one estimate_fill trial */
+struct fill_trial {
+  estimate_fill_t estimate_fill;
+  int m;
+  int n;
+  int nnz;
+  const int *ptr;
+  const int *ind;
+  int B;
+  double epsilon;
+  double delta;
+  double sigma;
+  int trials;
+  double *fill;
+  double *extra;
+  int *offsets;
+  int *extra_offsets;
+  long seed;
+  int verbose;
+  struct fill_workspace *workspace;
+};
 
-  //Load problem into cache
-  estimate_fill(m, n, nnz, ptr, ind, B, epsilon, delta, sigma, fill, seed, trials, verbose);
-  for (int i = 0; i < B * B; i++) {
-    fill[i] = 0;
+/* Trials beyond the recorded ones write their estimates to extra, and
+ * their best offsets, if there are any, to extra_offsets.
+ */
+static void fill_trial (void *arg, int t) {
+  struct fill_trial *a = (struct fill_trial*)arg;
+  double *fill = t < a->trials ? a->fill + t * a->B * a->B : a->extra;
+  if (a->offsets != NULL) {
+    a->workspace->best_offsets = t < a->trials ? a->offsets + 2 * t * a->B * a->B : a->extra_offsets;
   }
+  a->estimate_fill(a->m, a->n, a->nnz, a->ptr, a->ind, a->B, a->epsilon, a->delta, a->sigma, fill, a->seed, t, a->verbose, a->workspace);
+}
 
-  //Benchmark some runs
-  auto tic = std::chrono::high_resolution_clock::now();
-  for (int t = 0; t < trials; t++){
-    estimate_fill(m, n, nnz, ptr, ind, B, epsilon, delta, sigma, fill + t * B * B, seed, t, verbose);
+/* Print the estimates and timings of an estimator as fillest does, after
+ * key, which the caller uses to name them in its own object. format is the
+ * storage format of the estimates in the estimator registry. offsets, if it
+ * is not NULL, holds the row and column offsets of each estimate, which are
+ * printed after the results. Nothing is printed if this fails before the
+ * estimates are printed.
+ */
+static int print_fill (const char *key,
+                       const char *name,
+                       const char *format,
+                       int B,
+                       int trials,
+                       const double *fill,
+                       const int *offsets,
+                       const struct timing_stats *stats,
+                       const struct timing_options *timing,
+                       int clock,
+                       int results,
+                       const char *npy) {
+  /* With npy, the arrays are saved as <npy>_<name>_<key>.npy instead of
+   * being printed.
+   */
+  std::string prefix = npy ? std::string(npy) + "_" + name : "";
+  char times_npy[NPY_PATH_SIZE];
+  if (npy && npy_path(times_npy, prefix.c_str(), "times")) {
+    return 1;
   }
-  auto toc = std::chrono::high_resolution_clock::now();
-  auto diff = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic);
-  double time = diff.count() * 1e-9;
 
-  printf("{\n");
+  int ret = 0;
+  printf("%s{\n", key);
+  printf("  \"format\": \"%s\"%s\n", format, results || clock ? "," : "");
   int i = 0;
-  if (results) {
+  if (results && npy) {
+    long shape[3] = {trials, B, B};
+    ret = npy_print(prefix.c_str(), "results", 3, shape, fill, "  ", clock || offsets);
+  } else if (results) {
     printf("  \"results\": [\n");
     for (int t = 0; t < trials; t++) {
       printf("    [\n");
@@ -69,14 +97,169 @@ int test (int m,
       }
       printf("    ]%s\n", t < trials - 1 ? "," : "");
     }
+    printf("  ]%s\n", clock || offsets ? "," : "");
+  }
+  if (results && offsets && npy) {
+    long shape[4] = {trials, B, B, 2};
+    std::vector<double> data(offsets, offsets + 2L * B * B * trials);
+    ret |= npy_print(prefix.c_str(), "offsets", 4, shape, data.data(), "  ", clock);
+  } else if (results && offsets) {
+    printf("  \"offsets\": [\n");
+    i = 0;
+    for (int t = 0; t < trials; t++) {
+      printf("    [\n");
+      for (int b_r = 1; b_r <= B; b_r++) {
+        printf("      [");
+        for (int b_c = 1; b_c <= B; b_c++) {
+          printf("[%d, %d]%s", offsets[i], offsets[i + 1], b_c <= B - 1 ? ", " : "");
+          i += 2;
+        }
+        printf("]%s\n", b_r <= B - 1 ? "," : "");
+      }
+      printf("    ]%s\n", t < trials - 1 ? "," : "");
+    }
     printf("  ]%s\n", clock ? "," : "");
   }
   if (clock) {
-    printf("  \"total_time\": %.*e,\n", DECIMAL_DIG, time);
-    printf("  \"mean_time\": %.*e%s\n", DECIMAL_DIG, time/trials, 0 ? "," : "");
+    phases_print(omp_get_max_threads(), timing->warmup + stats->trials, "  ", 1);
+    ret |= timing_print(stats, npy ? times_npy : NULL, "  ", 0);
   }
   printf("\n}\n");
 
+  return ret;
+}
+
+int test (const char *key,
+          const struct estimator *estimator,
+          int m,
+          int n,
+          int nnz,
+          const int *ptr,
+          const int *ind,
+          int B,
+          double epsilon,
+          double delta,
+          double sigma,
+          int trials,
+          const struct timing_options *timing,
+          int clock,
+          int results,
+          const char *npy,
+          long seed,
+          int verbose) {
+
+  double *fill = (double*)malloc(sizeof(double) * B * B * trials);
+  double *extra = (double*)malloc(sizeof(double) * B * B);
+
+  /* Estimators of offset blocks also report the offsets of their estimates */
+  int offset_blocks = strcmp(estimator->format, "ubcsr") == 0;
+  int *offsets = NULL;
+  int *extra_offsets = NULL;
+  if (offset_blocks) {
+    offsets = (int*)calloc(2L * B * B * trials, sizeof(int));
+    extra_offsets = (int*)calloc(2L * B * B, sizeof(int));
+  }
+
+  /* Trials reuse one workspace, so that they do not time allocation */
+  struct fill_workspace workspace = FILL_WORKSPACE_INIT;
+  if (fill == NULL || extra == NULL || (offset_blocks && (offsets == NULL || extra_offsets == NULL)) || estimator->reserve_fill(&workspace, m, n, nnz, B, epsilon, delta)) {
+    free(fill);
+    free(extra);
+    free(offsets);
+    free(extra_offsets);
+    return 1;
+  }
+
+  /* The buffers are zeroed once, outside of the timed trials */
+  for (long i = 0; i < (long)B * B * trials; i++) {
+    fill[i] = 0;
+  }
+  for (int i = 0; i < B * B; i++) {
+    extra[i] = 0;
+  }
+
+  struct fill_trial arg = {estimator->estimate_fill, m, n, nnz, ptr, ind, B, epsilon, delta, sigma, trials, fill, extra, offsets, extra_offsets, seed, verbose, &workspace};
+  struct timing_stats stats;
+  phases_reset();
+  int ret = timing_run(timing, trials, fill_trial, &arg, &stats);
+  fill_workspace_free(&workspace);
+  if (ret) {
+    free(fill);
+    free(extra);
+    free(offsets);
+    free(extra_offsets);
+    return ret;
+  }
+
+  ret = print_fill(key, estimator->name, estimator->format, B, trials, fill, offsets, &stats, timing, clock, results, npy);
+
+  timing_free(&stats);
   free(fill);
-  return 0;
+  free(extra);
+  free(offsets);
+  free(extra_offsets);
+  return ret;
+}
+
+/* Arguments of one estimate_fill_phil_stream trial */
+struct stream_trial {
+  const char *path;
+  int B;
+  double epsilon;
+  double delta;
+  int trials;
+  double *fill;
+  double *extra;
+  long seed;
+  int verbose;
+  int ret;
+  char error[MTX_ERROR_SIZE];
+};
+
+static void stream_trial (void *arg, int t) {
+  struct stream_trial *a = (struct stream_trial*)arg;
+  double *fill = t < a->trials ? a->fill + t * a->B * a->B : a->extra;
+  if (a->ret == 0) {
+    a->ret = estimate_fill_phil_stream(a->path, a->B, a->epsilon, a->delta, fill, a->seed, t, a->verbose, a->error);
+  }
+}
+
+int test_stream (const char *key,
+                 const char *path,
+                 int B,
+                 double epsilon,
+                 double delta,
+                 int trials,
+                 const struct timing_options *timing,
+                 int clock,
+                 int results,
+                 const char *npy,
+                 long seed,
+                 int verbose) {
+  struct stream_trial arg;
+  arg.path = path;
+  arg.B = B;
+  arg.epsilon = epsilon;
+  arg.delta = delta;
+  arg.trials = trials;
+  arg.fill = (double*)malloc(sizeof(double) * B * B * trials);
+  arg.extra = (double*)malloc(sizeof(double) * B * B);
+  arg.seed = seed;
+  arg.verbose = verbose;
+  arg.ret = 0;
+  struct timing_stats stats;
+  phases_reset();
+  int ret = arg.fill == NULL || arg.extra == NULL || timing_run(timing, trials, stream_trial, &arg, &stats);
+  if (ret == 0 && arg.ret) {
+    fprintf(stderr, "%s\n", arg.error);
+    timing_free(&stats);
+    ret = arg.ret;
+  }
+  if (ret == 0) {
+    ret = print_fill(key, "phil", "bcsr", B, trials, arg.fill, NULL, &stats, timing, clock, results, npy);
+    timing_free(&stats);
+  }
+  free(arg.fill);
+  free(arg.extra);
+  return ret;
 }
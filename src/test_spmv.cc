@@ -1,119 +1,484 @@
+#include <errno.h>
 #include <float.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <taco.h>
 #include <chrono>
+#include "bcsr.h"
+#include "spmv.h"
 
 using namespace taco;
 
-int test (int m,
-          int n,
-          int nnz,
-          const int *ptr,
-          const int *ind,
-          const double *data,
-          int r,
-          int c,
-          int trials,
-          int verbose,
-          double *time_total,
-          double *time_mean){
-
-  Format  csr({Dense,Sparse});
-  Format bcsr({Dense,Sparse,Dense,Dense});
-  Format  bdv({Dense,Dense});
-  Format   dv({Dense});
-
-  int bm = (m + r - 1)/r;
-  int bn = (n + c - 1)/c;
-  int mm = bm * r;
-  int nn = bn * c;
-
-  // Create tensors
-  Tensor<double> A({bm, bn, r, c}, bcsr);
-  Tensor<double> b({bm, r},   bdv);
-  Tensor<double> x({bn, c},   bdv);
-
-  Tensor<double> Ap({m, n}, csr);
-  Tensor<double> bp({m}, dv);
-  Tensor<double> xp({n}, dv);
-
-  {
-    int i = 0;
-    for (int h = 0; h < nnz; h++){
-      while (ptr[i + 1] <= h) {
-        i++;
-      }
-      int j = ind[h];
-      A.insert({i/r, j/c, i%r, j%c}, data[h]);
+int parse_counts (const char *arg, int *counts) {
+  int ncounts = 0;
+  const char *p = arg;
+  while (*p) {
+    char *end;
+    errno = 0;
+    long longarg = strtol(p, &end, 10);
+    if (errno != 0 || end == p || longarg < 1 || longarg > INT_MAX || ncounts == SPMV_MAX_COUNTS) {
+      return 0;
+    }
+    counts[ncounts] = longarg;
+    ncounts++;
+    if (*end == ',') {
+      end++;
+    } else if (*end) {
+      return 0;
     }
+    p = end;
   }
+  return ncounts;
+}
 
-  {
-    int i = 0;
-    for (int h = 0; h < nnz; h++){
-      while (ptr[i + 1] <= h) {
-        i++;
-      }
-      int j = ind[h];
-      Ap.insert({i, j}, data[h]);
+/* Everything that stays the same from one block size to the next */
+struct spmv_session {
+  int m;
+  int n;
+  int nnz;
+  const int *ptr;
+  const int *ind;
+  const double *data;
+  int vectors;
+  int kernel;
+  int verbose;
+
+  /* x holds x_size ones and y has room for y_size entries */
+  long x_size;
+  long y_size;
+  double *x;
+  double *y;
+
+  /* The unblocked taco kernel, compiled the first time it is needed */
+  int csr_compiled;
+  Tensor<double> Ap;
+  Tensor<double> xp;
+  Tensor<double> bp;
+};
+
+/* Make sure x and y have room for m by n blocked vectors */
+static int spmv_session_reserve (struct spmv_session *session, int m, int n) {
+  long x_size = (long)n * session->vectors;
+  long y_size = (long)m * session->vectors;
+  if (x_size > session->x_size) {
+    double *x = (double*)realloc(session->x, sizeof(double) * x_size);
+    if (x == NULL) {
+      return 1;
+    }
+    for (long h = session->x_size; h < x_size; h++) {
+      x[h] = 1.0;
+    }
+    session->x = x;
+    session->x_size = x_size;
+  }
+  if (y_size > session->y_size) {
+    double *y = (double*)realloc(session->y, sizeof(double) * y_size);
+    if (y == NULL) {
+      return 1;
     }
+    session->y = y;
+    session->y_size = y_size;
   }
+  return 0;
+}
 
-  for(int h = 0; h < nn; h++){
-    x.insert({h/c, h%c}, 1.0);
+struct spmv_session *spmv_session_create (int m,
+                                          int n,
+                                          int nnz,
+                                          const int *ptr,
+                                          const int *ind,
+                                          const double *data,
+                                          int vectors,
+                                          int kernel,
+                                          int verbose) {
+  struct spmv_session *session = new spmv_session;
+  session->m = m;
+  session->n = n;
+  session->nnz = nnz;
+  session->ptr = ptr;
+  session->ind = ind;
+  session->data = data;
+  session->vectors = vectors;
+  session->kernel = kernel;
+  session->verbose = verbose;
+  session->x_size = 0;
+  session->y_size = 0;
+  session->x = NULL;
+  session->y = NULL;
+  session->csr_compiled = 0;
+  if (spmv_session_reserve(session, m, n)) {
+    spmv_session_free(session);
+    return NULL;
   }
 
-  for(int h = 0; h < n; h++){
-    xp.insert({h}, 1.0);
+  if (kernel == SPMV_KERNEL_TACO) {
+    // The CSR matrix is used in place rather than packed again
+    Format  csr({Dense,Sparse});
+    Format  bdv({Dense,Dense});
+    Format   dv({Dense});
+    session->Ap = Tensor<double>({m, n}, csr);
+    session->Ap.getStorage().setIndex(storage::makeCSRIndex(m, (int*)ptr, (int*)ind));
+    session->Ap.getStorage().setValues(storage::makeArray((double*)data, nnz));
+    if (vectors == 1) {
+      session->bp = Tensor<double>({m}, dv);
+      session->xp = Tensor<double>({n}, dv);
+    } else {
+      session->bp = Tensor<double>({m, vectors}, bdv);
+      session->xp = Tensor<double>({n, vectors}, bdv);
+    }
   }
+  return session;
+}
 
-  A.pack();
-  Ap.pack();
+void spmv_session_free (struct spmv_session *session) {
+  free(session->x);
+  free(session->y);
+  delete session;
+}
 
-  x.pack();
-  xp.pack();
+/* Arguments of one native multiplication */
+struct native_trial {
+  const struct bcsr_matrix *A;
+  int p;
+  const int *bounds;
+  int vectors;
+  const double *x;
+  double *y;
+};
 
-  // Form a matrix-vector multiplication expression
-  IndexVar i, j, k, l;
-  b(i, k) = A(i, j, k, l) * x(j,l);
-  bp(i) = Ap(i, j) * xp(j);
+static void native_trial (void *arg, int t) {
+  struct native_trial *a = (struct native_trial*)arg;
+  if (a->vectors > 1) {
+    bcsr_spmm_parallel(a->A, a->p, a->bounds, a->vectors, a->x, a->y);
+  } else if (a->p == 1) {
+    bcsr_spmv(a->A, a->x, a->y);
+  } else {
+    bcsr_spmv_parallel(a->A, a->p, a->bounds, a->x, a->y);
+  }
+}
 
-  // Compile the expression
-  b.compile();
-  b.assemble();
-  bp.compile();
-  bp.assemble();
+static int spmv_session_test_native (struct spmv_session *session,
+                                     int r,
+                                     int c,
+                                     int nthreads,
+                                     const int *threads,
+                                     int trials,
+                                     const struct timing_options *timing,
+                                     double *time_convert,
+                                     double *time_assemble,
+                                     struct timing_stats *stats){
 
-  double time;
+  if (bcsr_kernel(r, c) == NULL) {
+    fprintf(stderr, "native kernels support block sizes up to %d\n", BCSR_MAX_BLOCK);
+    return 1;
+  }
 
-  if (r == 1 && c == 1) {
-    //Load problem into cache
-    bp.compute();
+  auto tic = std::chrono::high_resolution_clock::now();
+  struct bcsr_matrix A;
+  if (bcsr_from_csr(&A, session->m, session->n, session->nnz, session->ptr, session->ind, session->data, r, c)) {
+    return 1;
+  }
+  auto toc = std::chrono::high_resolution_clock::now();
+  *time_convert = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+
+  if (spmv_session_reserve(session, A.bm * r, A.bn * c)) {
+    bcsr_free(&A);
+    return 1;
+  }
+
+  /* x and y are row-major with one column per vector */
+  int vectors = session->vectors;
+  double *x = session->x;
+  double *y = session->y;
+
+  *time_assemble = 0;
+  for (int u = 0; u < nthreads; u++) {
+    int p = threads[u];
+    tic = std::chrono::high_resolution_clock::now();
+    int *bounds = (int*)malloc(sizeof(int) * (p + 1));
+    if (bounds == NULL) {
+      for (int v = 0; v < u; v++) {
+        timing_free(&stats[v]);
+      }
+      bcsr_free(&A);
+      return 1;
+    }
+    bcsr_partition(&A, p, bounds);
+    toc = std::chrono::high_resolution_clock::now();
+    *time_assemble += std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+
+    struct native_trial arg = {&A, p, bounds, vectors, x, y};
+    int ret = timing_run(timing, trials, native_trial, &arg, &stats[u]);
+    free(bounds);
+    if (ret) {
+      for (int v = 0; v < u; v++) {
+        timing_free(&stats[v]);
+      }
+      bcsr_free(&A);
+      return ret;
+    }
+  }
+
+  bcsr_free(&A);
+  return 0;
+}
+
+static void taco_trial (void *arg, int t) {
+  ((TensorBase*)arg)->compute();
+}
+
+int spmv_session_test (struct spmv_session *session,
+                       int r,
+                       int c,
+                       int nthreads,
+                       const int *threads,
+                       int trials,
+                       const struct timing_options *timing,
+                       double *time_convert,
+                       double *time_assemble,
+                       struct timing_stats *stats){
+
+  if (session->kernel == SPMV_KERNEL_NATIVE) {
+    return spmv_session_test_native(session, r, c, nthreads, threads, trials, timing, time_convert, time_assemble, stats);
+  }
+
+  for (int u = 0; u < nthreads; u++) {
+    if (threads[u] != 1) {
+      fprintf(stderr, "taco kernels are single threaded, use the native kernel\n");
+      return 1;
+    }
+  }
+
+  int m = session->m;
+  int n = session->n;
+  int vectors = session->vectors;
+  int ret;
 
-    //Benchmark some runs
+  // Dense operands and results use the session buffers in place, so they
+  // need neither packing nor assembly.
+  if (r == 1 && c == 1) {
+    *time_convert = 0;
     auto tic = std::chrono::high_resolution_clock::now();
-    for (int t = 0; t < trials; t++){
-      bp.compute();
+    if (!session->csr_compiled) {
+      IndexVar i, j, v;
+      if (vectors == 1) {
+        session->bp(i) = session->Ap(i, j) * session->xp(j);
+      } else {
+        session->bp(i, v) = session->Ap(i, j) * session->xp(j, v);
+      }
+      session->bp.compile();
+      session->csr_compiled = 1;
     }
+    session->xp.getStorage().setValues(storage::makeArray(session->x, (size_t)n * vectors));
+    session->bp.getStorage().setValues(storage::makeArray(session->y, (size_t)m * vectors));
     auto toc = std::chrono::high_resolution_clock::now();
-    auto diff = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic);
-    time = diff.count() * 1e-9;
+    *time_assemble = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+
+    ret = timing_run(timing, trials, taco_trial, &session->bp, &stats[0]);
   } else {
-    //Load problem into cache
-    b.compute();
+    Format bcsr({Dense,Sparse,Dense,Dense});
+    Format  bdv({Dense,Dense});
+    Format  bdm({Dense,Dense,Dense});
 
-    //Benchmark some runs
     auto tic = std::chrono::high_resolution_clock::now();
-    for (int t = 0; t < trials; t++){
-      b.compute();
+    struct bcsr_matrix B;
+    if (bcsr_from_csr(&B, m, n, session->nnz, session->ptr, session->ind, session->data, r, c)) {
+      return 1;
+    }
+    if (spmv_session_reserve(session, B.bm * r, B.bn * c)) {
+      bcsr_free(&B);
+      return 1;
     }
+
+    // The blocked arrays are used in place rather than inserted and packed
+    Tensor<double> A({B.bm, B.bn, r, c}, bcsr);
+    A.getStorage().setIndex(storage::Index(bcsr, {
+      storage::ModeIndex({storage::makeArray({B.bm})}),
+      storage::ModeIndex({storage::makeArray(B.ptr, B.bm + 1), storage::makeArray(B.ind, B.nnzb)}),
+      storage::ModeIndex({storage::makeArray({r})}),
+      storage::ModeIndex({storage::makeArray({c})})}));
+    A.getStorage().setValues(storage::makeArray(B.val, (size_t)B.nnzb * r * c));
     auto toc = std::chrono::high_resolution_clock::now();
-    auto diff = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic);
-    time = diff.count() * 1e-9;
+    *time_convert = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+
+    // Multiple vectors are stored row-major, with the vector index innermost
+    tic = std::chrono::high_resolution_clock::now();
+    Tensor<double> b, x;
+    IndexVar i, j, k, l, v;
+    if (vectors == 1) {
+      b = Tensor<double>({B.bm, r}, bdv);
+      x = Tensor<double>({B.bn, c}, bdv);
+      b(i, k) = A(i, j, k, l) * x(j, l);
+    } else {
+      b = Tensor<double>({B.bm, r, vectors}, bdm);
+      x = Tensor<double>({B.bn, c, vectors}, bdm);
+      b(i, k, v) = A(i, j, k, l) * x(j, l, v);
+    }
+    x.getStorage().setValues(storage::makeArray(session->x, (size_t)B.bn * c * vectors));
+    b.getStorage().setValues(storage::makeArray(session->y, (size_t)B.bm * r * vectors));
+    b.compile();
+    toc = std::chrono::high_resolution_clock::now();
+    *time_assemble = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic).count() * 1e-9;
+
+    ret = timing_run(timing, trials, taco_trial, &b, &stats[0]);
+    bcsr_free(&B);
   }
 
-  *time_total = time;
-  *time_mean = time/trials;
+  if (ret) {
+    return ret;
+  }
+
+  // Every thread count takes the same single threaded time
+  for (int u = 1; u < nthreads; u++) {
+    if (timing_copy(&stats[u], &stats[0])) {
+      for (int v = 0; v < u; v++) {
+        timing_free(&stats[v]);
+      }
+      return 1;
+    }
+  }
   return 0;
 }
+
+int test (int m,
+          int n,
+          int nnz,
+          const int *ptr,
+          const int *ind,
+          const double *data,
+          int r,
+          int c,
+          int vectors,
+          int kernel,
+          int nthreads,
+          const int *threads,
+          int trials,
+          const struct timing_options *timing,
+          int verbose,
+          struct timing_stats *stats){
+
+  struct spmv_session *session = spmv_session_create(m, n, nnz, ptr, ind, data, vectors, kernel, verbose);
+  if (session == NULL) {
+    return 1;
+  }
+  double time_convert;
+  double time_assemble;
+  int ret = spmv_session_test(session, r, c, nthreads, threads, trials, timing, &time_convert, &time_assemble, stats);
+  spmv_session_free(session);
+  return ret;
+}
+
+int spmv_profile (int m,
+                  int n,
+                  int B,
+                  int vectors,
+                  int kernel,
+                  int nthreads,
+                  const int *threads,
+                  int trials,
+                  const struct timing_options *timing,
+                  int verbose,
+                  double *profile) {
+  long nnz = (long)m * n;
+  if (nnz > INT_MAX) {
+    return 1;
+  }
+  int *ptr = (int*)malloc(sizeof(int) * (m + 1));
+  int *ind = (int*)malloc(sizeof(int) * nnz);
+  double *data = (double*)malloc(sizeof(double) * nnz);
+  if (ptr == NULL || ind == NULL || data == NULL) {
+    free(ptr);
+    free(ind);
+    free(data);
+    return 1;
+  }
+  for (int i = 0; i <= m; i++) {
+    ptr[i] = i * n;
+  }
+  for (long k = 0; k < nnz; k++) {
+    ind[k] = k % n;
+    data[k] = 1.0;
+  }
+
+  int ret = 0;
+  struct spmv_session *session = spmv_session_create(m, n, nnz, ptr, ind, data, vectors, kernel, verbose);
+  if (session == NULL) {
+    ret = 1;
+  }
+  for (int r = 1; r <= B && ret == 0; r++) {
+    for (int c = 1; c <= B && ret == 0; c++) {
+      /* Empty stats may be freed whether or not the test filled them */
+      struct timing_stats stats[SPMV_MAX_COUNTS];
+      for (int u = 0; u < nthreads; u++) {
+        stats[u].times = NULL;
+        stats[u].counts = NULL;
+      }
+      double time_convert;
+      double time_assemble;
+      ret = spmv_session_test(session, r, c, nthreads, threads, trials, timing, &time_convert, &time_assemble, stats);
+      for (int u = 0; u < nthreads; u++) {
+        if (ret == 0) {
+          profile[(u * B + r - 1) * B + c - 1] = 2.0 * nnz * vectors / stats[u].mean * 1e-6;
+          if (verbose) {
+            fprintf(stderr, "%d by %d blocks with %d threads: %g Mflop/s\n", r, c, threads[u], profile[(u * B + r - 1) * B + c - 1]);
+          }
+        }
+        timing_free(&stats[u]);
+      }
+    }
+  }
+  if (session != NULL) {
+    spmv_session_free(session);
+  }
+  free(ptr);
+  free(ind);
+  free(data);
+  return ret;
+}
+
+/* Arguments of one STREAM triad */
+struct triad_trial {
+  long size;
+  double *a;
+  const double *b;
+  const double *c;
+};
+
+static void triad_trial (void *arg, int t) {
+  struct triad_trial *p = (struct triad_trial*)arg;
+  double *a = p->a;
+  const double *b = p->b;
+  const double *c = p->c;
+  for (long k = 0; k < p->size; k++) {
+    a[k] = b[k] + 3.0 * c[k];
+  }
+}
+
+int spmv_bandwidth (long size, int trials, const struct timing_options *timing, double *bandwidth) {
+  double *a = (double*)malloc(sizeof(double) * size);
+  double *b = (double*)malloc(sizeof(double) * size);
+  double *c = (double*)malloc(sizeof(double) * size);
+  if (a == NULL || b == NULL || c == NULL) {
+    free(a);
+    free(b);
+    free(c);
+    return 1;
+  }
+  for (long k = 0; k < size; k++) {
+    a[k] = 0.0;
+    b[k] = 1.0;
+    c[k] = 2.0;
+  }
+  struct triad_trial arg = {size, a, b, c};
+  struct timing_stats stats;
+  int ret = timing_run(timing, trials, triad_trial, &arg, &stats);
+  if (ret == 0) {
+    *bandwidth = 3.0 * sizeof(double) * size / stats.mean * 1e-6;
+    timing_free(&stats);
+  }
+  free(a);
+  free(b);
+  free(c);
+  return ret;
+}
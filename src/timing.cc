@@ -0,0 +1,246 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <taco.h>
+#include <taco/util/timers.h>
+#include "json.h"
+#include "npy.h"
+#include "timing.h"
+
+void timing_defaults (struct timing_options *options) {
+  options->warmup = 1;
+  options->flush = 0;
+  options->noise = 0;
+  options->max_trials = TIMING_MAX_TRIALS;
+  options->counters = NULL;
+}
+
+static int compare_doubles (const void *a, const void *b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/* The value with rank ceil(q * n) in the sorted array x of length n */
+static double quantile (const double *x, int n, double q) {
+  int k = (int)ceil(q * n) - 1;
+  if (k < 0) {
+    k = 0;
+  }
+  return x[k];
+}
+
+static double median (const double *x, int n) {
+  return n % 2 ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2;
+}
+
+/* The 97.5% quantile of Student's t distribution with df degrees of freedom,
+ * which scales the 95% confidence interval of the mean of df + 1 trials.
+ * Beyond the table, the Cornish-Fisher expansion around the normal quantile
+ * is within 2e-6 of it.
+ */
+static double student_t975 (int df) {
+  static const double table[] = {
+    12.706205, 4.302653, 3.182446, 2.776445, 2.570582,
+    2.446912, 2.364624, 2.306004, 2.262157, 2.228139,
+    2.200985, 2.178813, 2.160369, 2.144787, 2.131450,
+    2.119905, 2.109816, 2.100922, 2.093024, 2.085963,
+    2.079614, 2.073873, 2.068658, 2.063899, 2.059539,
+    2.055529, 2.051831, 2.048407, 2.045230, 2.042272,
+  };
+  int size = sizeof(table) / sizeof(table[0]);
+  if (df < 1) {
+    df = 1;
+  }
+  if (df <= size) {
+    return table[df - 1];
+  }
+  double z = 1.959964;
+  double z3 = z * z * z;
+  double z5 = z3 * z * z;
+  double z7 = z5 * z * z;
+  return z + (z3 + z) / (4.0 * df) +
+         (5 * z5 + 16 * z3 + 3 * z) / (96.0 * df * df) +
+         (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384.0 * df * df * df);
+}
+
+/* Summarize the trials, using sorted as scratch space for stats->trials times */
+static void summarize (struct timing_stats *stats, double *sorted) {
+  int n = stats->trials;
+  double total = 0;
+  for (int t = 0; t < n; t++) {
+    total += stats->times[t];
+  }
+  double mean = total / n;
+  double sq = 0;
+  for (int t = 0; t < n; t++) {
+    sq += (stats->times[t] - mean) * (stats->times[t] - mean);
+  }
+  stats->total = total;
+  stats->mean = mean;
+  stats->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+  stats->ci = student_t975(n - 1) * stats->stddev / sqrt(n);
+
+  for (int t = 0; t < n; t++) {
+    sorted[t] = stats->times[t];
+  }
+  qsort(sorted, n, sizeof(double), compare_doubles);
+  stats->min = sorted[0];
+  stats->median = median(sorted, n);
+  stats->p95 = quantile(sorted, n, 0.95);
+  for (int t = 0; t < n; t++) {
+    sorted[t] = fabs(sorted[t] - stats->median);
+  }
+  qsort(sorted, n, sizeof(double), compare_doubles);
+  stats->mad = median(sorted, n);
+}
+
+int timing_run (const struct timing_options *options,
+                int trials,
+                timing_trial_t trial,
+                void *arg,
+                struct timing_stats *stats) {
+
+  int max_trials = trials;
+  if (options->noise > 0 && options->max_trials > trials) {
+    max_trials = options->max_trials;
+  }
+  struct counters *counters = options->counters;
+  stats->times = (double*)malloc(sizeof(double) * max_trials);
+  stats->counts_nthreads = 0;
+  stats->counts = NULL;
+  if (counters != NULL) {
+    stats->counts_nthreads = counters->nthreads;
+    stats->counts = (long long*)malloc(sizeof(long long) * counters->nthreads * COUNTERS_EVENTS);
+  }
+  double *sorted = (double*)malloc(sizeof(double) * max_trials);
+  if (stats->times == NULL || sorted == NULL || (counters != NULL && stats->counts == NULL)) {
+    free(sorted);
+    timing_free(stats);
+    return 1;
+  }
+
+  //Load problem into cache
+  for (int w = 0; w < options->warmup; w++) {
+    trial(arg, w % trials);
+  }
+
+  taco::util::Timer flusher;
+  volatile double sink = 0;
+  if (counters != NULL) {
+    counters_attach(counters);
+    counters_reset(counters);
+  }
+  int t = 0;
+  while (t < max_trials) {
+    if (options->flush) {
+      sink += flusher.clear_cache();
+    }
+    if (counters != NULL) {
+      counters_enable(counters);
+    }
+    auto tic = std::chrono::high_resolution_clock::now();
+    trial(arg, t);
+    auto toc = std::chrono::high_resolution_clock::now();
+    if (counters != NULL) {
+      counters_disable(counters);
+    }
+    auto diff = std::chrono::duration_cast<std::chrono::nanoseconds>(toc-tic);
+    stats->times[t] = diff.count() * 1e-9;
+    t++;
+
+    if (t >= trials) {
+      if (options->noise <= 0 || t < 2) {
+        break;
+      }
+      stats->trials = t;
+      summarize(stats, sorted);
+      if (stats->ci <= options->noise * stats->mean) {
+        break;
+      }
+    }
+  }
+  stats->trials = t;
+  summarize(stats, sorted);
+  free(sorted);
+  if (counters != NULL) {
+    counters_read(counters, stats->counts);
+  }
+  return 0;
+}
+
+int timing_copy (struct timing_stats *to, const struct timing_stats *from) {
+  *to = *from;
+  to->times = (double*)malloc(sizeof(double) * from->trials);
+  to->counts = NULL;
+  if (from->counts != NULL) {
+    to->counts = (long long*)malloc(sizeof(long long) * from->counts_nthreads * COUNTERS_EVENTS);
+  }
+  if (to->times == NULL || (from->counts != NULL && to->counts == NULL)) {
+    timing_free(to);
+    return 1;
+  }
+  memcpy(to->times, from->times, sizeof(double) * from->trials);
+  if (from->counts != NULL) {
+    memcpy(to->counts, from->counts, sizeof(long long) * from->counts_nthreads * COUNTERS_EVENTS);
+  }
+  return 0;
+}
+
+void timing_free (struct timing_stats *stats) {
+  free(stats->times);
+  free(stats->counts);
+  stats->times = NULL;
+  stats->counts = NULL;
+}
+
+void timing_append (std::string *out, const struct timing_stats *stats, const char *indent, const char *separator) {
+  const struct {
+    const char *key;
+    double value;
+  } members[] = {
+    {"total_time", stats->total},
+    {"mean_time", stats->mean},
+    {"median_time", stats->median},
+    {"mad_time", stats->mad},
+    {"min_time", stats->min},
+    {"p95_time", stats->p95},
+    {"stddev_time", stats->stddev},
+    {"ci_time", stats->ci},
+  };
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%d", stats->trials);
+  out->append(indent).append("\"trials_run\": ").append(buffer).append(separator);
+  for (size_t h = 0; h < sizeof(members) / sizeof(members[0]); h++) {
+    snprintf(buffer, sizeof(buffer), "%.*e", DECIMAL_DIG, members[h].value);
+    out->append(indent).append("\"").append(members[h].key).append("\": ").append(buffer).append(separator);
+  }
+}
+
+int timing_print (const struct timing_stats *stats, const char *times_npy, const char *indent, int comma) {
+  std::string members;
+  timing_append(&members, stats, indent, ",\n");
+  fputs(members.c_str(), stdout);
+  if (stats->counts != NULL) {
+    counters_print(stats->counts_nthreads, stats->counts, indent, 1);
+  }
+  if (times_npy) {
+    long shape[1] = {stats->trials};
+    if (npy_save(times_npy, 1, shape, stats->times)) {
+      fprintf(stderr, "could not write %s\n", times_npy);
+      return 1;
+    }
+    std::string member;
+    json_append_string(&member, times_npy);
+    printf("%s\"times_npy\": %s%s\n", indent, member.c_str(), comma ? "," : "");
+    return 0;
+  }
+  printf("%s\"times\": [", indent);
+  for (int t = 0; t < stats->trials; t++) {
+    printf("%.*e%s", DECIMAL_DIG, stats->times[t], t < stats->trials - 1 ? ", " : "");
+  }
+  printf("]%s\n", comma ? "," : "");
+  return 0;
+}
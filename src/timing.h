@@ -0,0 +1,100 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <string>
+#include "counters.h"
+
+/* Most trials the auto-repeat mode will run before giving up on the noise
+ * threshold.
+ */
+#define TIMING_MAX_TRIALS 1000
+
+/**
+ *  How to time a benchmark. warmup untimed runs precede the timed trials. If
+ *  flush is nonzero, the caches are flushed (outside of the timed region)
+ *  before every timed trial. If noise is greater than 0, trials are added
+ *  until the half width of the 95% confidence interval of the mean falls
+ *  below noise times the mean, or until max_trials trials have been run. If
+ *  counters is not NULL, its events are counted over the timed trials.
+ */
+struct timing_options {
+  int warmup;
+  int flush;
+  double noise;
+  int max_trials;
+  struct counters *counters;
+};
+
+/**
+ *  Statistics of the timed trials, in seconds. times holds the time of each
+ *  trial and is allocated by timing_run, to be released with timing_free.
+ *  mad is the median absolute deviation from the median, stddev is the
+ *  sample standard deviation, and ci is the half width of the 95% confidence
+ *  interval of the mean, from Student's t distribution with trials - 1
+ *  degrees of freedom. If the options had counters, counts holds the
+ *  counts read by counters_read for counts_nthreads threads, and is otherwise
+ *  NULL.
+ */
+struct timing_stats {
+  int trials;
+  double *times;
+  double total;
+  double mean;
+  double median;
+  double mad;
+  double min;
+  double p95;
+  double stddev;
+  double ci;
+  int counts_nthreads;
+  long long *counts;
+};
+
+/**
+ *  A benchmark to be timed. Each call runs trial number trial, which is
+ *  trials or more when auto-repeat adds trials. Warmup runs replay the
+ *  trials that will be timed.
+ */
+typedef void (*timing_trial_t)(void *arg, int trial);
+
+void timing_defaults (struct timing_options *options);
+
+/**
+ *  Run trial(arg, t) for at least trials timed trials as described by
+ *  options and summarize the times in stats.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int timing_run (const struct timing_options *options,
+                int trials,
+                timing_trial_t trial,
+                void *arg,
+                struct timing_stats *stats);
+
+/**
+ *  Make to a copy of from, with its own arrays.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int timing_copy (struct timing_stats *to, const struct timing_stats *from);
+
+void timing_free (struct timing_stats *stats);
+
+/**
+ *  Print the statistics as JSON object members, one per line, each line
+ *  starting with indent. The last member is followed by a comma if comma is
+ *  nonzero. If times_npy is not NULL, the trial times are saved there as a
+ *  .npy array and its path is printed as "times_npy" instead of the times.
+ *
+ *  \returns On success, returns 0. On error, returns an error code.
+ */
+int timing_print (const struct timing_stats *stats, const char *times_npy, const char *indent, int comma);
+
+/**
+ *  Append the summary statistics that timing_print prints (every member but
+ *  the counters and times) to out, each starting with indent and followed by
+ *  separator, so that servers report the same keys as the command line.
+ */
+void timing_append (std::string *out, const struct timing_stats *stats, const char *indent, const char *separator);
+
+#endif
@@ -1,11 +1,14 @@
 import json
 import os
 import scipy.io
-from subprocess import check_output
+import scipy.sparse
+from subprocess import check_output, Popen, PIPE
 import numpy
 import random
 import sys
 import argparse
+import shutil
+import tempfile
 
 top = os.path.realpath(os.path.join(os.path.dirname(os.path.realpath(__file__)), "../"))
 src = os.path.join(top, "src")
@@ -59,8 +62,12 @@ experiment = {
   "run_path" : os.path.join(top, "run"),
   "fill_prefix" : "",
   "fill_vars" : {},
+  "fill_server" : False,
+  "fill_module" : False,
   "spmv_prefix" : "",
   "spmv_vars" : {},
+  "spmv_kernel" : "taco",
+  "block_scorer" : "profile",
   "create_script" : create_bash_script,
   "B" : 12,
   "epsilon" : 0.5,
@@ -70,6 +77,7 @@ experiment = {
   "profile_m" : 1000,
   "profile_n" : 1000,
   "profile_trials" : 1000,
+  "spmm_vectors" : [],
   "verbose" : False
 }
 
@@ -117,6 +125,8 @@ def parse(parser):
 
   experiment["matrix"] = read_path(experiment["matrix_path"])
 
+  experiment["matrix_info"] = os.path.join(experiment["data"], "matrix_info.json")
+
   experiment["run"] = os.path.join(read_path(experiment["run_path"]), experiment["experiment_name"])
 
   experiment["experiment"] = os.path.join(experiment["data"], "experiment", experiment["experiment_name"])
@@ -130,8 +140,19 @@ def parse(parser):
 
   assert isinstance(experiment["fill_prefix"], str), "Fill command prefix must evaluate to a string."
 
+  assert isinstance(experiment["fill_server"], bool), "Fill server setting must evaluate to a boolean."
+
+  assert isinstance(experiment["fill_module"], bool), "Fill module setting must evaluate to a boolean."
+
   assert isinstance(experiment["spmv_prefix"], str), "SPMV command prefix must evaluate to a string."
 
+  assert experiment["spmv_kernel"] in ["taco", "native"], "SPMV kernel must be \"taco\" or \"native\"."
+
+  assert experiment["block_scorer"] in ["profile", "model"], "Block scorer must be \"profile\" or \"model\"."
+
+  if experiment["block_scorer"] == "model":
+    import_pyfillest()
+
   return args
 
 def matrix_path(matrix):
@@ -156,16 +177,62 @@ def matrix_read(matrix):
     print("Problem reading matrix ({0}) at {1}. Double check that matrix is in matrixmarket format.".format(matrix, os.path.join(entry["relpath"], experiment["matrix_path"])))
     raise(e)
 
+matrix_info_cache = None
+
+def matrix_info(matrix):
+  global matrix_info_cache
+  path = matrix_path(matrix)
+  stat = os.stat(path)
+
+  if matrix_info_cache is None:
+    try:
+      with open(experiment["matrix_info"]) as f:
+        matrix_info_cache = json.load(f)
+    except (IOError, ValueError):
+      matrix_info_cache = {}
+
+  entry = matrix_info_cache.get(path)
+  if entry and entry["mtime"] == stat.st_mtime and entry["size"] == stat.st_size:
+    return entry["info"]
+
+  command = [os.path.join(os.path.dirname(os.path.realpath(__file__)), "matrix_info"), path]
+
+  if verbose:
+    print(command)
+
+  try:
+    output = check_output(command)
+  except Exception as e:
+    print("error executing command ({0})".format(command))
+    raise(e)
+
+  try:
+    info = json.loads(output)
+  except ValueError as e:
+    print("Output of command ({0}) must be valid json. Got:".format(command))
+    print(output)
+    raise(e)
+
+  # Concurrent jobs may overwrite each other's entries, which are then
+  # recomputed, but never leave the cache half written.
+  matrix_info_cache[path] = {"mtime": stat.st_mtime, "size": stat.st_size, "info": info}
+  make_path(os.path.dirname(experiment["matrix_info"]))
+  temp = "{0}.{1}".format(experiment["matrix_info"], os.getpid())
+  with open(temp, "w") as f:
+    json.dump(matrix_info_cache, f, indent = 2, sort_keys = True)
+  os.rename(temp, experiment["matrix_info"])
+  return info
+
 def matrix_nnz(matrix):
-  return matrix_read(matrix).nnz
+  return matrix_info(matrix)["nnz"]
 
 def matrix_n(matrix):
-  return matrix_read(matrix).shape[0]
+  return matrix_info(matrix)["m"]
 
 def matrix_m(matrix):
-  return matrix_read(matrix).shape[1]
+  return matrix_info(matrix)["n"]
 
-def spmv_time(matrix, r = 1, c = 1, trials = None):
+def spmv_time(matrix, r = 1, c = 1, trials = None, threads = None, vectors = None):
   myenv = os.environ.copy()
   myenv.update(experiment["spmv_vars"])
   if not trials:
@@ -179,6 +246,11 @@ def spmv_time(matrix, r = 1, c = 1, trials = None):
   command += [os.path.join(os.path.dirname(os.path.realpath(__file__)), "spmv")]
   command += ["-r", "%d" % r]
   command += ["-c", "%d" % c]
+  if vectors:
+    command += ["-k", "%d" % vectors]
+  command += ["-K", experiment["spmv_kernel"]]
+  if threads:
+    command += ["-T", ",".join(["%d" % p for p in threads])]
   command += ["-t", "%d" % trials]
   command += ["-g", "%s" % str(random.randrange(sys.maxint))]
   command += [matrix_path(matrix)]
@@ -201,7 +273,13 @@ def spmv_time(matrix, r = 1, c = 1, trials = None):
 
   return parsed
 
-def spmv_record(matrix, B = None, trials = None):
+def read_npy_output(output):
+  for key in list(output.keys()):
+    if key.endswith("_npy"):
+      output[key[:-len("_npy")]] = numpy.load(output.pop(key))
+  return output
+
+def spmv_record(matrix, B = None, trials = None, threads = None):
   if not B:
     B = experiment["B"]
   if not trials:
@@ -217,29 +295,145 @@ def spmv_record(matrix, B = None, trials = None):
     command = []
   command += [os.path.join(os.path.dirname(os.path.realpath(__file__)), "spmv_record")]
   command += ["-B", "%d" % B]
+  command += ["-K", experiment["spmv_kernel"]]
+  if threads:
+    command += ["-T", ",".join(["%d" % p for p in threads])]
   command += ["-t", "%d" % trials]
   command += ["-g", "%s" % str(random.randrange(sys.maxint))]
+  npy = tempfile.mkdtemp()
+  command += ["-o", os.path.join(npy, "record")]
   command += [matrix_path(matrix)]
 
   if verbose:
     print(command)
 
   try:
-    output = check_output(command, env=myenv)
-  except Exception as e:
-    print("error executing command ({0})".format(command))
-    raise(e)
+    try:
+      output = check_output(command, env=myenv)
+    except Exception as e:
+      print("error executing command ({0})".format(command))
+      raise(e)
+
+    try:
+      parsed = json.loads(output)
+    except ValueError as e:
+      print("Output of command ({0}) must be valid json. Got:".format(command))
+      print(output)
+      raise(e)
+
+    read_npy_output(parsed)
+  finally:
+    shutil.rmtree(npy)
+
+  return parsed
+
+def spmm_record(matrix, vectors, B = None, trials = None, threads = None):
+  if not B:
+    B = experiment["B"]
+  if not trials:
+    trials = experiment["profile_trials"]
+
+  myenv = os.environ.copy()
+  myenv.update(experiment["spmv_vars"])
+
+  prefix = experiment["spmv_prefix"]
+  if prefix:
+    command = prefix.split(" ")
+  else:
+    command = []
+  command += [os.path.join(os.path.dirname(os.path.realpath(__file__)), "spmm_record")]
+  command += ["-B", "%d" % B]
+  command += ["-k", ",".join(["%d" % k for k in vectors])]
+  command += ["-K", experiment["spmv_kernel"]]
+  if threads:
+    command += ["-T", "%d" % threads]
+  command += ["-t", "%d" % trials]
+  npy = tempfile.mkdtemp()
+  command += ["-o", os.path.join(npy, "record")]
+  command += [matrix_path(matrix)]
+
+  if verbose:
+    print(command)
 
   try:
-    parsed = json.loads(output)
-  except ValueError as e:
-    print("Output of command ({0}) must be valid json. Got:".format(command))
-    print(output)
-    raise(e)
+    try:
+      output = check_output(command, env=myenv)
+    except Exception as e:
+      print("error executing command ({0})".format(command))
+      raise(e)
+
+    try:
+      parsed = json.loads(output)
+    except ValueError as e:
+      print("Output of command ({0}) must be valid json. Got:".format(command))
+      print(output)
+      raise(e)
+
+    read_npy_output(parsed)
+  finally:
+    shutil.rmtree(npy)
 
   return parsed
 
-def get_profile(B = None, m = None, n = None, trials = None):
+def profile(B, m, n, trials, threads = None, vectors = None, bandwidth = False):
+  myenv = os.environ.copy()
+  myenv.update(experiment["spmv_vars"])
+
+  prefix = experiment["spmv_prefix"]
+  if prefix:
+    command = prefix.split(" ")
+  else:
+    command = []
+  command += [os.path.join(os.path.dirname(os.path.realpath(__file__)), "profile")]
+  command += ["-B", "%d" % B]
+  command += ["-S", "%dx%d" % (m, n)]
+  if vectors:
+    command += ["-k", "%d" % vectors]
+  command += ["-K", experiment["spmv_kernel"]]
+  if threads:
+    command += ["-T", ",".join(["%d" % p for p in threads])]
+  command += ["-t", "%d" % trials]
+  if bandwidth:
+    command += ["-W"]
+  npy = tempfile.mkdtemp()
+  command += ["-o", os.path.join(npy, "profile")]
+
+  if verbose:
+    print(command)
+
+  try:
+    try:
+      output = check_output(command, env=myenv)
+    except Exception as e:
+      print("error executing command ({0})".format(command))
+      raise(e)
+
+    try:
+      parsed = json.loads(output)
+    except ValueError as e:
+      print("Output of command ({0}) must be valid json. Got:".format(command))
+      print(output)
+      raise(e)
+
+    read_npy_output(parsed)
+  finally:
+    shutil.rmtree(npy)
+
+  if bandwidth:
+    return (parsed["results"], parsed["bandwidth"])
+  return parsed["results"]
+
+def thread_suffix(threads):
+  if threads:
+    return "_t{}".format(threads)
+  return ""
+
+def vector_suffix(vectors):
+  if vectors:
+    return "_k{}".format(vectors)
+  return ""
+
+def get_profiles(threads, B = None, m = None, n = None, trials = None, vectors = None):
   if not B:
     B = experiment["B"]
   if not m:
@@ -251,38 +445,62 @@ def get_profile(B = None, m = None, n = None, trials = None):
 
   make_path(experiment["profile"])
 
-  dense_path = os.path.join(experiment["profile"], "dense_{}_{}.mtx".format(m, n))
-  profile_path = os.path.join(experiment["profile"], "profile_{}_{}_{}_{}.npy".format(B, m, n, trials))
-
-  if not os.path.isfile(dense_path):
-    I = []
-    J = []
-    for i in range(m):
-      for j in range(n):
-        I += [i]
-        J += [j]
-    V = [1.0 for _ in I]
-    dense = scipy.sparse.coo_matrix((V, (I,J)), dtype=numpy.float64)
-    dense = scipy.sparse.csr_matrix(dense)
-    scipy.io.mmwrite(dense_path, dense)
-
-  experiment["matrix_registry"]["__P3T3R_IS_TH3_UB3R_HAX0R__"] = {"name" : "dense_{}_{}.mtx".format(m, n),
-                                                                  "domain" : "synthetic",
-                                                                  "path" : dense_path}
-
-  if not os.path.isfile(profile_path):
-    profile = numpy.ones((B, B))
-    for r in range(1, B + 1):
-      for c in range(1, B + 1):
-        t = spmv_time("__P3T3R_IS_TH3_UB3R_HAX0R__", r = r, c = c, trials = trials)["mean_time"]
-        profile[r-1][c-1] = float(n) * float(m) / float(t)
-    numpy.save(profile_path, profile)
-
-  experiment["matrix_registry"].pop("__P3T3R_IS_TH3_UB3R_HAX0R__", None)
-
-  return numpy.load(profile_path)
-
-def get_spmv_record(matrix, B = None, trials = None):
+  profile_paths = [os.path.join(experiment["profile"], "profile_{}_{}_{}_{}{}{}.npy".format(B, m, n, trials, thread_suffix(p), vector_suffix(vectors))) for p in threads]
+  missing = [p for (p, path) in zip(threads, profile_paths) if not os.path.isfile(path)]
+
+  #the default single threaded profile is timed without a thread sweep
+  for sweep in [[p for p in missing if not p], [p for p in missing if p]]:
+    if not sweep:
+      continue
+    profiles = profile(B = B, m = m, n = n, trials = trials, threads = sweep if sweep[0] else None, vectors = vectors)
+    if not sweep[0]:
+      profiles = [profiles]
+    for (p, result) in zip(sweep, profiles):
+      numpy.save(profile_paths[threads.index(p)], result)
+
+  return [numpy.load(path) for path in profile_paths]
+
+def get_profile(B = None, m = None, n = None, trials = None, threads = None, vectors = None):
+  return get_profiles([threads], B = B, m = m, n = n, trials = trials, vectors = vectors)[0]
+
+#the compute rates of the model are measured on a dense matrix that fits in cache
+model_dim = 128
+
+def get_model(B = None, trials = None):
+  if not B:
+    B = experiment["B"]
+  if not trials:
+    trials = experiment["profile_trials"]
+
+  make_path(experiment["profile"])
+
+  #named like the --model files of autotune, so autotune can share them
+  prefix = os.path.join(experiment["profile"], "model_{}_{}_{}".format(B, model_dim, trials))
+  compute_path = prefix + "_compute.npy"
+  bandwidth_path = prefix + "_bandwidth.npy"
+  if not os.path.isfile(compute_path) or not os.path.isfile(bandwidth_path):
+    (compute, bandwidth) = profile(B = B, m = model_dim, n = model_dim, trials = trials, bandwidth = True)
+    numpy.save(compute_path, compute)
+    numpy.save(bandwidth_path, numpy.array([bandwidth]))
+
+  return (numpy.load(compute_path), numpy.load(bandwidth_path)[0])
+
+#the roofline model is evaluated by estimator_model_time through pyfillest
+def import_pyfillest():
+  try:
+    import pyfillest
+  except ImportError as e:
+    raise ImportError("The model block scorer needs the pyfillest module. Run \"make python\" in src/ to build it. ({})".format(e))
+  return pyfillest
+
+def model_times(matrix, fill, compute, bandwidth):
+  pyfillest = import_pyfillest()
+  info = matrix_info(matrix)
+  times = numpy.zeros(fill.shape)
+  pyfillest.model_times(info["m"], info["n"], info["nnz"], numpy.ascontiguousarray(fill, dtype = numpy.float64), numpy.ascontiguousarray(compute, dtype = numpy.float64), float(bandwidth), times)
+  return times
+
+def get_spmv_record(matrix, B = None, trials = None, threads = None, vectors = None):
   if not B:
     B = experiment["B"]
   if not trials:
@@ -290,14 +508,92 @@ def get_spmv_record(matrix, B = None, trials = None):
 
   make_path(experiment["spmv_records"])
 
-  path = os.path.join(experiment["spmv_records"], "{}_{}_{}.npy".format(matrix, B, trials))
+  if vectors:
+    return get_spmm_records(matrix, [vectors], B = B, trials = trials, threads = threads)[0]
+
+  path = os.path.join(experiment["spmv_records"], "{}_{}_{}{}.npy".format(matrix, B, trials, thread_suffix(threads)))
 
   if not os.path.isfile(path):
-    record = spmv_record(matrix, B = B, trials = trials)["results"]
+    record = spmv_record(matrix, B = B, trials = trials, threads = [threads] if threads else None)["results"]
     numpy.save(path, record)
   return numpy.load(path)
 
-def fill_estimates(name, matrix, B = None, epsilon = None, delta = None, sigma = None, trials = 1, clock = True, results = False, errors = False, blocks = False, spmv_times = False):
+def get_spmm_records(matrix, vectors, B = None, trials = None, threads = None):
+  if not B:
+    B = experiment["B"]
+  if not trials:
+    trials = experiment["profile_trials"]
+
+  make_path(experiment["spmv_records"])
+
+  paths = [os.path.join(experiment["spmv_records"], "{}_{}_{}{}{}.npy".format(matrix, B, trials, thread_suffix(threads), vector_suffix(k))) for k in vectors]
+  missing = [k for (k, path) in zip(vectors, paths) if not os.path.isfile(path)]
+
+  if missing:
+    records = spmm_record(matrix, missing, B = B, trials = trials, threads = threads)["results"]
+    for (k, record) in zip(missing, records):
+      numpy.save(paths[vectors.index(k)], record)
+  return [numpy.load(path) for path in paths]
+
+def fill_estimates(name, matrix, B = None, epsilon = None, delta = None, sigma = None, trials = 1, clock = True, results = False, errors = False, blocks = False, spmv_times = False, threads = None, vectors = None):
+  return fill_estimates_multi([name], matrix, B = B, epsilon = epsilon, delta = delta, sigma = sigma, trials = trials, clock = clock, results = results, errors = errors, blocks = blocks, spmv_times = spmv_times, threads = threads, vectors = vectors)[name]
+
+fill_server = None
+
+def fill_server_request(request):
+  global fill_server
+  if not fill_server:
+    myenv = os.environ.copy()
+    myenv.update(experiment["fill_vars"])
+    prefix = experiment["fill_prefix"]
+    if prefix:
+      command = prefix.split(" ")
+    else:
+      command = []
+    command += [os.path.join(os.path.dirname(os.path.realpath(__file__)), "fillest"), "--serve"]
+    if verbose:
+      print(command)
+    fill_server = Popen(command, stdin=PIPE, stdout=PIPE, env=myenv)
+
+  fill_server.stdin.write(json.dumps(request) + "\n")
+  fill_server.stdin.flush()
+  line = fill_server.stdout.readline()
+  try:
+    parsed = json.loads(line)
+  except Exception as e:
+    print("Fill server response to ({0}) must be valid json. Got:".format(request))
+    print(line)
+    raise(e)
+  assert "error" not in parsed, "Fill server could not run ({0}): {1}".format(request, parsed.get("error"))
+  return parsed
+
+fill_module_matrix = (None, None)
+
+def fill_module_estimates(names, matrix, B, epsilon, delta, sigma, trials, seed):
+  global fill_module_matrix
+  import pyfillest
+  if fill_module_matrix[0] != matrix:
+    A = scipy.sparse.csr_matrix(matrix_read(matrix))
+    A.sort_indices()
+    A.indptr = A.indptr.astype(numpy.intc, copy = False)
+    A.indices = A.indices.astype(numpy.intc, copy = False)
+    fill_module_matrix = (matrix, A)
+  A = fill_module_matrix[1]
+
+  formats = pyfillest.formats()
+  parsed = {}
+  for name in names:
+    results = numpy.zeros((trials, B, B))
+    times = numpy.zeros(trials)
+    #Estimators of offset blocks also report the offsets of their estimates, as fillest does
+    offsets = numpy.zeros((trials, B, B, 2), dtype = numpy.intc) if formats[name] == "ubcsr" else None
+    pyfillest.estimate(name, A.indptr, A.indices, A.shape[1], results, times, epsilon = epsilon, delta = delta, sigma = sigma, seed = seed, offsets = offsets)
+    parsed[name] = {"format": formats[name], "results": results, "times": times, "trials_run": trials, "total_time": numpy.sum(times), "mean_time": numpy.mean(times), "median_time": numpy.median(times), "min_time": numpy.min(times), "stddev_time": numpy.std(times, ddof = 1) if trials > 1 else 0.0}
+    if offsets is not None:
+      parsed[name]["offsets"] = offsets
+  return parsed
+
+def fill_estimates_multi(names, matrix, B = None, epsilon = None, delta = None, sigma = None, trials = 1, clock = True, results = False, errors = False, blocks = False, spmv_times = False, threads = None, vectors = None):
   if not B:
     B = experiment["B"]
   if not epsilon:
@@ -311,66 +607,99 @@ def fill_estimates(name, matrix, B = None, epsilon = None, delta = None, sigma =
   if spmv_times:
     blocks = True
 
-  myenv = os.environ.copy()
-  myenv.update(experiment["fill_vars"])
+  seed = random.randrange(sys.maxint)
 
-  prefix = experiment["fill_prefix"]
-  if prefix:
-    command = prefix.split(" ")
-  else:
-    command = []
-  command += [os.path.join(os.path.dirname(os.path.realpath(__file__)), name)]
-  command += ["-B", "%d" % B]
-  command += ["-e", "%g" % epsilon]
-  command += ["-d", "%g" % delta]
-  command += ["-s", "%g" % sigma]
-  command += ["-t", "%d" % trials]
-  command += ["-g", "%s" % str(random.randrange(sys.maxint))]
-  if clock:
-    command += ["-c"]
+  if experiment["fill_module"]:
+    parsed = fill_module_estimates(names, matrix, B, epsilon, delta, sigma, trials, seed)
+  elif experiment["fill_server"]:
+    parsed = fill_server_request({"matrix": matrix_path(matrix), "algo": ",".join(names), "B": B, "epsilon": epsilon, "delta": delta, "sigma": sigma, "trials": trials, "seed": seed, "clock": clock, "results": results})
   else:
-    command += ["-C"]
-  if results:
-    command += ["-r"]
-  else:
-    command += ["-R"]
-  command += [matrix_path(matrix)]
+    myenv = os.environ.copy()
+    myenv.update(experiment["fill_vars"])
 
-  if verbose:
-    print(command)
+    prefix = experiment["fill_prefix"]
+    if prefix:
+      command = prefix.split(" ")
+    else:
+      command = []
+    command += [os.path.join(os.path.dirname(os.path.realpath(__file__)), "fillest")]
+    command += ["-a", ",".join(names)]
+    command += ["-B", "%d" % B]
+    command += ["-e", "%g" % epsilon]
+    command += ["-d", "%g" % delta]
+    command += ["-s", "%g" % sigma]
+    command += ["-t", "%d" % trials]
+    command += ["-g", "%s" % str(seed)]
+    if clock:
+      command += ["-c"]
+    else:
+      command += ["-C"]
+    if results:
+      command += ["-r"]
+    else:
+      command += ["-R"]
+    npy = tempfile.mkdtemp()
+    command += ["-o", os.path.join(npy, "fill")]
+    command += [matrix_path(matrix)]
 
-  try:
-    output = check_output(command, env=myenv)
-  except Exception as e:
-    print("error executing command ({0})".format(command))
-    raise(e)
+    if verbose:
+      print(command)
 
-  try:
-    parsed = json.loads(output)
-  except Exception as e:
-    print("Output of command ({0}) must be valid json. Got:".format(command))
-    print(output)
-    raise(e)
+    try:
+      try:
+        output = check_output(command, env=myenv)
+      except Exception as e:
+        print("error executing command ({0})".format(command))
+        raise(e)
 
-  try:
-    parsed["results"] = [numpy.array(result) for result in parsed["results"]]
-  except Exception as e:
-    print("Could not read result estimates as numpy arrays. Got:")
-    print(parsed["results"])
-    raise(e)
+      try:
+        parsed = json.loads(output)
+      except Exception as e:
+        print("Output of command ({0}) must be valid json. Got:".format(command))
+        print(output)
+        raise(e)
 
-  if errors:
-    reference = get_reference(matrix, B = B)
-    parsed["errors"] = [numpy.abs(result - reference) / reference for result in parsed["results"]]
-    parsed["max_errors"] = [numpy.max(error) for error in parsed["errors"]]
+      for name in names:
+        read_npy_output(parsed[name])
+    finally:
+      shutil.rmtree(npy)
 
-  if blocks:
-    profile = get_profile(B = B)
-    parsed["blocks"] = [numpy.unravel_index((profile/fill).argmax(), profile.shape) for fill in parsed["results"]]
+  for name in names:
+    output = parsed[name]
+    try:
+      output["results"] = [numpy.array(result) for result in output["results"]]
+    except Exception as e:
+      print("Could not read result estimates as numpy arrays. Got:")
+      print(output["results"])
+      raise(e)
+    if "offsets" in output:
+      output["offsets"] = numpy.array(output["offsets"]).astype(numpy.intc)
+
+    #the reference, profiles and records all describe BCSR, so estimates of
+    #other formats (such as the padding of dia) are neither compared against
+    #them nor scored as block sizes
+    if output["format"] != "bcsr":
+      continue
+
+    if errors:
+      reference = get_reference(matrix, B = B)
+      output["errors"] = [numpy.abs(result - reference) / reference for result in output["results"]]
+      output["max_errors"] = [numpy.max(error) for error in output["errors"]]
+
+    if blocks:
+      if experiment["block_scorer"] == "model":
+        #the model only describes one thread multiplying by one vector
+        if threads or vectors:
+          raise ValueError("The model block scorer only describes single-threaded multiplication by one vector, so it cannot choose blocks for threads = {} and vectors = {}. Use the profile block scorer.".format(threads, vectors))
+        (compute, bandwidth) = get_model(B = B)
+        output["blocks"] = [numpy.unravel_index(model_times(matrix, fill, compute, bandwidth).argmin(), fill.shape) for fill in output["results"]]
+      else:
+        profile = get_profile(B = B, threads = threads, vectors = vectors)
+        output["blocks"] = [numpy.unravel_index((profile/fill).argmax(), profile.shape) for fill in output["results"]]
 
-  if spmv_times:
-    record = get_spmv_record(matrix, B = B)
-    parsed["spmv_times"] = [record[block] for block in parsed["blocks"]]
+    if spmv_times:
+      record = get_spmv_record(matrix, B = B, threads = threads, vectors = vectors)
+      output["spmv_times"] = [record[block] for block in output["blocks"]]
 
   return parsed
 